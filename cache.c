@@ -0,0 +1,403 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include "gdigi.h"
+#include "cache.h"
+
+/*
+ * Host side cache of device preset names and preset contents, kept in
+ * $XDG_CACHE_HOME/gdigi between runs. Cache file is a serialized
+ * GVariant. It is only used if device IDs and firmware version match
+ * the ones it was written for.
+ *
+ * GeNetX data is not cached.
+ */
+
+/** bump whenever CACHE_FORMAT changes */
+#define CACHE_VERSION 1
+
+/** version, device ID, family ID, product ID, OS major, OS minor,
+    preset names of banks, preset contents */
+#define CACHE_FORMAT "(uyyyyya(yas)a(yysa(qyu)))"
+
+typedef struct {
+    guint8 device_id;
+    guint8 family_id;
+    guint8 product_id;
+    guint8 os_major;
+    guint8 os_minor;
+    gchar *filename;
+    GHashTable *names;      /**< bank -> GStrv */
+    GHashTable *presets;    /**< (bank << 8) | index -> Preset */
+    gboolean dirty;         /**< TRUE if cache differs from file */
+} Cache;
+
+G_LOCK_DEFINE_STATIC(cache);
+static Cache *cache = NULL;
+
+#define PRESET_KEY(bank, index) GUINT_TO_POINTER(((bank) << 8) | (index))
+
+/**
+ *  \param preset preset to copy
+ *
+ *  \return copy of preset name and parameters, which must be freed
+ *          using preset_free.
+ **/
+static Preset *cache_preset_copy(Preset *preset)
+{
+    Preset *copy = preset_new();
+
+    copy->name = g_strdup(preset->name);
+    g_array_append_vals(copy->params, preset->params->data,
+                        preset->params->len);
+
+    return copy;
+}
+
+/**
+ *  Reads cache file, if it matches current device.
+ *  Must be called with cache lock held.
+ **/
+static void cache_load()
+{
+    GError *error = NULL;
+    GVariant *file, *data;
+    GVariantIter *banks, *presets, *params;
+    gchar *contents;
+    gsize len;
+    guint32 version;
+    guint8 device_id, family_id, product_id, os_major, os_minor;
+    guint8 bank, index;
+    gchar **names;
+    const gchar *name;
+
+    if (!g_file_get_contents(cache->filename, &contents, &len, &error)) {
+        debug_msg(DEBUG_STARTUP, "No preset cache: %s", error->message);
+        g_error_free(error);
+        return;
+    }
+
+    file = g_variant_new_from_data(G_VARIANT_TYPE(CACHE_FORMAT),
+                                   contents, len, FALSE, g_free, contents);
+    /* file contents are not trusted */
+    data = g_variant_get_normal_form(file);
+    g_variant_unref(file);
+
+    g_variant_get(data, "(uyyyyya(yas)a(yysa(qyu)))",
+                  &version, &device_id, &family_id, &product_id,
+                  &os_major, &os_minor, &banks, &presets);
+
+    if (version != CACHE_VERSION ||
+        device_id != cache->device_id || family_id != cache->family_id ||
+        product_id != cache->product_id ||
+        os_major != cache->os_major || os_minor != cache->os_minor) {
+        debug_msg(DEBUG_STARTUP, "Preset cache is out of date");
+        cache->dirty = TRUE;
+    } else {
+        while (g_variant_iter_next(banks, "(y^as)", &bank, &names)) {
+            g_hash_table_replace(cache->names, GUINT_TO_POINTER(bank), names);
+        }
+
+        while (g_variant_iter_next(presets, "(yy&sa(qyu))",
+                                   &bank, &index, &name, &params)) {
+            Preset *preset = preset_new();
+            SettingParam param;
+            guint16 id;
+            guint8 position;
+            guint32 value;
+
+            preset->name = g_strdup(name);
+            while (g_variant_iter_next(params, "(qyu)",
+                                       &id, &position, &value)) {
+                param.id = id;
+                param.position = position;
+                param.value = value;
+                g_array_append_val(preset->params, param);
+            }
+            g_variant_iter_free(params);
+            /* file may have been written in any order */
+            g_array_sort(preset->params, params_cmp);
+
+            g_hash_table_replace(cache->presets, PRESET_KEY(bank, index),
+                                 preset);
+        }
+
+        debug_msg(DEBUG_STARTUP, "Loaded %d banks and %d presets from cache",
+                  g_hash_table_size(cache->names),
+                  g_hash_table_size(cache->presets));
+    }
+
+    g_variant_iter_free(banks);
+    g_variant_iter_free(presets);
+    g_variant_unref(data);
+}
+
+/**
+ *  Writes cache file. Must be called with cache lock held.
+ **/
+static void cache_save()
+{
+    GError *error = NULL;
+    GVariantBuilder banks, presets, params;
+    GHashTableIter iter;
+    gpointer key, value;
+    GVariant *data;
+    gchar *dir;
+    guint i;
+
+    g_variant_builder_init(&banks, G_VARIANT_TYPE("a(yas)"));
+    g_hash_table_iter_init(&iter, cache->names);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        g_variant_builder_add(&banks, "(y^as)",
+                              (guint8) GPOINTER_TO_UINT(key), value);
+    }
+
+    g_variant_builder_init(&presets, G_VARIANT_TYPE("a(yysa(qyu))"));
+    g_hash_table_iter_init(&iter, cache->presets);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        Preset *preset = value;
+
+        g_variant_builder_init(&params, G_VARIANT_TYPE("a(qyu)"));
+        for (i = 0; i < preset->params->len; i++) {
+            SettingParam *param = &g_array_index(preset->params,
+                                                 SettingParam, i);
+            g_variant_builder_add(&params, "(qyu)",
+                                  (guint16) param->id,
+                                  (guint8) param->position,
+                                  (guint32) param->value);
+        }
+
+        g_variant_builder_add(&presets, "(yysa(qyu))",
+                              (guint8) (GPOINTER_TO_UINT(key) >> 8),
+                              (guint8) GPOINTER_TO_UINT(key),
+                              preset->name ? preset->name : "",
+                              &params);
+    }
+
+    data = g_variant_new("(uyyyyya(yas)a(yysa(qyu)))",
+                         CACHE_VERSION, cache->device_id, cache->family_id,
+                         cache->product_id, cache->os_major, cache->os_minor,
+                         &banks, &presets);
+    g_variant_ref_sink(data);
+
+    dir = g_path_get_dirname(cache->filename);
+    g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+
+    if (!g_file_set_contents(cache->filename,
+                             g_variant_get_data(data),
+                             g_variant_get_size(data), &error)) {
+        g_warning("Failed to write preset cache: %s", error->message);
+        g_error_free(error);
+    } else {
+        cache->dirty = FALSE;
+    }
+
+    g_variant_unref(data);
+}
+
+/**
+ *  \param device_id device ID
+ *  \param family_id family ID
+ *  \param product_id product ID
+ *  \param os_major device firmware major version
+ *  \param os_minor device firmware minor version
+ *
+ *  Opens cache for device. Until this is called, cache is empty and
+ *  ignores all updates.
+ **/
+void cache_open(guint device_id, guint family_id, guint product_id,
+                guint os_major, guint os_minor)
+{
+    gchar *basename;
+
+    G_LOCK(cache);
+    if (cache != NULL) {
+        G_UNLOCK(cache);
+        return;
+    }
+
+    cache = g_slice_new(Cache);
+    cache->device_id = device_id;
+    cache->family_id = family_id;
+    cache->product_id = product_id;
+    cache->os_major = os_major;
+    cache->os_minor = os_minor;
+    cache->dirty = FALSE;
+    cache->names = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                         NULL, (GDestroyNotify) g_strfreev);
+    cache->presets = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                           NULL, (GDestroyNotify) preset_free);
+
+    basename = g_strdup_printf("%02x-%02x-%02x.cache",
+                               family_id, product_id, device_id);
+    cache->filename = g_build_filename(g_get_user_cache_dir(), "gdigi",
+                                       basename, NULL);
+    g_free(basename);
+
+    cache_load();
+    G_UNLOCK(cache);
+}
+
+/**
+ *  Writes cache file if anything changed, then frees cache.
+ **/
+void cache_close()
+{
+    G_LOCK(cache);
+    if (cache != NULL) {
+        if (cache->dirty) {
+            cache_save();
+        }
+
+        g_hash_table_destroy(cache->names);
+        g_hash_table_destroy(cache->presets);
+        g_free(cache->filename);
+        g_slice_free(Cache, cache);
+        cache = NULL;
+    }
+    G_UNLOCK(cache);
+}
+
+/**
+ *  \param bank preset bank
+ *
+ *  \return cached preset names which must be freed with g_strfreev,
+ *          or NULL if bank is not cached.
+ **/
+GStrv cache_get_preset_names(guint bank)
+{
+    GStrv names = NULL;
+
+    G_LOCK(cache);
+    if (cache != NULL) {
+        names = g_strdupv(g_hash_table_lookup(cache->names,
+                                              GUINT_TO_POINTER(bank)));
+    }
+    G_UNLOCK(cache);
+
+    return names;
+}
+
+/**
+ *  \param bank preset bank
+ *  \param names preset names read from device
+ *
+ *  Records preset names of bank. Cached contents of presets whose name
+ *  changed are dropped.
+ *
+ *  \return FALSE if names match cached ones, otherwise TRUE.
+ **/
+gboolean cache_set_preset_names(guint bank, const gchar * const *names)
+{
+    GStrv old;
+    guint i, n_old, n_new;
+    gboolean changed;
+
+    G_LOCK(cache);
+    if (cache == NULL) {
+        G_UNLOCK(cache);
+        return TRUE;
+    }
+
+    old = g_hash_table_lookup(cache->names, GUINT_TO_POINTER(bank));
+    n_old = old ? g_strv_length(old) : 0;
+    n_new = g_strv_length((gchar **) names);
+    changed = (old == NULL);
+
+    for (i = 0; i < MAX(n_old, n_new); i++) {
+        if (i >= n_old || i >= n_new || strcmp(names[i], old[i]) != 0) {
+            g_hash_table_remove(cache->presets, PRESET_KEY(bank, i));
+            changed = TRUE;
+        }
+    }
+
+    if (changed) {
+        g_hash_table_replace(cache->names, GUINT_TO_POINTER(bank),
+                             g_strdupv((gchar **) names));
+        cache->dirty = TRUE;
+    }
+    G_UNLOCK(cache);
+
+    return changed;
+}
+
+/**
+ *  \param bank preset bank
+ *  \param index preset index
+ *
+ *  \return copy of cached preset which must be freed using preset_free,
+ *          or NULL if preset is not cached.
+ **/
+Preset *cache_get_preset(guint bank, guint index)
+{
+    Preset *preset = NULL;
+
+    G_LOCK(cache);
+    if (cache != NULL) {
+        preset = g_hash_table_lookup(cache->presets, PRESET_KEY(bank, index));
+        if (preset != NULL)
+            preset = cache_preset_copy(preset);
+    }
+    G_UNLOCK(cache);
+
+    return preset;
+}
+
+/**
+ *  \param bank preset bank
+ *  \param index preset index
+ *  \param preset preset contents, as stored on device
+ *
+ *  Records preset contents. Preset is copied.
+ **/
+void cache_set_preset(guint bank, guint index, Preset *preset)
+{
+    g_return_if_fail(preset != NULL);
+
+    if (bank == PRESETS_EDIT_BUFFER)
+        return;
+
+    G_LOCK(cache);
+    if (cache != NULL) {
+        g_hash_table_replace(cache->presets, PRESET_KEY(bank, index),
+                             cache_preset_copy(preset));
+        cache->dirty = TRUE;
+    }
+    G_UNLOCK(cache);
+}
+
+/**
+ *  \param bank preset bank
+ *  \param index preset index
+ *
+ *  Forgets preset which was overwritten on device, together with preset
+ *  names of its bank.
+ **/
+void cache_invalidate_preset(guint bank, guint index)
+{
+    G_LOCK(cache);
+    if (cache != NULL) {
+        if (g_hash_table_remove(cache->names, GUINT_TO_POINTER(bank)))
+            cache->dirty = TRUE;
+        if (g_hash_table_remove(cache->presets, PRESET_KEY(bank, index)))
+            cache->dirty = TRUE;
+    }
+    G_UNLOCK(cache);
+}
@@ -0,0 +1,32 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef GDIGI_CACHE_H
+#define GDIGI_CACHE_H
+
+#include <glib.h>
+#include "preset.h"
+
+void cache_open(guint device_id, guint family_id, guint product_id,
+                guint os_major, guint os_minor);
+void cache_close();
+GStrv cache_get_preset_names(guint bank);
+gboolean cache_set_preset_names(guint bank, const gchar * const *names);
+Preset *cache_get_preset(guint bank, guint index);
+void cache_set_preset(guint bank, guint index, Preset *preset);
+void cache_invalidate_preset(guint bank, guint index);
+
+#endif /* GDIGI_CACHE_H */
@@ -4531,6 +4531,24 @@ static Modifier *get_modifier(guint id, guint position)
     return NULL;
 }
 
+/**
+ *  \param id parameter ID
+ *  \param position parameter position
+ *
+ *  \return TRUE if parameter can be linked to modifiers, otherwise FALSE.
+ **/
+gboolean modifier_is_linkable(guint id, guint position)
+{
+    gint x;
+
+    /* first entry is "None" */
+    for (x=1; x<n_modifiers; x++)
+        if ((modifiers[x].id == id) && (modifiers[x].position == position))
+            return TRUE;
+
+    return FALSE;
+}
+
 /**
  *  \param values possible setting values
  *
@@ -4623,14 +4641,18 @@ static void modifier_group_free(ModifierGroup *modifier_group)
  **/
 void update_modifier_linkable_list(GString *msg)
 {
+    LinkableListView view;
     guint group_id;
     guint count;
     guint i;
 
-    unsigned char *str = (unsigned char*)msg->str;
+    if (!linkable_list_view_init(&view, msg)) {
+        g_warning("Truncated RECEIVE_MODIFIER_LINKABLE_LIST message");
+        return;
+    }
 
-    group_id = (str[8] << 8) | str[9];
-    count = (str[10] << 8) | str[11];
+    group_id = view.group_id;
+    count = view.count;
 
     ModifierGroup *modifier_group = g_slice_new(ModifierGroup);
 
@@ -4644,8 +4666,9 @@ void update_modifier_linkable_list(GString *msg)
     EffectGroup *group = g_slice_alloc(count * sizeof(EffectGroup));
 
     for (i=0; i<count; i++) {
-        guint id = (str[12 + (i*3)] << 8) | str[13 + (i*3)];
-        guint position = str[14 + (i*3)];
+        guint id, position;
+
+        linkable_list_view_get(&view, i, &id, &position);
 
         group[i].type = (position << 16) | id;
 
@@ -122,6 +122,7 @@ void update_modifier_linkable_list(GString* msg);
 extern ModifierGroup *ModifierLinkableList;
 EffectGroup *get_modifier_group(void);
 guint get_modifier_amt(void);
+gboolean modifier_is_linkable(guint id, guint position);
 void get_values_info(EffectValues *values,
                      gdouble *min, gdouble *max, gboolean *custom);
 gboolean get_device_info(unsigned char device_id, unsigned char family_id,
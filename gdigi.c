@@ -20,21 +20,175 @@
 #include <getopt.h>
 #include <alsa/asoundlib.h>
 #include <alloca.h>
+#include <sys/eventfd.h>
 #include "gdigi.h"
 #include "gdigi_xml.h"
 #include "gui.h"
+#include "preset.h"
+#include "cache.h"
+#include "profile.h"
+#include "transport.h"
 
 static unsigned char device_id = 0x7F;
 static unsigned char family_id = 0x7F;
 unsigned char product_id = 0x7F;
 
-static snd_rawmidi_t *output = NULL;
-static snd_rawmidi_t *input = NULL;
+static Transport *transport = NULL;
 static char *device_port = NULL;
+static gchar *profile_trace_file = NULL;  /**< set by --profile-startup */
 
-static GQueue *message_queue = NULL;
+/** Chrome trace written by --profile-startup if no file is given */
+#define PROFILE_TRACE_FILE "gdigi-startup-trace.json"
+
+#define OUTPUT_RING_SIZE 65536  /* must be power of two */
+
+/*
+ * Single-producer/single-consumer byte ring between send_data() and
+ * the MIDI writer thread, which is the only writer of the transport.
+ * Head and tail run freely and are masked on access. Senders from
+ * different threads are serialized by output_producer_mutex, the mutex
+ * and conditions below are only used to sleep when the ring is empty
+ * (writer) or full (producer).
+ */
+static guchar output_ring[OUTPUT_RING_SIZE];
+static volatile gint output_ring_head = 0;
+static volatile gint output_ring_tail = 0;
+static volatile gint output_writer_sleeping = FALSE;
+static volatile gint output_producer_waiting = FALSE;
+static gboolean output_writer_stop = FALSE;
+static GMutex *output_producer_mutex = NULL;
+static GMutex *output_mutex = NULL;
+static GCond *output_data_cond = NULL;
+static GCond *output_space_cond = NULL;
+static GThread *output_thread = NULL;
+
+/* output statistics, bytes and writes are counted by transport */
+static guint output_max_depth = 0;
+
+#define N_MESSAGE_SLOTS 256
+
+#define REQUEST_TIMEOUT 2000    /* reply timeout in ms */
+#define LIST_TIMEOUT 30000      /* multi-message reply timeout in ms */
+
+/**
+ *  Dispatch slot of one reply MessageID.
+ *
+ *  Replies that span several messages (RECEIVE_PRESET_START,
+ *  RECEIVE_BULK_DUMP_START) are assembled by the read thread and handed
+ *  out as a single GList, all other replies as plain GStrings.
+ *
+ *  Every reply goes to the oldest request with matching key (bank and
+ *  index of preset, bank of preset names), or is dropped if nobody asked
+ *  for it. Requests which timed out leave a LateReply behind, so their
+ *  reply is dropped too instead of answering a newer request.
+ **/
+typedef struct {
+    GCond *cond;      /**< signalled when synchronous request gets reply */
+    GQueue *requests; /**< DeviceRequests waiting for reply, oldest first */
+    GQueue *late;     /**< LateReply of expired requests, oldest first */
+} MessageSlot;
+
+/** Reply still expected for request which timed out or got cancelled. */
+typedef struct {
+    guint generation;            /**< generation of expired request */
+    gint key;                    /**< key of expired request */
+    gint64 expires;              /**< monotonic time reply is assumed lost */
+} LateReply;
+
+static MessageSlot message_slots[N_MESSAGE_SLOTS];
 static GMutex *message_queue_mutex = NULL;
-static GCond *message_queue_cond = NULL;
+
+/* parameter changes waiting to be sent by set_option_coalesced() */
+G_LOCK_DEFINE_STATIC(pending_options);
+static GHashTable *pending_options = NULL;  /**< key -> newest value */
+static GQueue *pending_option_keys = NULL;  /**< keys in order of change */
+static guint pending_options_source = 0;
+static gint send_interval = 20;             /**< in ms, 0 to disable */
+
+/* received parameters waiting to be shown by apply_gui_params_cb() */
+G_LOCK_DEFINE_STATIC(gui_params);
+static GArray *gui_params = NULL;           /**< SettingParam */
+static GHashTable *gui_param_index = NULL;  /**< key -> index + 1 */
+static guint gui_params_source = 0;
+
+gboolean verify_edit_buffer = FALSE;
+
+/** packed length of len bytes of data */
+#define PACKED_LEN(len) ((len) + ((len) + 6) / 7)
+/** SysEx message length carrying len bytes of data */
+#define SYSEX_LEN(len) (8 + PACKED_LEN(len) + 2)
+/** messages up to this long are built on stack */
+#define SYSEX_STACK_SIZE 512
+/** longest encoded value: length byte and four value bytes */
+#define VALUE_MAX_LEN 5
+/** longest encoded parameter: ID, position and value */
+#define PARAM_MAX_LEN (3 + VALUE_MAX_LEN)
+
+/**
+ *  Outstanding request for a device reply.
+ *
+ *  The request is owned by gdigi and stays valid until its callback
+ *  returns.
+ **/
+struct _DeviceRequest {
+    MessageID reply_id;          /**< MessageID of expected reply */
+    guint generation;            /**< increases with every request */
+    gint key;                    /**< expected reply key, -1 for any */
+    guint timeout;               /**< in milliseconds */
+    RequestStatus status;
+    gpointer reply;              /**< GString, or GList for sequences */
+    gint64 sent_time;            /**< monotonic time request was sent */
+    guint timeout_id;            /**< deadline GSource ID, or 0 */
+    DeviceRequestFunc callback;  /**< NULL for synchronous request */
+    gpointer user_data;
+};
+
+static guint request_generation = 0;
+
+/** Reply statistics, indexed by reply MessageID. */
+typedef struct {
+    guint sent;
+    guint completed;
+    guint timed_out;
+    guint cancelled;
+    gint64 total_latency;        /**< in microseconds */
+    gint64 max_latency;          /**< in microseconds */
+} RequestStats;
+
+static RequestStats request_stats[N_MESSAGE_SLOTS];
+
+/* multi-message reply currently being assembled by the read thread */
+static GList *message_list = NULL;
+static MessageID message_list_id;
+static gint message_list_left = 0;
+
+/* rest of sequence with corrupted message, dropped by read thread */
+static gint message_discard_left = 0;
+static MessageID message_discard_until = -1;
+
+/** how many times corrupted reply gets requested again */
+#define MAX_REREQUESTS 3
+/** how many sent requests are remembered */
+#define MAX_REMEMBERED_REQUESTS 16
+
+/** Sent request that can be safely repeated if its reply gets corrupted. */
+typedef struct {
+    gint procedure;
+    GString *data;
+    MessageID reply_id;
+    gint key;           /**< key of expected reply, see get_request_key() */
+    gint retries;
+} RememberedRequest;
+
+static GQueue *remembered_requests = NULL;  /**< oldest first */
+
+static void send_message_data(gint procedure, const gchar *data, gint len);
+static gsize decode_param(const guchar *str, const guchar *end,
+                          SettingParam *param);
+
+/* received message statistics, indexed by MessageID */
+static guint messages_good[N_MESSAGE_SLOTS];
+static guint messages_bad[N_MESSAGE_SLOTS];
 
 static guint DebugFlags;
 
@@ -74,6 +228,9 @@ gboolean set_debug_flags (const gchar *option_name, const gchar *value,
     if (strchr(value, 'v')) {
         DebugFlags |= DEBUG_VERBOSE;
     }
+    if (strchr(value, 't')) {
+        DebugFlags |= DEBUG_STATS;
+    }
     if (strchr(value, 'a')) {
         DebugFlags = -1;
     }
@@ -81,6 +238,33 @@ gboolean set_debug_flags (const gchar *option_name, const gchar *value,
     return TRUE;
 }
 
+/**
+ *  Enables startup profiling, writing Chrome trace to value, or to
+ *  PROFILE_TRACE_FILE if no value was given.
+ **/
+static gboolean set_profile_startup(const gchar *option_name,
+                                    const gchar *value,
+                                    gpointer data, GError **error)
+{
+    g_free(profile_trace_file);
+    profile_trace_file = g_strdup(value ? value : PROFILE_TRACE_FILE);
+
+    return TRUE;
+}
+
+/**
+ *  Makes gdigi talk to simulated device described by value, or to first
+ *  supported device if no value was given, instead of MIDI device.
+ **/
+static gboolean set_simulate(const gchar *option_name, const gchar *value,
+                             gpointer data, GError **error)
+{
+    g_free(device_port);
+    device_port = g_strconcat("sim:", value ? value : "", NULL);
+
+    return TRUE;
+}
+
 void
 debug_msg (debug_flags_t flags, char *fmt, ...)
 {
@@ -220,153 +404,295 @@ static GQuark gdigi_error_quark()
 }
 
 /**
- *  \param array data to calculate checksum
- *  \param length data length
+ *  Opens transport to device_port, which is ALSA rawmidi device unless
+ *  it names other transport (see transport.c).
+ *  This function modifies global transport variable.
  *
- *  Calculates message checksum.
- *
- *  \return calculated checksum.
+ *  \return FALSE on success, TRUE on error.
  **/
-static char calculate_checksum(gchar *array, gint length)
+gboolean open_device()
 {
-    int x;
-    int checksum = 0;
+    profile_begin("Open MIDI device");
+    transport = transport_open(device_port);
+    profile_end();
 
-    for (x = 0; x<length; x++) {
-        checksum ^= array[x];
-    }
+    return transport == NULL;
+}
 
-    return checksum;
+/**
+ *  \return amount of bytes queued for the MIDI writer thread.
+ **/
+guint get_output_queue_depth()
+{
+    return (guint)g_atomic_int_get(&output_ring_head) -
+           (guint)g_atomic_int_get(&output_ring_tail);
 }
 
 /**
- *  Opens MIDI device. This function modifies global input and output variables.
+ *  \param data unused
  *
- *  \return FALSE on success, TRUE on error.
+ *  MIDI writer thread. Drains the output ring with as few
+ *  transport_write() calls as possible, until asked to stop and
+ *  everything queued has been written.
+ *
+ *  \return NULL.
  **/
-gboolean open_device()
+static gpointer write_data_thread(gpointer data)
 {
-    int err;
+    for (;;) {
+        guint tail = g_atomic_int_get(&output_ring_tail);
+        guint head = g_atomic_int_get(&output_ring_head);
+        guint offset, chunk;
+        gssize err;
+
+        if (head == tail) {
+            gboolean stop;
+
+            g_mutex_lock(output_mutex);
+            g_atomic_int_set(&output_writer_sleeping, TRUE);
+            while (((guint)g_atomic_int_get(&output_ring_head) == tail) &&
+                   !output_writer_stop) {
+                g_cond_wait(output_data_cond, output_mutex);
+            }
+            g_atomic_int_set(&output_writer_sleeping, FALSE);
+            stop = output_writer_stop &&
+                   ((guint)g_atomic_int_get(&output_ring_head) == tail);
+            g_mutex_unlock(output_mutex);
 
-    err = snd_rawmidi_open(&input, &output, device_port, SND_RAWMIDI_SYNC);
-    if (err) {
-        fprintf(stderr, "snd_rawmidi_open %s failed: %d\n", device_port, err);
-        return TRUE;
-    }
+            if (stop)
+                break;
+            continue;
+        }
 
-    err = snd_rawmidi_nonblock(output, 0);
-    if (err) {
-        fprintf(stderr, "snd_rawmidi_nonblock failed: %d\n", err);
-        return TRUE;
+        /* write everything up to the end of ring in one go */
+        offset = tail & (OUTPUT_RING_SIZE - 1);
+        chunk = MIN(head - tail, OUTPUT_RING_SIZE - offset);
+
+        err = transport_write(transport, &output_ring[offset], chunk);
+        if (err == -EINTR)
+            continue;
+        if (err < 0) {
+            g_warning("Failed to write to %s transport: %s",
+                      transport_get_name(transport), g_strerror(-err));
+            err = chunk;    /* drop data, device is gone */
+        }
+
+        g_atomic_int_set(&output_ring_tail, tail + err);
+
+        if (g_atomic_int_get(&output_producer_waiting)) {
+            g_mutex_lock(output_mutex);
+            g_cond_signal(output_space_cond);
+            g_mutex_unlock(output_mutex);
+        }
     }
 
-    snd_rawmidi_read(input, NULL, 0); /* trigger reading */
+    return NULL;
+}
 
-    return FALSE;
+/**
+ *  Starts MIDI writer thread.
+ **/
+static void output_writer_start()
+{
+    output_producer_mutex = g_mutex_new();
+    output_mutex = g_mutex_new();
+    output_data_cond = g_cond_new();
+    output_space_cond = g_cond_new();
+    output_writer_stop = FALSE;
+
+    output_thread = g_thread_create(write_data_thread, NULL, TRUE, NULL);
+}
+
+/**
+ *  Waits until MIDI writer thread wrote all queued data, then stops it.
+ **/
+static void output_writer_finish()
+{
+    if (output_thread == NULL)
+        return;
+
+    g_mutex_lock(output_mutex);
+    output_writer_stop = TRUE;
+    g_cond_signal(output_data_cond);
+    g_mutex_unlock(output_mutex);
+
+    g_thread_join(output_thread);
+    output_thread = NULL;
+
+    debug_msg(DEBUG_STATS, "MIDI output: max queue depth %d bytes",
+              output_max_depth);
+
+    g_mutex_free(output_producer_mutex);
+    g_mutex_free(output_mutex);
+    g_cond_free(output_data_cond);
+    g_cond_free(output_space_cond);
 }
 
 /**
  *  \param data data to be sent
  *  \param length data length
  *
- *  Sends data to device. This function uses global output variable.
+ *  Queues data for the MIDI writer thread. Blocks only if the output
+ *  ring is full.
  **/
 void send_data(char *data, int length)
 {
-    snd_rawmidi_write(output, data, length);
+    g_mutex_lock(output_producer_mutex);
+
+    while (length > 0) {
+        guint head = g_atomic_int_get(&output_ring_head);
+        guint tail = g_atomic_int_get(&output_ring_tail);
+        guint space = OUTPUT_RING_SIZE - (head - tail);
+        guint offset, chunk;
+
+        if (space == 0) {
+            g_mutex_lock(output_mutex);
+            g_atomic_int_set(&output_producer_waiting, TRUE);
+            while ((guint)g_atomic_int_get(&output_ring_tail) == tail) {
+                g_cond_wait(output_space_cond, output_mutex);
+            }
+            g_atomic_int_set(&output_producer_waiting, FALSE);
+            g_mutex_unlock(output_mutex);
+            continue;
+        }
+
+        offset = head & (OUTPUT_RING_SIZE - 1);
+        chunk = MIN(MIN((guint)length, space), OUTPUT_RING_SIZE - offset);
+        memcpy(&output_ring[offset], data, chunk);
+
+        g_atomic_int_set(&output_ring_head, head + chunk);
+        output_max_depth = MAX(output_max_depth, head + chunk - tail);
+
+        data += chunk;
+        length -= chunk;
+
+        if (g_atomic_int_get(&output_writer_sleeping)) {
+            g_mutex_lock(output_mutex);
+            g_cond_signal(output_data_cond);
+            g_mutex_unlock(output_mutex);
+        }
+    }
+
+    g_mutex_unlock(output_producer_mutex);
 }
 
+/** most significant bits of unpacked group, indexed by status byte */
+static guint64 unpack_msb_table[128];
+
 /**
- *  \param data data to be packed
- *  \param len data length
- *
- *  Packs data using method used on all newer DigiTech products.
- *
- *  \return GString containing packed data
+ *  Fills unpack_msb_table. Called once.
  **/
-GString *pack_data(gchar *data, gint len)
+static gpointer unpack_msb_table_init(gpointer data)
 {
-    GString *packed;
-    gint i;
-    gint new_len;
-    unsigned char status;
-    gint status_byte;
-
-    new_len = len + (len/7);
-    packed = g_string_sized_new(new_len);
-    status = 0;
-    status_byte = 0;
-
-    for (i=0; i<len; i++) {
-        if ((i % 7) == 0) {
-            packed->str[status_byte] = status;
-            status = 0;
-            status_byte = packed->len;
-            g_string_append_c(packed, '\0');
+    gint status, x;
+
+    for (status = 0; status < 128; status++) {
+        guint64 msbs = 0;
+
+        for (x = 0; x < 7; x++) {
+            if (status & (0x40 >> x))
+                msbs |= G_GUINT64_CONSTANT(0x80) << (8 * x);
         }
-        g_string_append_c(packed, (data[i] & 0x7F));
-        status |= (data[i] & 0x80) >> ((i%7) + 1);
+        unpack_msb_table[status] = msbs;
     }
-    packed->str[status_byte] = status;
 
-    return packed;
+    return NULL;
 }
 
-static void message_free_func(GString *msg, gpointer user_data)
+/**
+ *  \param dest buffer to store 8 packed bytes
+ *  \param src 7 bytes of data to be packed
+ *
+ *  Packs one full group: status byte holding the most significant bits,
+ *  followed by 7 data bytes with the most significant bit cleared.
+ *
+ *  \return XOR of all 8 packed bytes.
+ **/
+static inline guchar pack_group(guchar *dest, const guchar *src)
 {
-    g_string_free(msg, TRUE);
+    guint64 v = 0;
+    guint64 x;
+    guchar status;
+
+    memcpy(&v, src, 7);
+    v = GUINT64_FROM_LE(v);
+
+    /* gather bit 7 of byte k into bit 6 - k of status */
+    status = ((((v >> 7) & G_GUINT64_CONSTANT(0x0001010101010101)) *
+               G_GUINT64_CONSTANT(0x4020100804020100)) >> 56) & 0x7F;
+    v &= G_GUINT64_CONSTANT(0x007F7F7F7F7F7F7F);
+
+    x = v ^ (v >> 32);
+    x ^= x >> 16;
+    x ^= x >> 8;
+
+    dest[0] = status;
+    v = GUINT64_TO_LE(v);
+    memcpy(&dest[1], &v, 7);
+
+    return (x & 0xFF) ^ status;
 }
 
 /**
- *  \param msg message to unpack
+ *  \param dest buffer to store 7 unpacked bytes, followed by one byte
+ *              that gets overwritten. May overlap src as long as dest
+ *              is not after src.
+ *  \param src 8 packed bytes, followed by at least one more byte
  *
- *  Unpacks message data. This function modifies given GString.
+ *  Unpacks one full group using single 8 byte load and store.
  **/
-static void unpack_message(GString *msg)
+static inline void unpack_group(guchar *dest, const guchar *src)
 {
-    int offset;
-    int x;
-    int i;
-    unsigned char status;
-    unsigned char *str;
-    gboolean stop = FALSE;
+    guint64 v;
+
+    memcpy(&v, &src[1], 8);
+    v = GUINT64_TO_LE(GUINT64_FROM_LE(v) | unpack_msb_table[src[0] & 0x7F]);
+    memcpy(dest, &v, 8);
+}
 
-    g_return_if_fail(msg != NULL);
-    g_return_if_fail(msg->len > 9);
+/**
+ *  \param dest buffer to store packed data, at least PACKED_LEN(len) long
+ *  \param data data to be packed
+ *  \param len data length
+ *  \param checksum checksum to be updated with packed bytes
+ *
+ *  Packs data using method used on all newer DigiTech products.
+ *
+ *  \return packed data length
+ **/
+static gint pack_data(guchar *dest, const gchar *data, gint len,
+                      guchar *checksum)
+{
+    const guchar *src = (const guchar *) data;
+    gint i, j, n = 0;
+    guchar sum = *checksum;
 
-    offset = 1;
-    x = 0;
-    i = 8;
+    for (i = 0; i + 7 <= len; i += 7, n += 8) {
+        sum ^= pack_group(&dest[n], &src[i]);
+    }
 
-    str = (unsigned char*)msg->str;
-    do {
-        offset += 8;
-        status = str[offset-1];
-        for (x=0; x<7 && !stop; x++) {
-            if (offset+x >= msg->len) {
-                i++;
-                stop = TRUE;
-                break;
-            }
-            if (str[offset+x] == 0xF7) {
-                if (x == 0) {
-                    str[i] = status;
-                    i++;
-                }
-                str[i] = 0xF7;
-                i++;
-                stop = TRUE;
-                break;
-            }
+    if (i < len) {
+        guchar *status = &dest[n++];
 
-            str[i] = (((status << (x+1)) & 0x80) | str[x+offset]);
-            i++;
+        *status = 0;
+        for (j = 0; i + j < len; j++) {
+            *status |= (src[i + j] & 0x80) >> (j + 1);
+            dest[n] = src[i + j] & 0x7F;
+            sum ^= dest[n++];
         }
-    } while (!stop);
+        sum ^= *status;
+    }
+
+    *checksum = sum;
+    return n;
+}
 
-    g_string_truncate(msg, i);
+static void message_free_func(GString *msg, gpointer user_data)
+{
+    g_string_free(msg, TRUE);
 }
 
+
 /**
  *  \param msg SysEx message
  *
@@ -386,473 +712,1976 @@ MessageID get_message_id(GString *msg)
     return -1;
 }
 
-#define HEX_WIDTH 26
-
-static gboolean modifier_linkable_list_request_pending = FALSE;
+/**
+ *  \param id MessageID to check
+ *
+ *  Checks whether message starts multi-message reply.
+ *
+ *  \return TRUE if id starts message sequence, otherwise FALSE.
+ **/
+static gboolean is_message_list_id(MessageID id)
+{
+    return (id == RECEIVE_PRESET_START || id == RECEIVE_BULK_DUMP_START);
+}
 
-void push_message(GString *msg)
+/**
+ *  \param msg unpacked message starting message sequence
+ *
+ *  Gets amount of messages following sequence start message.
+ *
+ *  \return amount of messages to follow.
+ **/
+static gint get_message_list_length(GString *msg)
 {
-    MessageID msgid = get_message_id(msg);
-    if (((unsigned char)msg->str[0] == 0xF0) &&
-            ((unsigned char)msg->str[msg->len-1] == 0xF7)) {
-        debug_msg(DEBUG_VERBOSE, "Pushing correct message!");
-    } else {
-        g_warning("Pushing incorrect message!");
-    }
+    PresetStartView view;
 
-    int x;
-    if (debug_flag_is_set(DEBUG_HEX)) {
-        for (x = 0; x<msg->len; x++) {
-            if (x && (x % HEX_WIDTH) == 0) {
-                printf("\n");
+    switch (get_message_id(msg)) {
+        case RECEIVE_PRESET_START:
+            if (!preset_start_view_init(&view, msg)) {
+                g_warning("Truncated RECEIVE_PRESET_START message");
+                return 0;
             }
-            printf("%02x ", (unsigned char)msg->str[x]);
-        }
-        if (x % HEX_WIDTH) {
-            printf("\n");
-        }
+            return view.n_messages;
+        case RECEIVE_BULK_DUMP_START:
+            return ((unsigned char)msg->str[8] << 8) |
+                   (unsigned char)msg->str[9];
+        default:
+            g_assert(!"BUG");
+            return 0;
     }
-    debug_msg(DEBUG_VERBOSE, "Received %s", get_message_name(msgid));
-
-    SettingParam *param;
-    switch (msgid) {
-        case ACK:
-            g_string_free(msg, TRUE);
-            return;
-
-        case NACK:
-            g_warning("Received NACK!");
-            g_string_free(msg, TRUE);
-            return;
+}
 
-        case RECEIVE_PARAMETER_VALUE:
-        {
-            unpack_message(msg);
-            param = setting_param_new_from_data(&msg->str[8], NULL);
-            if (debug_flag_is_set(DEBUG_MSG2HOST)) {
-                GString *ipv = format_ipv(param->id,
-                                          param->position,
-                                          param->value);
-                debug_msg(DEBUG_MSG2HOST, "RECEIVE_PARAMETER_VALUE\n%s",
-                                          ipv->str);
-                g_string_free(ipv, TRUE);
-            }
+static gboolean device_request_done_cb(gpointer data);
 
-            GDK_THREADS_ENTER();
-            apply_setting_param_to_gui(param);
-            GDK_THREADS_LEAVE();
+/**
+ *  \param id reply MessageID
+ *  \param status final request status
+ *  \param sent_time monotonic time request was sent
+ *
+ *  Accounts finished request in reply statistics.
+ *  message_queue_mutex must be held by caller.
+ **/
+static void request_stats_add(MessageID id, RequestStatus status,
+                              gint64 sent_time)
+{
+    RequestStats *stats = &request_stats[id & (N_MESSAGE_SLOTS - 1)];
+    gint64 latency;
+
+    switch (status) {
+        case REQUEST_DONE:
+            latency = g_get_monotonic_time() - sent_time;
+            stats->completed++;
+            stats->total_latency += latency;
+            stats->max_latency = MAX(stats->max_latency, latency);
+            break;
+        case REQUEST_TIMED_OUT:
+            stats->timed_out++;
+            break;
+        case REQUEST_CANCELLED:
+            stats->cancelled++;
+            break;
+        default:
+            break;
+    }
+}
 
-            setting_param_free(param);
-            g_string_free(msg, TRUE);
-            return;
-        }
+/**
+ *  Prints reply statistics for every MessageID that was requested.
+ **/
+static void request_stats_dump()
+{
+    gint x;
 
-        case RECEIVE_DEVICE_NOTIFICATION:
-            unpack_message(msg);
-            unsigned char *str = (unsigned char*)msg->str;
-            switch (str[8]) {
-            case NOTIFY_PRESET_MOVED:
-                if (str[11] == PRESETS_EDIT_BUFFER && str[12] == 0) {
+    for (x = 0; x < N_MESSAGE_SLOTS; x++) {
+        RequestStats *stats = &request_stats[x];
 
-                    GDK_THREADS_ENTER();
-                    g_timeout_add(0, apply_current_preset_to_gui, NULL);
-                    GDK_THREADS_LEAVE();
-                    debug_msg(DEBUG_MSG2HOST,
-                              "RECEIVE_DEVICE_NOTIFICATION: Loaded preset "
-                              "%d from bank %d",
-                              str[10], str[9]);
-                } else {
-                    debug_msg(DEBUG_MSG2HOST,
-                              "RECEIVE_DEVICE_NOTIFICATION: %d %d moved to "
-                              "%d %d",
-                              str[9], str[10],
-                              str[11], str[12]);
-                }
-                break;
+        if (stats->sent == 0)
+            continue;
 
-            case NOTIFY_MODIFIER_GROUP_CHANGED:
-            {
-                int i;
-                if (debug_flag_is_set(DEBUG_HEX)) {
-                    printf("\n");
-                    for (i = 0; i < msg->len; i++) {
-                        printf(" %02x", (unsigned char) str[i]);
-                    }
-                    printf("\n");
-                }
+        debug_msg(DEBUG_STATS,
+                  "%-32s sent %4d done %4d timed out %3d cancelled %3d "
+                  "latency avg %6.2f ms max %6.2f ms",
+                  get_message_name(x), stats->sent, stats->completed,
+                  stats->timed_out, stats->cancelled,
+                  stats->completed ?
+                      stats->total_latency / 1000.0 / stats->completed : 0.0,
+                  stats->max_latency / 1000.0);
+    }
+}
 
-                debug_msg(DEBUG_MSG2HOST,
-                          "NOTIFY_MODIFIER_GROUP_CHANGED: Modifier group "
-                          "id %d changed",
-                          (str[9] << 8) | (str[10]));
+/**
+ *  \param id reply MessageID
+ *  \param data reply (message or message list)
+ *
+ *  Frees reply.
+ **/
+static void message_data_free(MessageID id, gpointer data)
+{
+    if (is_message_list_id(id)) {
+        message_list_free(data);
+    } else {
+        g_string_free(data, TRUE);
+    }
+}
 
-                if (!modifier_linkable_list_request_pending) {
-                    send_message(REQUEST_MODIFIER_LINKABLE_LIST, "\x00\x01", 2);
-                    modifier_linkable_list_request_pending = TRUE;
-                }
+/**
+ *  \param procedure procedure ID of request
+ *  \param data request data
+ *  \param len data length
+ *
+ *  \return key of reply expected by request, -1 if any reply with
+ *          right MessageID answers it.
+ **/
+static gint get_request_key(gint procedure, const gchar *data, gint len)
+{
+    switch (procedure) {
+        case REQUEST_PRESET:
+            if (len < 2)
+                return -1;
+            return ((guchar) data[0] << 8) | (guchar) data[1];
+        case REQUEST_PRESET_NAMES:
+            if (len < 1)
+                return -1;
+            return (guchar) data[0];
+        default:
+            return -1;
+    }
+}
 
-                break;
-            }
-            default:
-                g_warning("Received unhandled device notification 0x%x",
-                          str[11]);
-            }
-            g_string_free(msg, TRUE);
-            return;
-        case RECEIVE_GLOBAL_PARAMETERS:
-            unpack_message(msg);
-            gint tot, n, x;
-            tot = (unsigned char)msg->str[9];
-            if (debug_flag_is_set(DEBUG_HEX)) {
-                for (n = 0; n < msg->len; n++) {
-                    printf("%02x ",(unsigned char) msg->str[n]);
-                }
-                printf("\n");
-            }
+/**
+ *  \param msg reply message, first one of message list
+ *
+ *  Device echoes requested bank and index in RECEIVE_PRESET_START,
+ *  and requested bank in RECEIVE_PRESET_NAMES.
+ *
+ *  \return key of reply, -1 if message carries none or its header
+ *          doesn't decode.
+ **/
+static gint get_message_key(GString *msg)
+{
+    PresetStartView start;
+    NameIter names;
+
+    switch (get_message_id(msg)) {
+        case RECEIVE_PRESET_START:
+            if (!preset_start_view_init(&start, msg))
+                return -1;
+            return (start.bank << 8) | start.index;
+        case RECEIVE_PRESET_NAMES:
+            if (!name_iter_init(&names, msg))
+                return -1;
+            return names.bank;
+        default:
+            return -1;
+    }
+}
 
-            n = 0;
-            x = 10;
-            do {
-                param = setting_param_new_from_data(&msg->str[x], &x);
-                debug_msg(DEBUG_MSG2HOST,
-                          "RECEIVE_GLOBAL_PARAMETERS ID: %5d "
-                          "Position: %2.1d Value: %6.1d: %s",
-                          param->id,
-                          param->position, param->value, "XXX");
+/**
+ *  \param id reply MessageID
+ *  \param data reply (message or message list)
+ *
+ *  \return key of reply, -1 if reply carries none.
+ **/
+static gint get_reply_key(MessageID id, gpointer data)
+{
+    if (is_message_list_id(id))
+        return get_message_key(((GList *) data)->data);
 
-                GDK_THREADS_ENTER();
-                apply_setting_param_to_gui(param);
-                GDK_THREADS_LEAVE();
+    return get_message_key(data);
+}
 
-                setting_param_free(param);
-            } while ( (x < msg->len) && n < tot);
+/**
+ *  \param expected key of request
+ *  \param key key of reply
+ *
+ *  \return TRUE if reply answers request.
+ **/
+static inline gboolean reply_key_matches(gint expected, gint key)
+{
+    return expected == -1 || key == -1 || expected == key;
+}
 
-            g_string_free(msg, TRUE);
+/**
+ *  \param request DeviceRequest which timed out or got cancelled
+ *
+ *  Removes request from its slot, remembering that its reply is still
+ *  on the way. message_queue_mutex must be held by caller.
+ **/
+static void message_slot_expire(DeviceRequest *request)
+{
+    MessageSlot *slot = &message_slots[request->reply_id & (N_MESSAGE_SLOTS - 1)];
+    LateReply *late = g_slice_new(LateReply);
+
+    g_queue_remove(slot->requests, request);
+
+    /* reply later than twice the deadline is assumed lost */
+    late->generation = request->generation;
+    late->key = request->key;
+    late->expires = g_get_monotonic_time() + request->timeout * 1000L;
+    g_queue_push_tail(slot->late, late);
+}
+
+/**
+ *  \param id MessageID of slot
+ *  \param data reply (message or message list), taken over
+ *
+ *  Hands reply to the oldest request waiting for it. Synchronous
+ *  requests are woken up, asynchronous ones completed on main context.
+ *  Late and unexpected replies are dropped.
+ *  message_queue_mutex must be held by caller.
+ **/
+static void message_slot_push(MessageID id, gpointer data)
+{
+    MessageSlot *slot = &message_slots[id & (N_MESSAGE_SLOTS - 1)];
+    gint key = get_reply_key(id, data);
+    gint64 now = g_get_monotonic_time();
+    DeviceRequest *request = NULL;
+    LateReply *late = NULL;
+    GList *iter, *next;
+
+    for (iter = slot->requests->head; iter; iter = iter->next) {
+        if (reply_key_matches(((DeviceRequest *) iter->data)->key, key)) {
+            request = iter->data;
+            break;
+        }
+    }
+
+    for (iter = slot->late->head; iter; iter = next) {
+        LateReply *entry = iter->data;
+
+        next = iter->next;
+        if (entry->expires <= now) {
+            g_queue_delete_link(slot->late, iter);
+            g_slice_free(LateReply, entry);
+        } else if (late == NULL && reply_key_matches(entry->key, key)) {
+            late = entry;
+        }
+    }
+
+    /* device answers in order, so reply belongs to the oldest request */
+    if (late != NULL &&
+        (request == NULL || late->generation < request->generation)) {
+        debug_msg(DEBUG_STATS, "Dropping late %s reply to request %u",
+                  get_message_name(id), late->generation);
+        g_queue_remove(slot->late, late);
+        g_slice_free(LateReply, late);
+        message_data_free(id, data);
+        return;
+    }
+
+    if (request == NULL) {
+        debug_msg(DEBUG_STATS, "Dropping unexpected %s",
+                  get_message_name(id));
+        message_data_free(id, data);
+        return;
+    }
+
+    g_queue_remove(slot->requests, request);
+    request->reply = data;
+    request->status = REQUEST_DONE;
+
+    if (request->callback == NULL) {
+        g_cond_broadcast(slot->cond);
+    } else {
+        g_idle_add(device_request_done_cb, request);
+    }
+}
+
+/**
+ *  \param procedure procedure ID
+ *  \param data unpacked message data
+ *  \param len data length
+ *  \param reply_id MessageID of expected reply
+ *  \param timeout maximum time to wait for reply in milliseconds
+ *  \param callback callback, NULL for synchronous request
+ *  \param user_data data to pass to callback
+ *
+ *  Creates request and registers it in slot of reply_id, so the reply
+ *  can't arrive before request is known.
+ *
+ *  \return new DeviceRequest.
+ **/
+static DeviceRequest *device_request_register(gint procedure,
+                                              const gchar *data, gint len,
+                                              MessageID reply_id,
+                                              guint timeout,
+                                              DeviceRequestFunc callback,
+                                              gpointer user_data)
+{
+    DeviceRequest *request = g_slice_new(DeviceRequest);
+    MessageSlot *slot = &message_slots[reply_id & (N_MESSAGE_SLOTS - 1)];
+
+    request->reply_id = reply_id;
+    request->key = get_request_key(procedure, data, len);
+    request->timeout = timeout;
+    request->status = REQUEST_PENDING;
+    request->reply = NULL;
+    request->callback = callback;
+    request->user_data = user_data;
+    request->timeout_id = 0;
+
+    g_mutex_lock(message_queue_mutex);
+    request->generation = ++request_generation;
+    request->sent_time = g_get_monotonic_time();
+    g_queue_push_tail(slot->requests, request);
+    request_stats[reply_id & (N_MESSAGE_SLOTS - 1)].sent++;
+    g_mutex_unlock(message_queue_mutex);
+
+    return request;
+}
+
+/**
+ *  \param procedure procedure ID
+ *  \param data unpacked message data
+ *  \param len data length
+ *  \param reply_id MessageID of expected reply
+ *  \param timeout maximum time to wait for reply in milliseconds
+ *
+ *  Sends message and waits for its reply. Calling thread is blocked,
+ *  so GUI uses device_request_send() instead; on main thread this is
+ *  only used at startup, before main loop runs.
+ *
+ *  \return reply (GString, or GList of GStrings for message sequences)
+ *          which must be freed by caller, or NULL if nothing arrived
+ *          within timeout.
+ **/
+static gpointer device_request_wait(gint procedure, gchar *data, gint len,
+                                    MessageID reply_id, guint timeout)
+{
+    MessageSlot *slot = &message_slots[reply_id & (N_MESSAGE_SLOTS - 1)];
+    DeviceRequest *request;
+    GTimeVal deadline;
+    gpointer reply;
+
+    request = device_request_register(procedure, data, len, reply_id,
+                                      timeout, NULL, NULL);
+    send_message(procedure, data, len);
+
+    g_get_current_time(&deadline);
+    g_time_val_add(&deadline, timeout * 1000L);
+
+    g_mutex_lock(message_queue_mutex);
+    while (request->status == REQUEST_PENDING) {
+        if (!g_cond_timed_wait(slot->cond, message_queue_mutex, &deadline))
+            break;
+    }
+    if (request->status == REQUEST_PENDING) {
+        message_slot_expire(request);
+        request->status = REQUEST_TIMED_OUT;
+    }
+    request_stats_add(reply_id, request->status, request->sent_time);
+    g_mutex_unlock(message_queue_mutex);
+
+    reply = request->reply;
+    if (reply == NULL) {
+        g_warning("Timed out waiting for %s", get_message_name(reply_id));
+    }
+
+    g_slice_free(DeviceRequest, request);
+
+    return reply;
+}
+
+/**
+ *  \param request finished DeviceRequest
+ *
+ *  Runs request callback, then frees request. Must be called from
+ *  main context.
+ **/
+static void device_request_finish(DeviceRequest *request)
+{
+    if (request->timeout_id != 0) {
+        g_source_remove(request->timeout_id);
+        request->timeout_id = 0;
+    }
+
+    g_mutex_lock(message_queue_mutex);
+    request_stats_add(request->reply_id, request->status,
+                      request->sent_time);
+    g_mutex_unlock(message_queue_mutex);
+
+    if (request->status != REQUEST_DONE) {
+        debug_msg(DEBUG_STATS, "%s request %s",
+                  get_message_name(request->reply_id),
+                  request->status == REQUEST_TIMED_OUT ?
+                      "timed out" : "cancelled");
+    }
+
+    if (request->callback != NULL) {
+        request->callback(request, request->user_data);
+    }
+
+    if (request->reply != NULL) {
+        message_data_free(request->reply_id, request->reply);
+    }
+
+    g_slice_free(DeviceRequest, request);
+}
+
+/**
+ *  \param data DeviceRequest which got reply
+ *
+ *  Idle callback completing request on main context.
+ *
+ *  \return FALSE.
+ **/
+static gboolean device_request_done_cb(gpointer data)
+{
+    device_request_finish((DeviceRequest *) data);
+    return FALSE;
+}
+
+/**
+ *  \param data DeviceRequest which deadline passed
+ *
+ *  Timeout callback expiring request unless reply has already arrived.
+ *
+ *  \return FALSE.
+ **/
+static gboolean device_request_timeout_cb(gpointer data)
+{
+    DeviceRequest *request = data;
+    gboolean expired = FALSE;
+
+    request->timeout_id = 0;
+
+    g_mutex_lock(message_queue_mutex);
+    if (request->status == REQUEST_PENDING) {
+        message_slot_expire(request);
+        request->status = REQUEST_TIMED_OUT;
+        expired = TRUE;
+    }
+    g_mutex_unlock(message_queue_mutex);
+
+    /* otherwise reply arrived and device_request_done_cb is queued */
+    if (expired) {
+        device_request_finish(request);
+    }
+
+    return FALSE;
+}
+
+/**
+ *  \param procedure procedure ID
+ *  \param data unpacked message data
+ *  \param len data length
+ *  \param reply_id MessageID of expected reply
+ *  \param timeout maximum time to wait for reply in milliseconds
+ *  \param callback function to call on main context once request
+ *                  is finished (may be NULL)
+ *  \param user_data data to pass to callback
+ *
+ *  Sends message without waiting for reply. Callback is called exactly
+ *  once, when reply arrives, deadline passes or request gets cancelled.
+ *
+ *  \return DeviceRequest, valid until callback returns.
+ **/
+DeviceRequest *device_request_send(gint procedure, gchar *data, gint len,
+                                   MessageID reply_id, guint timeout,
+                                   DeviceRequestFunc callback,
+                                   gpointer user_data)
+{
+    DeviceRequest *request;
+
+    g_return_val_if_fail(callback != NULL, NULL);
+
+    request = device_request_register(procedure, data, len, reply_id,
+                                      timeout, callback, user_data);
+    request->timeout_id = g_timeout_add(timeout, device_request_timeout_cb,
+                                        request);
+
+    send_message(procedure, data, len);
+
+    return request;
+}
+
+/**
+ *  \param request pending DeviceRequest
+ *
+ *  Cancels request. Callback is called with REQUEST_CANCELLED status
+ *  unless reply has already arrived. Must be called from main context.
+ **/
+void device_request_cancel(DeviceRequest *request)
+{
+    gboolean cancelled = FALSE;
+
+    g_return_if_fail(request != NULL);
+
+    g_mutex_lock(message_queue_mutex);
+    if (request->status == REQUEST_PENDING) {
+        message_slot_expire(request);
+        request->status = REQUEST_CANCELLED;
+        cancelled = TRUE;
+    }
+    g_mutex_unlock(message_queue_mutex);
+
+    if (cancelled) {
+        device_request_finish(request);
+    }
+}
+
+/**
+ *  \param request DeviceRequest
+ *
+ *  \return current request status.
+ **/
+RequestStatus device_request_get_status(DeviceRequest *request)
+{
+    RequestStatus status;
+
+    g_return_val_if_fail(request != NULL, REQUEST_CANCELLED);
+
+    g_mutex_lock(message_queue_mutex);
+    status = request->status;
+    g_mutex_unlock(message_queue_mutex);
+
+    return status;
+}
+
+/**
+ *  \param request finished DeviceRequest
+ *
+ *  Takes ownership of reply. Meant to be called from request callback.
+ *
+ *  \return unpacked reply (GString, or GList of GStrings for message
+ *          sequences) which must be freed by caller, or NULL.
+ **/
+gpointer device_request_steal_reply(DeviceRequest *request)
+{
+    gpointer reply;
+
+    g_return_val_if_fail(request != NULL, NULL);
+
+    reply = request->reply;
+    request->reply = NULL;
+
+    return reply;
+}
+
+/**
+ *  \param procedure procedure ID
+ *
+ *  \return MessageID of reply if request can be safely repeated,
+ *          otherwise -1.
+ **/
+static MessageID get_repeatable_reply_id(gint procedure)
+{
+    switch (procedure) {
+        case REQUEST_PRESET:
+            return RECEIVE_PRESET_START;
+        case REQUEST_PRESET_NAMES:
+            return RECEIVE_PRESET_NAMES;
+        case REQUEST_GLOBAL_PARAMETERS:
+            return RECEIVE_GLOBAL_PARAMETERS;
+        default:
+            return -1;
+    }
+}
+
+/**
+ *  \param procedure procedure ID
+ *  \param data unpacked message data
+ *  \param len data length
+ *  \param reply_id MessageID of reply
+ *
+ *  Remembers request, so it can be repeated if reply gets corrupted.
+ **/
+static void remember_request(gint procedure, const gchar *data, gint len,
+                             MessageID reply_id)
+{
+    RememberedRequest *request = g_slice_new(RememberedRequest);
+
+    request->procedure = procedure;
+    request->data = g_string_new_len(data, len);
+    request->reply_id = reply_id;
+    request->key = get_request_key(procedure, data, len);
+    request->retries = 0;
+
+    g_mutex_lock(message_queue_mutex);
+    g_queue_push_tail(remembered_requests, request);
+    if (g_queue_get_length(remembered_requests) > MAX_REMEMBERED_REQUESTS) {
+        /* device never answered it */
+        request = g_queue_pop_head(remembered_requests);
+        g_string_free(request->data, TRUE);
+        g_slice_free(RememberedRequest, request);
+    }
+    g_mutex_unlock(message_queue_mutex);
+}
+
+/**
+ *  \param reply_id MessageID of reply
+ *  \param key key of reply, -1 if unknown
+ *
+ *  message_queue_mutex must be held by caller.
+ *
+ *  \return link of oldest remembered request answered by reply, or NULL.
+ **/
+static GList *find_remembered_request(MessageID reply_id, gint key)
+{
+    GList *iter;
+
+    for (iter = remembered_requests->head; iter; iter = iter->next) {
+        RememberedRequest *request = iter->data;
+
+        if (request->reply_id == reply_id &&
+            reply_key_matches(request->key, key))
+            return iter;
+    }
+
+    return NULL;
+}
+
+/**
+ *  \param reply_id MessageID of received reply
+ *  \param key key of received reply, -1 if it carries none
+ *
+ *  Forgets oldest remembered request answered by reply.
+ *  message_queue_mutex must be held by caller.
+ **/
+static void forget_request(MessageID reply_id, gint key)
+{
+    GList *iter = find_remembered_request(reply_id, key);
+
+    if (iter != NULL) {
+        RememberedRequest *request = iter->data;
+
+        g_queue_delete_link(remembered_requests, iter);
+        g_string_free(request->data, TRUE);
+        g_slice_free(RememberedRequest, request);
+    }
+}
+
+/**
+ *  \param msg received message
+ *
+ *  Unpacks message and hands it over to the dispatch slot of its
+ *  MessageID. Messages following sequence start message are collected
+ *  into single list, which is queued once complete.
+ **/
+static void queue_message(GString *msg)
+{
+    MessageID msgid = get_message_id(msg);
+
+    g_mutex_lock(message_queue_mutex);
+    if (message_discard_left > 0) {
+        message_discard_left--;
+        g_string_free(msg, TRUE);
+    } else if (message_discard_until != -1) {
+        if (msgid == message_discard_until)
+            message_discard_until = -1;
+        g_string_free(msg, TRUE);
+    } else if (message_list_left > 0) {
+        message_list = g_list_prepend(message_list, msg);
+        message_list_left--;
+        debug_msg(DEBUG_VERBOSE, "%d messages left", message_list_left);
+        if (message_list_left == 0) {
+            message_list = g_list_reverse(message_list);
+            forget_request(message_list_id,
+                           get_message_key(message_list->data));
+            message_slot_push(message_list_id, message_list);
+            message_list = NULL;
+        }
+    } else if (is_message_list_id(msgid)) {
+        message_list = g_list_prepend(NULL, msg);
+        message_list_id = msgid;
+        message_list_left = get_message_list_length(msg);
+        if (message_list_left == 0) {
+            forget_request(message_list_id, get_message_key(msg));
+            message_slot_push(message_list_id, message_list);
+            message_list = NULL;
+        }
+    } else {
+        forget_request(msgid, get_message_key(msg));
+        message_slot_push(msgid, msg);
+    }
+    g_mutex_unlock(message_queue_mutex);
+}
+
+/**
+ *  \param msg corrupted message
+ *
+ *  Drops the sequence corrupted message belongs to and repeats request
+ *  it answers, if that request can be safely repeated. Request is
+ *  picked by key of reply if its header decodes, otherwise the oldest
+ *  one waiting for that MessageID is repeated.
+ **/
+static void message_corrupted(GString *msg)
+{
+    MessageID msgid = get_message_id(msg);
+    RememberedRequest *request = NULL;
+    GString *data = NULL;
+    gint procedure = 0;
+    gint key;
+    GList *iter;
+
+    g_mutex_lock(message_queue_mutex);
+    if (message_list_left > 0) {
+        /* sequence start passed checksum check, it is last in list */
+        msgid = message_list_id;
+        key = get_message_key(g_list_last(message_list)->data);
+        message_discard_left = message_list_left - 1;
+        message_list_free(message_list);
+        message_list = NULL;
+        message_list_left = 0;
+    } else {
+        key = get_message_key(msg);
+        if (msgid == RECEIVE_PRESET_START) {
+            message_discard_until = RECEIVE_PRESET_END;
+        } else if (msgid == RECEIVE_BULK_DUMP_START) {
+            message_discard_until = RECEIVE_BULK_DUMP_END;
+        }
+    }
+
+    iter = find_remembered_request(msgid, key);
+    if (iter != NULL) {
+        request = iter->data;
+    }
+
+    if (request == NULL) {
+        g_warning("Dropping corrupted %s", get_message_name(msgid));
+    } else if (request->retries < MAX_REREQUESTS) {
+        request->retries++;
+        procedure = request->procedure;
+        data = g_string_new_len(request->data->str, request->data->len);
+        g_warning("Corrupted %s, requesting again (%d/%d)",
+                  get_message_name(msgid), request->retries, MAX_REREQUESTS);
+    } else {
+        g_warning("Corrupted %s, giving up", get_message_name(msgid));
+        g_queue_remove(remembered_requests, request);
+        g_string_free(request->data, TRUE);
+        g_slice_free(RememberedRequest, request);
+    }
+    g_mutex_unlock(message_queue_mutex);
+
+    if (data != NULL) {
+        send_message_data(procedure, data->str, data->len);
+        g_string_free(data, TRUE);
+    }
+}
+
+/**
+ *  Allocates per-MessageID dispatch slots.
+ **/
+static void message_slots_init()
+{
+    gint x;
+
+    message_queue_mutex = g_mutex_new();
+    remembered_requests = g_queue_new();
+    for (x = 0; x < N_MESSAGE_SLOTS; x++) {
+        message_slots[x].cond = g_cond_new();
+        message_slots[x].requests = g_queue_new();
+        message_slots[x].late = g_queue_new();
+    }
+}
+
+/**
+ *  Frees per-MessageID dispatch slots and incomplete message sequence.
+ **/
+static void message_slots_free()
+{
+    gint x;
+
+    for (x = 0; x < N_MESSAGE_SLOTS; x++) {
+        LateReply *late;
+
+        if (message_slots[x].requests == NULL)
+            continue;
+
+        while ((late = g_queue_pop_head(message_slots[x].late)) != NULL) {
+            g_slice_free(LateReply, late);
+        }
+
+        if (!g_queue_is_empty(message_slots[x].requests)) {
+            g_warning("%d pending %s requests",
+                      g_queue_get_length(message_slots[x].requests),
+                      get_message_name(x));
+        }
+
+        g_queue_free(message_slots[x].requests);
+        g_queue_free(message_slots[x].late);
+        g_cond_free(message_slots[x].cond);
+        message_slots[x].cond = NULL;
+        message_slots[x].requests = NULL;
+        message_slots[x].late = NULL;
+    }
+
+    if (message_list != NULL) {
+        g_warning("Dropping incomplete %s", get_message_name(message_list_id));
+        message_list_free(message_list);
+        message_list = NULL;
+    }
+
+    while (!g_queue_is_empty(remembered_requests)) {
+        RememberedRequest *request = g_queue_pop_head(remembered_requests);
+        g_string_free(request->data, TRUE);
+        g_slice_free(RememberedRequest, request);
+    }
+    g_queue_free(remembered_requests);
+    remembered_requests = NULL;
+
+    request_stats_dump();
+
+    g_mutex_free(message_queue_mutex);
+    message_queue_mutex = NULL;
+}
+
+#define HEX_WIDTH 26
+
+static gboolean modifier_linkable_list_request_pending = FALSE;
+
+/** size of chunks read from device */
+#define INPUT_CHUNK_SIZE 4096
+
+typedef enum {
+    DECODER_IDLE,       /**< waiting for 0xF0 */
+    DECODER_HEADER,     /**< reading header, which is not packed */
+    DECODER_STATUS,     /**< expecting status byte of next group */
+    DECODER_DATA,       /**< reading data bytes of group */
+} DecoderState;
+
+/**
+ *  Unpacks SysEx messages while bytes arrive, so received messages are
+ *  ready to use once their 0xF7 arrives. Parameters of
+ *  RECEIVE_GLOBAL_PARAMETERS are parsed as soon as they are complete,
+ *  and applied once the checksum of the message has been verified.
+ **/
+typedef struct {
+    DecoderState state;
+    GString *msg;       /**< unpacked message being decoded */
+    GString *raw;       /**< received bytes, only with DEBUG_HEX */
+    guchar status;      /**< status byte of current group */
+    guchar checksum;    /**< XOR of received bytes, 0 for valid message */
+    gint group_pos;     /**< data bytes of current group decoded */
+    gsize parsed;       /**< bytes of msg already parsed into parameters */
+    gint params_left;   /**< parameters left to parse, -1 if not known */
+    GArray *params;     /**< SettingParam parsed from current message */
+} SysExDecoder;
+
+static GThread *read_thread = NULL;
+static volatile gboolean read_thread_stop = FALSE;
+static volatile gboolean read_thread_reconfigure = FALSE;
+static int read_thread_event_fd = -1;   /**< eventfd waking up read thread */
+
+/* read thread statistics, shown with DEBUG_STATS */
+static guint read_wakeups = 0;          /**< all poll() returns */
+static guint read_idle_wakeups = 0;     /**< poll() returns without events */
+static guint read_event_wakeups = 0;    /**< wakeups through eventfd */
+
+/**
+ *  \param data unused
+ *
+ *  Shows all received parameters queued since last run in GUI.
+ *
+ *  \return FALSE, so the idle source is removed.
+ **/
+static gboolean apply_gui_params_cb(gpointer data)
+{
+    GArray *params;
+
+    G_LOCK(gui_params);
+    params = gui_params;
+    gui_params = NULL;
+    g_hash_table_remove_all(gui_param_index);
+    gui_params_source = 0;
+    G_UNLOCK(gui_params);
+
+    if (params != NULL) {
+        debug_msg(DEBUG_VERBOSE, "Applying %d received parameters to GUI",
+                  params->len);
+        apply_setting_params_to_gui((SettingParam *) params->data,
+                                    params->len);
+        g_array_free(params, TRUE);
+    }
+
+    return FALSE;
+}
+
+/**
+ *  \param param parameter received from device
+ *
+ *  Records parameter in edit buffer and queues it to be shown in GUI.
+ *  Parameters are shown in batches from main context; if parameter
+ *  changes again before that, only the newest value is shown.
+ **/
+static void apply_received_param(SettingParam *param)
+{
+    gpointer key = GUINT_TO_POINTER((param->position << 16) | param->id);
+    guint index;
+
+    edit_buffer_set_param(param->id, param->position, param->value);
+
+    G_LOCK(gui_params);
+    if (gui_param_index == NULL) {
+        gui_param_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+    if (gui_params == NULL) {
+        gui_params = g_array_new(FALSE, FALSE, sizeof(SettingParam));
+    }
+
+    index = GPOINTER_TO_UINT(g_hash_table_lookup(gui_param_index, key));
+    if (index != 0) {
+        g_array_index(gui_params, SettingParam, index - 1) = *param;
+    } else {
+        g_array_append_val(gui_params, *param);
+        g_hash_table_insert(gui_param_index, key,
+                            GUINT_TO_POINTER(gui_params->len));
+    }
+
+    if (gui_params_source == 0) {
+        gui_params_source = g_idle_add(apply_gui_params_cb, NULL);
+    }
+    G_UNLOCK(gui_params);
+}
+
+/**
+ *  \param data RECEIVE_MODIFIER_LINKABLE_LIST message
+ *
+ *  Updates modifier linkable list and rebuilds modifier groups in GUI.
+ *
+ *  \return FALSE, so the idle source is removed.
+ **/
+static gboolean apply_modifier_linkable_list_cb(gpointer data)
+{
+    GString *msg = data;
+
+    update_modifier_linkable_list(msg);
+    g_string_free(msg, TRUE);
+
+    create_modifier_group(EXP_POSITION, EXP_ASSIGN1);
+    create_modifier_group(LFO1_POSITION, LFO_TYPE);
+    create_modifier_group(LFO2_POSITION, LFO_TYPE);
+
+    return FALSE;
+}
+
+/**
+ *  \param msg unpacked message
+ *
+ *  Handles received message.
+ *
+ *  \return TRUE if msg was taken over, FALSE if caller can reuse it.
+ **/
+static gboolean push_message(GString *msg)
+{
+    MessageID msgid = get_message_id(msg);
+
+    debug_msg(DEBUG_VERBOSE, "Received %s", get_message_name(msgid));
+
+    SettingParam param;
+    ParamIter params;
+    NotificationView notification;
+
+    switch (msgid) {
+        case ACK:
+            return FALSE;
+
+        case NACK:
+            g_warning("Received NACK!");
+            return FALSE;
+
+        case RECEIVE_PARAMETER_VALUE:
+            if (param_iter_init(&params, msg) &&
+                param_iter_next(&params, &param)) {
+                if (debug_flag_is_set(DEBUG_MSG2HOST)) {
+                    GString *ipv = format_ipv(param.id,
+                                              param.position,
+                                              param.value);
+                    debug_msg(DEBUG_MSG2HOST, "RECEIVE_PARAMETER_VALUE\n%s",
+                                              ipv->str);
+                    g_string_free(ipv, TRUE);
+                }
+
+                apply_received_param(&param);
+            } else {
+                g_warning("Truncated RECEIVE_PARAMETER_VALUE message");
+            }
+            return FALSE;
+
+        case RECEIVE_DEVICE_NOTIFICATION:
+            if (!notification_view_init(&notification, msg)) {
+                g_warning("Truncated RECEIVE_DEVICE_NOTIFICATION message");
+                return FALSE;
+            }
+
+            switch (notification.code) {
+            case NOTIFY_PRESET_MOVED:
+                if (notification.u.moved.dst_bank == PRESETS_EDIT_BUFFER &&
+                    notification.u.moved.dst_index == 0) {
+                    edit_buffer_invalidate();
+
+                    g_idle_add(apply_current_preset_to_gui, NULL);
+                    debug_msg(DEBUG_MSG2HOST,
+                              "RECEIVE_DEVICE_NOTIFICATION: Loaded preset "
+                              "%d from bank %d",
+                              notification.u.moved.src_index,
+                              notification.u.moved.src_bank);
+                } else {
+                    cache_invalidate_preset(notification.u.moved.dst_bank,
+                                            notification.u.moved.dst_index);
+                    debug_msg(DEBUG_MSG2HOST,
+                              "RECEIVE_DEVICE_NOTIFICATION: %d %d moved to "
+                              "%d %d",
+                              notification.u.moved.src_bank,
+                              notification.u.moved.src_index,
+                              notification.u.moved.dst_bank,
+                              notification.u.moved.dst_index);
+                }
+                break;
+
+            case NOTIFY_MODIFIER_GROUP_CHANGED:
+            {
+                int i;
+                if (debug_flag_is_set(DEBUG_HEX)) {
+                    printf("\n");
+                    for (i = 0; i < msg->len; i++) {
+                        printf(" %02x", (unsigned char) msg->str[i]);
+                    }
+                    printf("\n");
+                }
+
+                debug_msg(DEBUG_MSG2HOST,
+                          "NOTIFY_MODIFIER_GROUP_CHANGED: Modifier group "
+                          "id %d changed",
+                          notification.u.group_id);
+
+                if (!modifier_linkable_list_request_pending) {
+                    send_message(REQUEST_MODIFIER_LINKABLE_LIST, "\x00\x01", 2);
+                    modifier_linkable_list_request_pending = TRUE;
+                }
+
+                break;
+            }
+            default:
+                g_warning("Received unhandled device notification 0x%x",
+                          notification.code);
+            }
+            return FALSE;
+        case RECEIVE_GLOBAL_PARAMETERS:
+            /* parameters were applied by decoder after checksum check */
+            if (param_iter_init(&params, msg)) {
+                debug_msg(DEBUG_MSG2HOST, "RECEIVE_GLOBAL_PARAMETERS: %d "
+                          "parameters", params.left);
+            }
+            g_mutex_lock(message_queue_mutex);
+            forget_request(RECEIVE_GLOBAL_PARAMETERS, -1);
+            g_mutex_unlock(message_queue_mutex);
+            profile_async_end("Global parameters");
+            return FALSE;
+
+        case RECEIVE_MODIFIER_LINKABLE_LIST:
+
+            modifier_linkable_list_request_pending = FALSE;
+            profile_async_end("Modifier linkable list");
+
+            /* modifier groups are shared with GUI, update them there */
+            g_idle_add(apply_modifier_linkable_list_cb, msg);
+            return TRUE;
+
+
+        default:
+            queue_message(msg);
+            return TRUE;
+    }
+}
+
+/**
+ *  \param data freshly read data
+ *  \param len data length
+ *
+ *  Removes active sensing bytes from data.
+ *
+ *  \return data length without active sensing bytes.
+ **/
+static gsize strip_active_sensing(guchar *data, gsize len)
+{
+    guchar *end = data + len;
+    guchar *src, *dst;
+
+    dst = memchr(data, 0xFE, len);
+    if (dst == NULL)
+        return len;
+
+    for (src = dst + 1; src < end; src++) {
+        if (*src != 0xFE)
+            *dst++ = *src;
+    }
+
+    return dst - data;
+}
+
+/**
+ *  \param decoder decoder parsing parameters
+ *
+ *  Parses parameters that are complete. The newest byte is never parsed,
+ *  as until 0xF7 arrives it may be the checksum.
+ **/
+static void sysex_decoder_parse_params(SysExDecoder *decoder)
+{
+    guchar *str = (guchar *) decoder->msg->str;
+    gsize avail = decoder->msg->len - 1;
+
+    if (decoder->params_left < 0) {
+        if (avail < 10)
             return;
+        decoder->params_left = str[9];
+        decoder->parsed = 10;
+    }
+
+    while (decoder->params_left > 0) {
+        SettingParam param;
+        gsize need = decode_param(&str[decoder->parsed], &str[avail], &param);
+
+        if (need == 0)
+            break;
+
+        g_array_append_val(decoder->params, param);
+
+        decoder->parsed += need;
+        decoder->params_left--;
+    }
+}
+
+/**
+ *  \param data bytes
+ *  \param len data length
+ *
+ *  \return XOR of all bytes.
+ **/
+static guchar xor_bytes(const guchar *data, gsize len)
+{
+    guchar x = 0;
+    gsize i;
+
+    for (i = 0; i < len; i++) {
+        x ^= data[i];
+    }
+
+    return x;
+}
+
+/**
+ *  \param decoder decoder which got 0xF7
+ *
+ *  Terminates current message and verifies its checksum. Valid message
+ *  gets its parsed parameters applied and is handed over to
+ *  push_message().
+ **/
+static void sysex_decoder_finish(SysExDecoder *decoder)
+{
+    MessageID msgid;
+    guint x;
 
+    if (decoder->state == DECODER_HEADER) {
+        g_warning("Dropping truncated message");
+        decoder->state = DECODER_IDLE;
+        return;
+    }
 
-        case RECEIVE_MODIFIER_LINKABLE_LIST:
+    if (decoder->state == DECODER_DATA && decoder->group_pos == 0) {
+        /* status byte was the checksum */
+        g_string_append_c(decoder->msg, decoder->status);
+        if (get_message_id(decoder->msg) == RECEIVE_GLOBAL_PARAMETERS)
+            sysex_decoder_parse_params(decoder);
+    }
+    g_string_append_c(decoder->msg, 0xF7);
+    decoder->state = DECODER_IDLE;
+    msgid = get_message_id(decoder->msg);
 
-            modifier_linkable_list_request_pending = FALSE;
-            unpack_message(msg);
-            tot = (unsigned char)msg->str[9];
+    if (decoder->raw != NULL) {
+        g_string_append_c(decoder->raw, 0xF7);
+        for (x = 0; x < decoder->raw->len; x++) {
+            if (x && (x % HEX_WIDTH) == 0) {
+                printf("\n");
+            }
+            printf("%02x ", (unsigned char) decoder->raw->str[x]);
+        }
+        if (x % HEX_WIDTH) {
+            printf("\n");
+        }
+    }
+
+    if (decoder->checksum != 0) {
+        messages_bad[msgid]++;
+        message_corrupted(decoder->msg);
+        return;
+    }
+
+    messages_good[msgid]++;
+
+    for (x = 0; x < decoder->params->len; x++) {
+        SettingParam *param = &g_array_index(decoder->params, SettingParam, x);
+
+        debug_msg(DEBUG_MSG2HOST,
+                  "RECEIVE_GLOBAL_PARAMETERS ID: %5d "
+                  "Position: %2.1d Value: %6.1d",
+                  param->id, param->position, param->value);
+        apply_received_param(param);
+    }
+
+    if (push_message(decoder->msg)) {
+        decoder->msg = g_string_sized_new(INPUT_CHUNK_SIZE);
+    }
+}
+
+/**
+ *  \param decoder decoder
+ *  \param data packed bytes, none of them 0xF7
+ *  \param len data length
+ *  \param more TRUE if data is followed by at least one more byte
+ *
+ *  Unpacks message data.
+ **/
+static void sysex_decoder_unpack(SysExDecoder *decoder,
+                                 const guchar *data, gsize len,
+                                 gboolean more)
+{
+    GString *msg = decoder->msg;
+    gsize i = 0;
+
+    while (i < len) {
+        if (decoder->state == DECODER_STATUS) {
+            /* whole groups at once, unpack_group() reads one byte past
+               the group and writes one byte past its output */
+            while (i + 8 < len || (more && i + 8 == len)) {
+                gsize out = msg->len;
+
+                g_string_set_size(msg, out + 8);
+                unpack_group((guchar *) &msg->str[out], &data[i]);
+                g_string_truncate(msg, out + 7);
+                i += 8;
+            }
+            if (i == len)
+                break;
+
+            decoder->status = data[i++];
+            decoder->group_pos = 0;
+            decoder->state = DECODER_DATA;
+            continue;
+        }
 
+        g_string_append_c(msg,
+                          ((decoder->status << (decoder->group_pos+1)) & 0x80) |
+                          data[i++]);
+        if (++decoder->group_pos == 7) {
+            decoder->state = DECODER_STATUS;
+        }
+    }
+}
+
+/**
+ *  \param decoder decoder
+ *  \param data received bytes, without active sensing
+ *  \param len data length
+ *
+ *  Decodes received bytes.
+ **/
+static void sysex_decoder_feed(SysExDecoder *decoder,
+                               const guchar *data, gsize len)
+{
+    const guchar *end = data + len;
+
+    while (data < end) {
+        const guchar *stop;
+
+        if (decoder->state == DECODER_IDLE) {
+            data = memchr(data, 0xF0, end - data);
+            if (data == NULL)
+                return;
+
+            g_string_truncate(decoder->msg, 0);
             if (debug_flag_is_set(DEBUG_HEX)) {
-                for (n = 0; n < msg->len; n++) {
-                    printf("%02x ",(unsigned char) msg->str[n]);
-                }
-                printf("\n");
+                if (decoder->raw == NULL)
+                    decoder->raw = g_string_new(NULL);
+                g_string_truncate(decoder->raw, 0);
             }
+            decoder->params_left = -1;
+            g_array_set_size(decoder->params, 0);
+            decoder->checksum = 0xF0;   /* cancels out 0xF0 itself */
+            decoder->state = DECODER_HEADER;
+        }
+
+        stop = memchr(data, 0xF7, end - data);
+        if (stop == NULL)
+            stop = end;
 
+        decoder->checksum ^= xor_bytes(data, stop - data);
 
-            update_modifier_linkable_list(msg);
+        if (decoder->raw != NULL) {
+            g_string_append_len(decoder->raw, (const gchar *) data,
+                                stop - data);
+        }
 
-            g_string_free(msg, TRUE);
+        if (decoder->state == DECODER_HEADER) {
+            gsize n = MIN(8 - decoder->msg->len, stop - data);
 
-            GDK_THREADS_ENTER();
+            g_string_append_len(decoder->msg, (const gchar *) data, n);
+            data += n;
+            if (decoder->msg->len == 8)
+                decoder->state = DECODER_STATUS;
+        }
 
-            create_modifier_group(EXP_POSITION, EXP_ASSIGN1);
-            create_modifier_group(LFO1_POSITION, LFO_TYPE);
-            create_modifier_group(LFO2_POSITION, LFO_TYPE);
+        if (data < stop) {
+            sysex_decoder_unpack(decoder, data, stop - data, stop < end);
+            data = stop;
 
-            GDK_THREADS_LEAVE();
+            if (get_message_id(decoder->msg) == RECEIVE_GLOBAL_PARAMETERS)
+                sysex_decoder_parse_params(decoder);
+        }
 
-            return;
+        if (stop < end) {
+            sysex_decoder_finish(decoder);
+            data = stop + 1;
+        }
+    }
+}
 
+/**
+ *  Wakes up read thread, so it notices stop or reconfigure requests.
+ **/
+static void read_thread_wakeup()
+{
+    eventfd_t value = 1;
 
-        default:
-            g_mutex_lock(message_queue_mutex);
-            g_queue_push_tail(message_queue, msg);
-            g_cond_signal(message_queue_cond);
-            g_mutex_unlock(message_queue_mutex);
-            break;
+    if (write(read_thread_event_fd, &value, sizeof(value)) < 0) {
+        g_warning("Failed to wake up read thread: %s", strerror(errno));
     }
 }
 
-gpointer read_data_thread(gboolean *stop)
+/**
+ *  Asks read thread to query input poll descriptors again, for example
+ *  after input device has been reopened.
+ **/
+void read_thread_request_reconfigure()
+{
+    read_thread_reconfigure = TRUE;
+    read_thread_wakeup();
+}
+
+/**
+ *  \param pfds location to store poll descriptors array
+ *
+ *  Gets input poll descriptors followed by read thread eventfd.
+ *
+ *  \return number of poll descriptors, including eventfd.
+ **/
+static int read_thread_get_poll_descriptors(struct pollfd **pfds)
+{
+    int npfds;
+
+    npfds = transport_poll_descriptors_count(transport);
+    *pfds = g_renew(struct pollfd, *pfds, npfds + 1);
+    transport_poll_descriptors(transport, *pfds, npfds);
+
+    (*pfds)[npfds].fd = read_thread_event_fd;
+    (*pfds)[npfds].events = POLLIN;
+    (*pfds)[npfds].revents = 0;
+
+    return npfds + 1;
+}
+
+/**
+ *  \param data unused
+ *
+ *  Reads data from device. Sleeps in poll() until data arrives or
+ *  read thread is woken up through its eventfd.
+ **/
+static gpointer read_data_thread(gpointer data)
 {
     /* This is mostly taken straight from alsa-utils-1.0.19 amidi/amidi.c
        by Clemens Ladisch <clemens@ladisch.de> */
     int err;
     int npfds;
-    struct pollfd *pfds;
-    GString *string = NULL;
+    struct pollfd *pfds = NULL;
+    static GOnce table_once = G_ONCE_INIT;
+    guchar buf[INPUT_CHUNK_SIZE];
+    SysExDecoder decoder;
 
-    npfds = snd_rawmidi_poll_descriptors_count(input);
-    pfds = alloca(npfds * sizeof(struct pollfd));
-    snd_rawmidi_poll_descriptors(input, pfds, npfds);
+    g_once(&table_once, unpack_msb_table_init, NULL);
 
-    do {
-        unsigned char buf[256];
-        int i, length;
-        unsigned short revents;
+    decoder.state = DECODER_IDLE;
+    decoder.msg = g_string_sized_new(INPUT_CHUNK_SIZE);
+    decoder.raw = NULL;
+    decoder.params = g_array_new(FALSE, FALSE, sizeof(SettingParam));
+
+    npfds = read_thread_get_poll_descriptors(&pfds);
 
-        /* SysEx messages can't contain bytes with 8th bit set.
-           memset our buffer to 0xFF, so if for some reason we'll
-           get out of reply bounds, we'll catch it */
-        memset(buf, '\0', sizeof(buf));
+    while (read_thread_stop == FALSE) {
+        unsigned short revents;
 
-        err = poll(pfds, npfds, 200);
+        err = poll(pfds, npfds, -1);
+        read_wakeups++;
         if (err < 0 && errno == EINTR)
             break;
         if (err < 0) {
             g_error("poll failed: %s", strerror(errno));
             break;
         }
-        if ((err = snd_rawmidi_poll_descriptors_revents(input, pfds, npfds, &revents)) < 0) {
-            g_error("cannot get poll events: %s", snd_strerror(errno));
-            break;
+        if (err == 0) {
+            read_idle_wakeups++;
+            continue;
+        }
+
+        if (pfds[npfds-1].revents & POLLIN) {
+            eventfd_t value;
+
+            read_event_wakeups++;
+            if (read(read_thread_event_fd, &value, sizeof(value)) < 0) {
+                g_warning("Failed to read eventfd: %s", strerror(errno));
+            }
+
+            if (read_thread_stop)
+                break;
+
+            if (read_thread_reconfigure) {
+                read_thread_reconfigure = FALSE;
+                npfds = read_thread_get_poll_descriptors(&pfds);
+                continue;
+            }
         }
+
+        revents = transport_poll_revents(transport, pfds, npfds-1);
         if (revents & (POLLERR | POLLHUP))
             break;
         if (!(revents & POLLIN))
             continue;
 
-        err = snd_rawmidi_read(input, buf, sizeof(buf));
-        if (err == -EAGAIN)
+        err = transport_read(transport, buf, sizeof(buf));
+        if (err == 0)
+            break;      /* other end is gone */
+        if (err == -EAGAIN || err == -EINTR)
             continue;
         if (err < 0) {
-            g_error("cannot read: %s", snd_strerror(err));
+            g_error("cannot read: %s", g_strerror(-err));
             break;
         }
 
-        length = 0;
-        for (i = 0; i < err; ++i)
-            if ((unsigned char)buf[i] != 0xFE) /* ignore active sensing */
-                buf[length++] = buf[i];
+        sysex_decoder_feed(&decoder, buf, strip_active_sensing(buf, err));
+    }
+
+    g_string_free(decoder.msg, TRUE);
+    g_array_free(decoder.params, TRUE);
+    if (decoder.raw != NULL) {
+        g_string_free(decoder.raw, TRUE);
+    }
+    g_free(pfds);
+
+    return NULL;
+}
+
+/**
+ *  Starts read thread.
+ *
+ *  \return FALSE on success, TRUE on error.
+ **/
+static gboolean read_thread_start()
+{
+    read_thread_event_fd = eventfd(0, EFD_CLOEXEC);
+    if (read_thread_event_fd < 0) {
+        g_warning("eventfd failed: %s", strerror(errno));
+        return TRUE;
+    }
+
+    read_thread_stop = FALSE;
+    read_thread = g_thread_create(read_data_thread, NULL, TRUE, NULL);
+
+    return read_thread == NULL;
+}
+
+/**
+ *  Stops read thread and waits until it exits.
+ **/
+static void read_thread_finish()
+{
+    if (read_thread != NULL) {
+        read_thread_stop = TRUE;
+        read_thread_wakeup();
+
+        g_thread_join(read_thread);
+        read_thread = NULL;
 
-        i = 0;
+        debug_msg(DEBUG_STATS,
+                  "MIDI input: %d wakeups, %d on events, %d idle",
+                  read_wakeups, read_event_wakeups, read_idle_wakeups);
 
-        while (i < length) {
-            int pos;
-            int bytes;
+        if (debug_flag_is_set(DEBUG_STATS)) {
+            gint x;
 
-            if (string == NULL) {
-                while (buf[i] != 0xF0 && i < length)
-                    i++;
+            for (x = 0; x < N_MESSAGE_SLOTS; x++) {
+                if (messages_good[x] || messages_bad[x]) {
+                    debug_msg(DEBUG_STATS, "%-32s received %5d corrupted %3d",
+                              get_message_name(x),
+                              messages_good[x], messages_bad[x]);
+                }
             }
+        }
+    }
+
+    if (read_thread_event_fd >= 0) {
+        close(read_thread_event_fd);
+        read_thread_event_fd = -1;
+    }
+}
+
+/**
+ *  \param procedure procedure ID
+ *  \param data unpacked message data
+ *  \param len data length
+ *
+ *  Creates SysEx message then sends it. This function uses folowing global variables: device_id, family_id and product_id.
+ **/
+static void send_message_data(gint procedure, const gchar *data, gint len)
+{
+    guchar buf[SYSEX_STACK_SIZE];
+    guchar *msg = buf;
+    guchar checksum;
+    gint n;
+
+    if (SYSEX_LEN(len) > sizeof(buf)) {
+        msg = g_malloc(SYSEX_LEN(len));
+    }
+
+    msg[0] = 0xF0;          /* SysEx status byte */
+    msg[1] = 0x00;          /* Manufacturer ID   */
+    msg[2] = 0x00;
+    msg[3] = 0x10;
+    msg[4] = device_id;
+    msg[5] = family_id;
+    msg[6] = product_id;
+    msg[7] = procedure;
+
+    checksum = msg[3] ^ msg[4] ^ msg[5] ^ msg[6] ^ msg[7];
+    n = 8;
+    if (len > 0) {
+        n += pack_data(&msg[n], data, len, &checksum);
+    }
+    msg[n++] = checksum;
+    msg[n++] = 0xF7;
+
+    debug_msg(DEBUG_VERBOSE, "Sending %s len %d",
+                              get_message_name(procedure), len);
+
+    send_data((char *) msg, n);
+
+    if (msg != buf) {
+        g_free(msg);
+    }
+}
+
+/**
+ *  \param procedure procedure ID
+ *  \param data unpacked message data
+ *  \param len data length
+ *
+ *  Sends message after pending parameter changes. Requests that can be
+ *  safely repeated are remembered until answered.
+ **/
+void send_message(gint procedure, gchar *data, gint len)
+{
+    MessageID reply_id;
+
+    /* keep coalesced parameter changes ordered before anything else */
+    if (procedure != RECEIVE_PARAMETER_VALUE) {
+        flush_pending_options();
+    }
+
+    reply_id = get_repeatable_reply_id(procedure);
+    if (reply_id != -1 && message_queue_mutex != NULL) {
+        remember_request(procedure, data, len, reply_id);
+    }
+
+    send_message_data(procedure, data, len);
+}
+
+/**
+ *  \param buf buffer to store value, at least VALUE_MAX_LEN long
+ *  \param value value to encode
+ *
+ *  Encodes value using scheme used on all newer DigiTech products.
+ *
+ *  \return encoded value length
+ **/
+static gint encode_value(gchar *buf, guint value)
+{
+    /* check how many bytes long the value is */
+    guint temp = value;
+    gint n = 0;
+    gint x;
+
+    do {
+        n++;
+        temp = temp >> 8;
+    } while (temp);
+
+    if (n == 1) {
+        if (value & 0x80) {
+            n = 2;
+        } else {
+            buf[0] = value;
+            return 1;
+        }
+    }
+
+    buf[0] = n | 0x80;
+    for (x=0; x<n; x++) {
+        buf[x+1] = (value >> (8*(n-x-1))) & 0xFF;
+    }
+
+    return n + 1;
+}
+
+/**
+ *  \param buf buffer to store parameter, at least PARAM_MAX_LEN long
+ *  \param id parameter ID
+ *  \param position parameter position
+ *  \param value parameter value
+ *
+ *  Encodes parameter as it appears in messages.
+ *
+ *  \return encoded parameter length
+ **/
+static gint encode_param(gchar *buf, guint id, guint position, guint value)
+{
+    buf[0] = (id & 0xFF00) >> 8;
+    buf[1] = id & 0xFF;
+    buf[2] = position;
 
-            pos = i;
+    return 3 + encode_value(&buf[3], value);
+}
+
+/**
+ *  \param msg message to append value
+ *  \param value value to append
+ *
+ *  Packs value using scheme used on all newer DigiTech products.
+ **/
+void append_value(GString *msg, guint value)
+{
+    gchar buf[VALUE_MAX_LEN];
+
+    g_string_append_len(msg, buf, encode_value(buf, value));
+}
+
+/**
+ *  \param msg unpacked message
+ *  \param min amount of payload bytes (starting at offset 8) required
+ *
+ *  \return pointer past last payload byte (checksum and 0xF7 are not part
+ *          of payload), or NULL if message is shorter than required.
+ **/
+static const guchar *message_payload_end(GString *msg, gsize min)
+{
+    if (msg->len < 10 + min)
+        return NULL;
+
+    return (const guchar *) msg->str + msg->len - 2;
+}
+
+/**
+ *  \param str pointer to setting param in message
+ *  \param end pointer past last byte which may be read
+ *  \param param return location for decoded param
+ *
+ *  Decodes parameter (ID, position, value) without allocating memory.
+ *
+ *  \return amount of bytes param is encoded on, or 0 if it is truncated
+ *          or malformed.
+ **/
+static gsize decode_param(const guchar *str, const guchar *end,
+                          SettingParam *param)
+{
+    gsize len = 4;
+    guint value;
+    gint i;
+
+    if (end - str < 4)
+        return 0;
+
+    value = str[3];
+    if (value > 0x80) {
+        gint n = value & 0x7F;
+
+        if (n > sizeof(guint) || end - str < 4 + n)
+            return 0;
 
-            for (bytes = 0; (bytes<length-i) && (buf[i+bytes] != 0xF7); bytes++);
+        value = 0;
+        for (i = 0; i < n; i++)
+            value = (value << 8) | str[4 + i];
+        len += n;
+    }
+
+    param->id = (str[0] << 8) | str[1];
+    param->position = str[2];
+    param->value = value;
+
+    return len;
+}
+
+/**
+ *  \param iter iterator to initialize
+ *  \param msg RECEIVE_PARAMETER_VALUE, RECEIVE_GLOBAL_PARAMETERS or
+ *             RECEIVE_PRESET_PARAMETERS message
+ *
+ *  Sets up iterator over parameters contained in message.
+ *
+ *  \return TRUE on success, FALSE if message contains no parameter list.
+ **/
+gboolean param_iter_init(ParamIter *iter, GString *msg)
+{
+    const guchar *str = (const guchar *) msg->str;
+
+    switch (get_message_id(msg)) {
+        case RECEIVE_PARAMETER_VALUE:
+            iter->end = message_payload_end(msg, 0);
+            iter->pos = &str[8];
+            iter->left = 1;
+            break;
+        case RECEIVE_GLOBAL_PARAMETERS:
+        case RECEIVE_PRESET_PARAMETERS:
+            iter->end = message_payload_end(msg, 2);
+            iter->pos = &str[10];
+            iter->left = (iter->end != NULL) ? str[9] : 0;
+            break;
+        default:
+            return FALSE;
+    }
+
+    return iter->end != NULL;
+}
+
+/**
+ *  \param iter parameter iterator
+ *  \param param return location for next parameter
+ *
+ *  \return TRUE if param was filled in, FALSE if there are no more
+ *          parameters (or rest of message is truncated).
+ **/
+gboolean param_iter_next(ParamIter *iter, SettingParam *param)
+{
+    gsize len;
 
-            if (buf[i+bytes] == 0xF7) bytes++;
+    if (iter->left <= 0)
+        return FALSE;
+
+    len = decode_param(iter->pos, iter->end, param);
+    if (len == 0) {
+        g_warning("Truncated parameter list, %d parameters missing",
+                  iter->left);
+        iter->left = 0;
+        return FALSE;
+    }
 
-            i += bytes;
+    iter->pos += len;
+    iter->left--;
+    return TRUE;
+}
 
-            if (string == NULL)
-                string = g_string_new_len((gchar*)&buf[pos], bytes);
-            else
-                g_string_append_len(string, (gchar*)&buf[pos], bytes);
+/**
+ *  \param iter iterator to initialize
+ *  \param msg RECEIVE_PRESET_NAMES message
+ *
+ *  Sets up iterator over preset names contained in message.
+ *
+ *  \return TRUE on success, FALSE if message is not valid.
+ **/
+gboolean name_iter_init(NameIter *iter, GString *msg)
+{
+    const guchar *end = message_payload_end(msg, 2);
 
-            if ((unsigned char)string->str[string->len-1] == 0xF7) {
-                /* push message on stack */
-                push_message(string);
-                string = NULL;
-            }
-        }
-    } while (*stop == FALSE);
+    if (get_message_id(msg) != RECEIVE_PRESET_NAMES || end == NULL)
+        return FALSE;
 
-    if (string) {
-        g_string_free(string, TRUE);
-        string = NULL;
-    }
+    iter->bank = (unsigned char) msg->str[8];
+    iter->pos = &msg->str[10];
+    iter->end = (const gchar *) end;
+    iter->left = (unsigned char) msg->str[9];
 
-    return NULL;
+    return TRUE;
 }
 
 /**
- *  \param procedure procedure ID
- *  \param data unpacked message data
- *  \param len data length
+ *  \param iter name iterator
  *
- *  Creates SysEx message then sends it. This function uses folowing global variables: device_id, family_id and product_id.
+ *  \return next name (pointing into message), or NULL if there are
+ *          no more names.
  **/
-void send_message(gint procedure, gchar *data, gint len)
+const gchar *name_iter_next(NameIter *iter)
 {
-    GString *msg = g_string_new_len("\xF0"          /* SysEx status byte */
-                                    "\x00\x00\x10", /* Manufacturer ID   */
-                                    4);
-    g_string_append_printf(msg,
-                           "%c%c%c"   /* device, family, product ID */
-                           "%c",      /* procedure */
-                           device_id, family_id, product_id,
-                           procedure);
-
-    if (len > 0) {
-        GString *tmp = pack_data(data, len);
-        g_string_append_len(msg, tmp->str, tmp->len);
-        g_string_free(tmp, TRUE);
-    }
+    const gchar *name = iter->pos;
+    const gchar *nul;
 
-    g_string_append_printf(msg, "%c\xF7",
-                           calculate_checksum(&msg->str[1], msg->len - 1));
+    if (iter->left <= 0)
+        return NULL;
 
-    debug_msg(DEBUG_VERBOSE, "Sending %s len %d",
-                              get_message_name(procedure), len);
-
-    send_data(msg->str, msg->len);
+    nul = memchr(name, '\0', iter->end - name);
+    if (nul == NULL) {
+        g_warning("Truncated name list, %d names missing", iter->left);
+        iter->left = 0;
+        return NULL;
+    }
 
-    g_string_free(msg, TRUE);
+    iter->pos = nul + 1;
+    iter->left--;
+    return name;
 }
 
 /**
- *  \param id MessageID of requested message
- *
- *  Reads data from message queue until message with matching id is found.
+ *  \param view view to fill in
+ *  \param msg RECEIVE_PRESET_START message
  *
- *  \return GString containing unpacked message.
+ *  \return TRUE on success, FALSE if message is not valid.
  **/
-GString *get_message_by_id(MessageID id)
+gboolean preset_start_view_init(PresetStartView *view, GString *msg)
 {
-    GString *data = NULL;
-    guint x, len;
-    gboolean found = FALSE;
-
-    g_mutex_lock(message_queue_mutex);
-    do {
-        len = g_queue_get_length(message_queue);
-        for (x = 0; x<len; x++) {
-            data = g_queue_peek_nth(message_queue, x);
-            if (get_message_id(data) == id) {
-                found = TRUE;
-                g_queue_pop_nth(message_queue, x);
-                break;
-            }
-        }
+    const guchar *str = (const guchar *) msg->str;
+    const guchar *end = message_payload_end(msg, 3);
+    const guchar *nul;
 
-        if (found == FALSE)
-            g_cond_wait(message_queue_cond, message_queue_mutex);
+    if (get_message_id(msg) != RECEIVE_PRESET_START || end == NULL)
+        return FALSE;
 
-    } while (found == FALSE);
-    g_mutex_unlock(message_queue_mutex);
+    nul = memchr(&str[10], '\0', end - &str[10]);
+    if (nul == NULL || nul + 2 >= end)
+        return FALSE;
 
-    unpack_message(data);
+    view->bank = str[8];
+    view->index = str[9];
+    view->name = (const gchar *) &str[10];
+    view->modified = nul[1];
+    view->n_messages = nul[2];
 
-    return data;
+    return TRUE;
 }
 
 /**
- *  \param msg message to append value
- *  \param value value to append
+ *  \param view view to fill in
+ *  \param msg RECEIVE_DEVICE_NOTIFICATION message
  *
- *  Packs value using scheme used on all newer DigiTech products.
+ *  Code specific data is only filled in for notifications having
+ *  a member in NotificationView.
+ *
+ *  \return TRUE on success, FALSE if message is not valid.
  **/
-void append_value(GString *msg, guint value)
+gboolean notification_view_init(NotificationView *view, GString *msg)
 {
-    /* check how many bytes long the value is */
-    guint temp = value;
-    gint n = 0;
-    do {
-        n++;
-        temp = temp >> 8;
-    } while (temp);
-
-    if (n == 1) {
-        if (value & 0x80)
-            n = 2;
-        else
-            g_string_append_printf(msg, "%c", value);
+    const guchar *str = (const guchar *) msg->str;
+    const guchar *end = message_payload_end(msg, 1);
+
+    if (get_message_id(msg) != RECEIVE_DEVICE_NOTIFICATION || end == NULL)
+        return FALSE;
+
+    view->code = str[8];
+    switch (view->code) {
+        case NOTIFY_PRESET_MOVED:
+            if (end - str < 13)
+                return FALSE;
+            view->u.moved.src_bank = str[9];
+            view->u.moved.src_index = str[10];
+            view->u.moved.dst_bank = str[11];
+            view->u.moved.dst_index = str[12];
+            break;
+        case NOTIFY_MODIFIER_GROUP_CHANGED:
+            if (end - str < 11)
+                return FALSE;
+            view->u.group_id = (str[9] << 8) | str[10];
+            break;
+        default:
+            break;
     }
 
-    if (n > 1) {
-        gint x;
-        g_string_append_printf(msg, "%c", (n | 0x80));
-        for (x=0; x<n; x++) {
-            g_string_append_printf(msg, "%c",
-                                   ((value >> (8*(n-x-1))) & 0xFF));
-        }
-    }
+    return TRUE;
 }
 
 /**
- *  \param str pointer to value to unpack
- *  \param len return location for how many bytes value is encoded on (length is added to current value)
- *
- *  Unpacks value using scheme used on all newer DigiTech products.
+ *  \param view view to fill in
+ *  \param msg RECEIVE_MODIFIER_LINKABLE_LIST message
  *
- *  \return unpacked value
+ *  \return TRUE on success, FALSE if message is not valid.
  **/
-guint unpack_value(gchar *str, int *len)
+gboolean linkable_list_view_init(LinkableListView *view, GString *msg)
 {
-    guint value;
-    gint tmp;
+    const guchar *str = (const guchar *) msg->str;
+    const guchar *end = message_payload_end(msg, 4);
 
-    value = (unsigned char)str[0];
-    if (len != NULL)
-       *len += 1;
+    if (get_message_id(msg) != RECEIVE_MODIFIER_LINKABLE_LIST || end == NULL)
+        return FALSE;
 
-    if (value > 0x80) {
-        tmp = value & 0x7F;
-        value = 0;
-        gint i;
-        for (i = 0; i<tmp; i++) {
-            value |= ((unsigned char)str[1+i] << (8*(tmp-i-1)));
-        }
+    view->group_id = (str[8] << 8) | str[9];
+    view->count = (str[10] << 8) | str[11];
+    view->entries = &str[12];
 
-        if (len != NULL)
-            *len += tmp;
-    }
+    if (end - view->entries < view->count * 3)
+        return FALSE;
 
-    return value;
+    return TRUE;
 }
 
 /**
- *  Allocates memory for SettingParam.
- *
- *  \return SettingParam which must be freed using setting_param_free.
+ *  \param view linkable list view
+ *  \param n entry number, must be lower than view->count
+ *  \param id return location for parameter ID
+ *  \param position return location for parameter position
  **/
-SettingParam *setting_param_new()
+void linkable_list_view_get(LinkableListView *view, guint n,
+                            guint *id, guint *position)
 {
-    SettingParam *param = g_slice_new(SettingParam);
-    param->id = -1;
-    param->position = -1;
-    param->value = -1;
+    const guchar *entry = &view->entries[n * 3];
+
+    g_return_if_fail(n < view->count);
 
-    return param;
+    *id = (entry[0] << 8) | entry[1];
+    *position = entry[2];
 }
 
 /**
- *  \param str pointer to setting param in message
- *  \param len return location for how many bytes value is encoded on (length is added to current value)
- *
- *  Creates SettingParam basing on data.
- *  This function expects str to point on:
- *    -Parameter ID - 2 bytes
- *    -Parameter position - 1 byte
- *    -Parameter value - var
+ *  \param view view to fill in
+ *  \param msg RECEIVE_WHO_AM_I message
  *
- *  \return newly created SettingParam which must be freed using setting_param_free.
+ *  \return TRUE on success, FALSE if message is not valid.
  **/
-SettingParam *setting_param_new_from_data(gchar *str, gint *len)
+gboolean who_am_i_view_init(WhoAmIView *view, GString *msg)
 {
-    gint id;
-    gint position;
-    guint value;
-
-    id = ((unsigned char)str[0] << 8) | (unsigned char)str[1];
-    position = (unsigned char)str[2];
-    if (len != NULL)
-       *len += 3;
+    const guchar *str = (const guchar *) msg->str;
 
-    value = unpack_value(&str[3], len);
+    if (get_message_id(msg) != RECEIVE_WHO_AM_I ||
+        message_payload_end(msg, 3) == NULL)
+        return FALSE;
 
-    SettingParam *param = g_slice_new(SettingParam);
-    param->id = id;
-    param->position = position;
-    param->value = value;
+    view->device_id = str[8];
+    view->family_id = str[9];
+    view->product_id = str[10];
 
-    return param;
+    return TRUE;
 }
 
 /**
- *  \param param SettingParam to be freed
+ *  \param view view to fill in
+ *  \param msg RECEIVE_DEVICE_CONFIGURATION message
  *
- *  Frees all memory used by SettingParam.
+ *  \return TRUE on success, FALSE if message is not valid.
  **/
-void setting_param_free(SettingParam *param)
+gboolean device_config_view_init(DeviceConfigView *view, GString *msg)
 {
-    g_slice_free(SettingParam, param);
+    const guchar *str = (const guchar *) msg->str;
+    const guchar *end = message_payload_end(msg, 7);
+
+    if (get_message_id(msg) != RECEIVE_DEVICE_CONFIGURATION || end == NULL)
+        return FALSE;
+
+    view->os_major = str[8];
+    view->os_minor = (((str[9] & 0xF0) >> 4) * 10) | (str[9] & 0x0F);
+    view->cpu_major = str[10];
+    view->cpu_minor = str[11];
+    view->protocol_version = str[12];
+    view->current_bank = str[13];
+    view->current_preset = str[14];
+
+    if (view->os_major >= 1 && end - str > 15)
+        view->media_card = str[15];
+    else
+        view->media_card = -1;
+
+    return TRUE;
 }
 
 /**
@@ -926,14 +2755,14 @@ SectionID get_genetx_section_id(gint version, gint type)
  **/
 void get_option(guint id, guint position)
 {
-    GString *msg = g_string_sized_new(9);
+    gchar data[3];
+
     debug_msg(DEBUG_MSG2DEV, "REQUEST_PARAMETER_VALUE: id %d position %d",
                               id, position);
-    g_string_append_printf(msg, "%c%c%c",
-                           ((id & 0xFF00) >> 8), (id & 0xFF),
-                           position);
-    send_message(REQUEST_PARAMETER_VALUE, msg->str, msg->len);
-    g_string_free(msg, TRUE);
+    data[0] = (id & 0xFF00) >> 8;
+    data[1] = id & 0xFF;
+    data[2] = position;
+    send_message(REQUEST_PARAMETER_VALUE, data, sizeof(data));
 }
 /**
  *  \param id Parameter ID
@@ -942,20 +2771,135 @@ void get_option(guint id, guint position)
  *
  *  Forms SysEx message to set parameter then sends it to device.
  **/
-void set_option(guint id, guint position, guint value)
+static void send_option(guint id, guint position, guint value)
 {
-    GString *msg = g_string_sized_new(9);
-    g_string_append_printf(msg, "%c%c%c",
-                           ((id & 0xFF00) >> 8), (id & 0xFF),
-                           position);
-    append_value(msg, value);
+    gchar data[PARAM_MAX_LEN];
+    gint len = encode_param(data, id, position, value);
+
     if (debug_flag_is_set(DEBUG_MSG2DEV)) {
         GString *ipv = format_ipv(id, position, value);
         debug_msg(DEBUG_MSG2DEV, "RECEIVE_PARAMETER_VALUE\n%s", ipv->str);
         g_string_free(ipv, TRUE);
     }
-    send_message(RECEIVE_PARAMETER_VALUE, msg->str, msg->len);
-    g_string_free(msg, TRUE);
+    send_message(RECEIVE_PARAMETER_VALUE, data, len);
+    edit_buffer_set_param(id, position, value);
+}
+
+/**
+ *  Sends newest value of every pending coalesced parameter change,
+ *  in order the parameters were first changed.
+ **/
+void flush_pending_options()
+{
+    GQueue *keys;
+    GHashTable *values;
+    gpointer key;
+
+    G_LOCK(pending_options);
+    if (pending_option_keys == NULL ||
+        g_queue_is_empty(pending_option_keys)) {
+        G_UNLOCK(pending_options);
+        return;
+    }
+
+    keys = pending_option_keys;
+    values = pending_options;
+    pending_option_keys = g_queue_new();
+    pending_options = g_hash_table_new(g_direct_hash, g_direct_equal);
+    G_UNLOCK(pending_options);
+
+    while ((key = g_queue_pop_head(keys)) != NULL) {
+        guint k = GPOINTER_TO_UINT(key);
+        guint value = GPOINTER_TO_UINT(g_hash_table_lookup(values, key));
+
+        send_option(k & 0xFFFF, k >> 16, value);
+    }
+
+    g_queue_free(keys);
+    g_hash_table_destroy(values);
+}
+
+/**
+ *  \param data unused
+ *
+ *  Rate limiting timeout. Sends pending parameter changes and keeps
+ *  running as long as there were any.
+ *
+ *  \return TRUE if timeout should keep running, otherwise FALSE.
+ **/
+static gboolean pending_options_timeout_cb(gpointer data)
+{
+    gboolean pending;
+
+    G_LOCK(pending_options);
+    pending = !g_queue_is_empty(pending_option_keys);
+    if (!pending) {
+        pending_options_source = 0;
+    }
+    G_UNLOCK(pending_options);
+
+    if (pending) {
+        flush_pending_options();
+    }
+
+    return pending;
+}
+
+/**
+ *  \param id Parameter ID
+ *  \param position Parameter position
+ *  \param value Parameter value
+ *
+ *  Sets parameter, sending at most one message per parameter every
+ *  send_interval milliseconds. The first change is sent right away,
+ *  further changes within the interval only replace the pending value.
+ *  Must be called from main context.
+ **/
+void set_option_coalesced(guint id, guint position, guint value)
+{
+    gpointer key = GUINT_TO_POINTER((position << 16) | id);
+
+    if (send_interval <= 0) {
+        set_option(id, position, value);
+        return;
+    }
+
+    G_LOCK(pending_options);
+    if (pending_options == NULL) {
+        pending_options = g_hash_table_new(g_direct_hash, g_direct_equal);
+        pending_option_keys = g_queue_new();
+    }
+
+    if (pending_options_source == 0) {
+        /* idle for at least one interval, send right away */
+        pending_options_source = g_timeout_add(send_interval,
+                                               pending_options_timeout_cb,
+                                               NULL);
+        G_UNLOCK(pending_options);
+        send_option(id, position, value);
+        return;
+    }
+
+    if (!g_hash_table_lookup_extended(pending_options, key, NULL, NULL)) {
+        g_queue_push_tail(pending_option_keys, key);
+    }
+    g_hash_table_replace(pending_options, key, GUINT_TO_POINTER(value));
+    G_UNLOCK(pending_options);
+
+    edit_buffer_set_param(id, position, value);
+}
+
+/**
+ *  \param id Parameter ID
+ *  \param position Parameter position
+ *  \param value Parameter value
+ *
+ *  Sends pending coalesced changes, then sets parameter.
+ **/
+void set_option(guint id, guint position, guint value)
+{
+    flush_pending_options();
+    send_option(id, position, value);
 }
 
 /**
@@ -970,54 +2914,65 @@ void set_option(guint id, guint position, guint value)
 void send_object(SectionID section, guint bank, guint index,
                  gchar *name, GString *data)
 {
-    GString *msg = g_string_new(NULL);
-
+    gchar buf[SYSEX_STACK_SIZE];
+    gchar *msg = buf;
+    gint name_len = strlen(name) + 1; /* NULL terminated string */
     gint len = data->len;
+    gint n = 0;
 
-    g_string_append_printf(msg,
-                           "%c%c%c%c%s%c%c%c",
-                           section, bank,
-                           ((index & 0xFF00) >> 8), (index & 0xFF),
-                           name, 0 /* NULL terminated string */,
-                           ((len & 0xFF00) >> 8), (len & 0xFF));
-
-    g_string_append_len(msg, data->str, data->len);
-
-    send_message(RECEIVE_OBJECT, msg->str, msg->len);
+    if (6 + name_len + len > sizeof(buf)) {
+        msg = g_malloc(6 + name_len + len);
+    }
 
-    g_string_free(msg, TRUE);
+    msg[n++] = section;
+    msg[n++] = bank;
+    msg[n++] = (index & 0xFF00) >> 8;
+    msg[n++] = index & 0xFF;
+    memcpy(&msg[n], name, name_len);
+    n += name_len;
+    msg[n++] = (len & 0xFF00) >> 8;
+    msg[n++] = len & 0xFF;
+    memcpy(&msg[n], data->str, len);
+    n += len;
+
+    send_message(RECEIVE_OBJECT, msg, n);
+
+    if (msg != buf) {
+        g_free(msg);
+    }
 }
 
 /**
- *  \param params GList containing SettingParam
+ *  \param params GArray containing SettingParam
  *
  *  Forms RECEIVE_PRESET_PARAMETERS SysEx message then sends it to device.
  **/
-void send_preset_parameters(GList *params)
+void send_preset_parameters(GArray *params)
 {
-    GString *msg = g_string_sized_new(500);
-    GList *iter = params;
-    gint len = g_list_length(iter);
+    gchar buf[SYSEX_STACK_SIZE];
+    gchar *msg = buf;
+    gint len = params->len;
+    gint n = 0;
+    gint i;
 
-    g_string_append_printf(msg, "%c%c",
-                           ((len & 0xFF00) >> 8),
-                           (len & 0xFF));
+    if (2 + len * PARAM_MAX_LEN > sizeof(buf)) {
+        msg = g_malloc(2 + len * PARAM_MAX_LEN);
+    }
 
-    while (iter) {
-        SettingParam *param = (SettingParam *) iter->data;
-        iter = iter->next;
+    msg[n++] = (len & 0xFF00) >> 8;
+    msg[n++] = len & 0xFF;
 
-        g_string_append_printf(msg, "%c%c%c",
-                               ((param->id & 0xFF00) >> 8),
-                               (param->id & 0xFF),
-                               param->position);
+    for (i = 0; i < len; i++) {
+        SettingParam *param = &g_array_index(params, SettingParam, i);
 
-        append_value(msg, param->value);
-    };
+        n += encode_param(&msg[n], param->id, param->position, param->value);
+    }
 
-    send_message(RECEIVE_PRESET_PARAMETERS, msg->str, msg->len);
+    send_message(RECEIVE_PRESET_PARAMETERS, msg, n);
 
-    g_string_free(msg, TRUE);
+    if (msg != buf) {
+        g_free(msg);
+    }
 }
 
 /**
@@ -1036,6 +2991,8 @@ void switch_preset(guint bank, guint x)
                            1);                     /* load */
     send_message(MOVE_PRESET, msg->str, msg->len);
     g_string_free(msg, TRUE);
+
+    edit_buffer_invalidate();
 }
 
 /**
@@ -1054,6 +3011,32 @@ void store_preset_name(int x, const gchar *name)
                            1);                     /* load */
     send_message(MOVE_PRESET, msg->str, msg->len);
     g_string_free(msg, TRUE);
+
+    edit_buffer_set_name(name);
+
+    cache_invalidate_preset(PRESETS_USER, x);
+    Preset *preset = edit_buffer_get_preset();
+    if (preset != NULL) {
+        cache_set_preset(PRESETS_USER, x, preset);
+        preset_free(preset);
+    }
+}
+
+/**
+ *  \param name new name
+ *
+ *  Renames preset loaded in edit buffer, without storing it.
+ **/
+void set_edit_buffer_name(const gchar *name)
+{
+    GString *msg = g_string_sized_new(12);
+    g_string_append_printf(msg, "%c%c%s%c",
+                           PRESETS_EDIT_BUFFER, 0,  /* edit buffer */
+                           name, 0);                /* name */
+    send_message(RECEIVE_PRESET_NAME, msg->str, msg->len);
+    g_string_free(msg, TRUE);
+
+    edit_buffer_set_name(name);
 }
 
 /**
@@ -1074,117 +3057,50 @@ void set_preset_name(int x, gchar *name)
 }
 
 /**
- *  \param bank preset bank
+ *  \param data RECEIVE_PRESET_NAMES reply
  *
- *  Queries preset names.
- *
- *  \return GStrv which must be freed with g_strfreev, or NULL on error.
+ *  \return GStrv which must be freed with g_strfreev, or NULL if reply
+ *          is malformed.
  **/
-GStrv query_preset_names(gchar bank)
+GStrv parse_preset_names(GString *data)
 {
-    GString *data = NULL;
-    int x;                    /* used to iterate over whole reply */
+    NameIter names;
+    const gchar *name;
     int n = 0;                /* current preset number */
-    int n_total;              /* total number of presets */
-    gchar **str_array = NULL;
-
-    /* query user preset names */
-    send_message(REQUEST_PRESET_NAMES, &bank, 1);
-
-    /* read reply */
-    data = get_message_by_id(RECEIVE_PRESET_NAMES);
+    gchar **str_array;
 
-    if (data != NULL) {
-        if (data->len >= 10) {
-            n_total = data->str[9];
-            str_array = g_new(gchar*, n_total + 1);
-            str_array[n_total] = NULL;
-        }
+    if (!name_iter_init(&names, data))
+        return NULL;
 
-        for (x=10; ((x<data->len) && (n<n_total)); x++) {
-            if ((unsigned char)data->str[x] == 0xF7) /* every message ends with 0xF7 */
-                break;
+    str_array = g_new(gchar*, names.left + 1);
+    while ((name = name_iter_next(&names)) != NULL)
+        str_array[n++] = g_strdup(name);
+    str_array[n] = NULL;
 
-            str_array[n] = g_strdup(&data->str[x]);
-            x += strlen(str_array[n]);
-            n++;
-        }
-        g_string_free(data, TRUE);
-    }
     return str_array;
 }
 
 /**
- *  Reads multiple messages and puts them into GList.
+ *  \param bank preset bank
  *
- *  \param id MessageID starting message sequence
+ *  Queries preset names, waiting for reply.
  *
- *  \return GList with SysEx messages, which must be freed using message_list_free.
+ *  \return GStrv which must be freed with g_strfreev, or NULL on error.
  **/
-GList *get_message_list(MessageID id)
+GStrv query_preset_names(gchar bank)
 {
     GString *data = NULL;
-    GList *list = NULL;
-    guint x, len;
-    gboolean found = FALSE;
-    gboolean done = FALSE;
-
-    g_mutex_lock(message_queue_mutex);
-    do {
-        len = g_queue_get_length(message_queue);
-
-        for (x = 0; x<len && (found == FALSE); x++) {
-            data = g_queue_peek_nth(message_queue, x);
-            if (get_message_id(data) == id) {
-                found = TRUE;
-                g_queue_pop_nth(message_queue, x);
-                unpack_message(data);
-                list = g_list_append(list, data);
-                break;
-            }
-        }
-
-        if (found == TRUE) {
-            int i;
-            int amt;
-
-            switch (id) {
-                case RECEIVE_PRESET_START:
-                    for (i = 10; (i < data->len) && data->str[i]; i++);
-                    amt = (unsigned char)data->str[i+2];
-                    break;
-                case RECEIVE_BULK_DUMP_START:
-                    amt = ((unsigned char)data->str[8] << 8) | (unsigned char)data->str[9];
-                    break;
-                default:
-                    g_error("get_message_list() doesn't support followning id: %d", id);
-                    g_string_free(data, TRUE);
-                    g_list_free(list);
-                    g_assert(!"BUG");
-                    return NULL;
-            }
-
-            while (amt) {
-                debug_msg(DEBUG_VERBOSE, "%d messages left", amt);
-                data = g_queue_pop_nth(message_queue, x);
-                if (data == NULL) {
-                    g_cond_wait(message_queue_cond, message_queue_mutex);
-                } else {
-                    unpack_message(data);
-                    list = g_list_append(list, data);
-                    amt--;
-                }
-            }
+    gchar **str_array = NULL;
 
-            done = TRUE;
-        } else {
-            /* id not found in message queue */
-            g_cond_wait(message_queue_cond, message_queue_mutex);
-        }
-    } while (done == FALSE);
-    g_mutex_unlock(message_queue_mutex);
+    /* query user preset names */
+    data = device_request_wait(REQUEST_PRESET_NAMES, &bank, 1,
+                               RECEIVE_PRESET_NAMES, REQUEST_TIMEOUT);
 
-    return list;
+    if (data != NULL) {
+        str_array = parse_preset_names(data);
+        g_string_free(data, TRUE);
+    }
+    return str_array;
 }
 
 /**
@@ -1201,28 +3117,18 @@ void message_list_free(GList *list)
 }
 
 /**
- *  Queries current edit buffer.
- *
- *  \return GList with preset SysEx messages, which must be freed using message_list_free.
- **/
-GList *get_current_preset()
-{
-    send_message(REQUEST_PRESET, "\x04\x00", 2);
-    return get_message_list(RECEIVE_PRESET_START);
-}
-
-/**
- *  Creates backup file.
+ *  Writes backup file.
  *
  *  \param file backup file handle
+ *  \param list bulk dump messages received from device
  *  \param error a GError
  *
  *  \return FALSE on success, TRUE on error.
  **/
-static gboolean create_backup_file(GFile *file, GError **error)
+static gboolean write_backup_file(GFile *file, GList *list, GError **error)
 {
     GFileOutputStream *output = NULL;
-    GList *list = NULL, *iter = NULL;
+    GList *iter = NULL;
     const gchar header[] = {'\x01', '\x00'};
     gsize written;
     gboolean val;
@@ -1242,9 +3148,6 @@ static gboolean create_backup_file(GFile *file, GError **error)
         return TRUE;
     }
 
-    send_message(REQUEST_BULK_DUMP, "\x00", 1);
-    list = get_message_list(RECEIVE_BULK_DUMP_START);
-
     for (iter = list; iter; iter = g_list_next(iter)) {
         GString *str;
         guchar id;    /* message id */
@@ -1258,7 +3161,6 @@ static gboolean create_backup_file(GFile *file, GError **error)
         val = g_output_stream_write_all(G_OUTPUT_STREAM(output), &id,
                                         sizeof(id), &written, NULL, error);
         if (val == FALSE) {
-            message_list_free(list);
             g_object_unref(output);
             return TRUE;
         }
@@ -1269,7 +3171,6 @@ static gboolean create_backup_file(GFile *file, GError **error)
         val = g_output_stream_write_all(G_OUTPUT_STREAM(output), &len,
                                         sizeof(len), &written, NULL, error);
         if (val == FALSE) {
-            message_list_free(list);
             g_object_unref(output);
             return TRUE;
         }
@@ -1279,14 +3180,11 @@ static gboolean create_backup_file(GFile *file, GError **error)
         val = g_output_stream_write_all(G_OUTPUT_STREAM(output), &str->str[8],
                                         str->len - 10, &written, NULL, error);
         if (val == FALSE) {
-            message_list_free(list);
             g_object_unref(output);
             return TRUE;
         }
     }
 
-    message_list_free(list);
-
     if (error)
         *error = NULL;
     val = g_output_stream_close(G_OUTPUT_STREAM(output), NULL, error);
@@ -1294,6 +3192,47 @@ static gboolean create_backup_file(GFile *file, GError **error)
     return !val;
 }
 
+/**
+ *  \param request finished REQUEST_BULK_DUMP request
+ *  \param data backup GFile
+ *
+ *  Writes received bulk dump to backup file.
+ **/
+static void backup_received_cb(DeviceRequest *request, gpointer data)
+{
+    GFile *file = data;
+    GError *error = NULL;
+    GList *list = NULL;
+
+    if (device_request_get_status(request) == REQUEST_DONE)
+        list = device_request_steal_reply(request);
+
+    if (list == NULL) {
+        g_warning("Failed to create backup file: No reply from device");
+    } else {
+        if (write_backup_file(file, list, &error) && error != NULL) {
+            g_warning("Failed to create backup file: %s", error->message);
+            g_error_free(error);
+        }
+        message_list_free(list);
+    }
+
+    g_object_unref(file);
+}
+
+/**
+ *  Creates backup file. Bulk dump is requested without waiting,
+ *  backup_received_cb() writes it to file once it arrives.
+ *
+ *  \param file backup file handle
+ **/
+static void create_backup_file(GFile *file)
+{
+    device_request_send(REQUEST_BULK_DUMP, "\x00", 1,
+                        RECEIVE_BULK_DUMP_START, LIST_TIMEOUT,
+                        backup_received_cb, g_object_ref(file));
+}
+
 /**
  *  Restores backup file.
  *
@@ -1366,13 +3305,16 @@ static gboolean restore_backup_file(const gchar *filename, GError **error)
 static gboolean request_who_am_i(unsigned char *device_id, unsigned char *family_id,
                                  unsigned char *product_id)
 {
-    send_message(REQUEST_WHO_AM_I, "\x7F\x7F\x7F", 3);
-
-    GString *data = get_message_by_id(RECEIVE_WHO_AM_I);
-    if ((data != NULL) && (data->len > 11)) {
-        *device_id = data->str[8];
-        *family_id = data->str[9];
-        *product_id = data->str[10];
+    profile_begin("Request who am I");
+    GString *data = device_request_wait(REQUEST_WHO_AM_I, "\x7F\x7F\x7F", 3,
+                                        RECEIVE_WHO_AM_I, REQUEST_TIMEOUT);
+    WhoAmIView view;
+    profile_end();
+
+    if ((data != NULL) && who_am_i_view_init(&view, data)) {
+        *device_id = view.device_id;
+        *family_id = view.family_id;
+        *product_id = view.product_id;
         g_string_free(data, TRUE);
         debug_msg(DEBUG_STARTUP, "Found device id %d family %d product id %d.",
                                 *device_id,
@@ -1383,49 +3325,69 @@ static gboolean request_who_am_i(unsigned char *device_id, unsigned char *family
     return FALSE;
 }
 
-static void request_device_configuration()
+/**
+ *  \param config return location for device configuration
+ *
+ *  Requests device configuration.
+ *
+ *  \return TRUE on success, FALSE on error.
+ **/
+static gboolean request_device_configuration(DeviceConfigView *config)
 {
-    gint os_major, os_minor;
-    gint cpu_major, cpu_minor;
-    gint protocol_version;
-    gint current_bank, current_preset;
-    gint media_card;
+    gboolean ok;
 
-    send_message(REQUEST_DEVICE_CONFIGURATION, NULL, 0);
+    profile_begin("Request device configuration");
+    GString *data = device_request_wait(REQUEST_DEVICE_CONFIGURATION, NULL, 0,
+                                        RECEIVE_DEVICE_CONFIGURATION,
+                                        REQUEST_TIMEOUT);
+    profile_end();
 
-    GString *data = get_message_by_id(RECEIVE_DEVICE_CONFIGURATION);
-
-    if (data->len > 14) {
-        os_major = data->str[8];
-        os_minor = (((data->str[9] & 0xF0) >> 4) * 10) |
-                   (data->str[9] & 0x0F);
-        g_message("OS version: %d.%d", os_major, os_minor);
-
-        cpu_major = data->str[10];
-        cpu_minor = data->str[11];
-        g_message("CPU version: %d.%d", cpu_major, cpu_minor);
-
-        protocol_version = data->str[12];
-        g_message("Protocol version: %d", protocol_version);
+    if (data == NULL) {
+        return FALSE;
+    }
 
-        current_bank = data->str[13];
-        current_preset = data->str[14];
-        g_message("Active bank: %d", current_bank);
-        g_message("Active preset: %d", current_preset);
+    ok = device_config_view_init(config, data);
+    if (ok) {
+        g_message("OS version: %d.%d", config->os_major, config->os_minor);
+        g_message("CPU version: %d.%d", config->cpu_major, config->cpu_minor);
+        g_message("Protocol version: %d", config->protocol_version);
+        g_message("Active bank: %d", config->current_bank);
+        g_message("Active preset: %d", config->current_preset);
 
-        if (os_major >= 1) {
-            media_card = data->str[15];
-            g_message("Media card present: %d", media_card);
+        if (config->media_card >= 0) {
+            g_message("Media card present: %d", config->media_card);
         }
     }
+
+    g_string_free(data, TRUE);
+
+    return ok;
 }
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 
 static GOptionEntry options[] = {
-    {"device", 'd', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_STRING, &device_port, "MIDI device port to use", NULL},
+    {"device", 'd', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_STRING, &device_port,
+        "MIDI device port to use, or transport address starting with "
+        "rawmidi:, seq:, unix:, fd:, sim: or loopback:", "<port>"},
+    {"send-interval", 'i', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_INT, &send_interval,
+        "Minimum interval in ms between updates of one parameter "
+        "(default 20, 0 to send every change)", "<ms>"},
+    {"verify-edit-buffer", 'V', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &verify_edit_buffer,
+        "Read edit buffer from device when saving and compare it with local copy", NULL},
+    {"profile-startup", 0, G_OPTION_FLAG_IN_MAIN | G_OPTION_FLAG_OPTIONAL_ARG,
+        G_OPTION_ARG_CALLBACK, set_profile_startup,
+        "Print startup phase timing and write it as Chrome trace "
+        "(default " PROFILE_TRACE_FILE ")", "<file>"},
+    {"simulate", 0, G_OPTION_FLAG_IN_MAIN | G_OPTION_FLAG_OPTIONAL_ARG,
+        G_OPTION_ARG_CALLBACK, set_simulate,
+        "Use simulated device instead of MIDI device. Options are latency "
+        "and jitter in ms, bandwidth in bytes/s, drop and corrupt in percent "
+        "of replies and presets per bank",
+        "<model>[,latency=<ms>,jitter=<ms>,bandwidth=<n>,drop=<n>,corrupt=<n>,"
+        "presets=<n>]"},
     {"debug-flags <flags>", 'D', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_CALLBACK, set_debug_flags,
-        "<flags> any of a, d, g, h, m, s, x, v:\n"
+        "<flags> any of a, d, g, h, m, s, t, x, v:\n"
         "                                "
         "a: Everything.\n"
         "                                "
@@ -1439,6 +3401,8 @@ static GOptionEntry options[] = {
         "                                "
         "s: Startup.\n"
         "                                "
+        "t: Request and I/O statistics.\n"
+        "                                "
         "x: Debug xml parsing/writing.\n"
         "                                "
         "v: Additional verbosity.\n" ,
@@ -1477,11 +3441,9 @@ static gint get_digitech_devices(GList **devices)
 int main(int argc, char *argv[]) {
     GError *error = NULL;
     GOptionContext *context;
-    static gboolean stop_read_thread = FALSE;
-    GThread *read_thread = NULL;
+    gint64 start_time = g_get_monotonic_time();
 
     g_thread_init(NULL);
-    gdk_threads_init();
 
     context = g_option_context_new(NULL);
     g_option_context_add_main_entries(context, options, NULL);
@@ -1494,13 +3456,22 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    if (profile_trace_file != NULL) {
+        profile_init(profile_trace_file, start_time);
+    }
+
     if (device_port == NULL) {
         /* port not given explicitly in commandline - search for devices */
         GList *devices = NULL;
         GList *device = NULL;
         int    num_devices = 0;
         int    chosen_device = 0;
-        if ((num_devices = get_digitech_devices(&devices)) <= 0) {
+
+        profile_begin("Find DigiTech devices");
+        num_devices = get_digitech_devices(&devices);
+        profile_end();
+
+        if (num_devices <= 0) {
             g_warning("Couldn't find DigiTech devices!");
             exit(EXIT_FAILURE);
         }
@@ -1525,14 +3496,11 @@ int main(int argc, char *argv[]) {
     if (open_device() == TRUE) {
         show_error_message(NULL, "Failed to open MIDI device");
     } else {
-        message_queue = g_queue_new();
-        message_queue_mutex = g_mutex_new();
-        message_queue_cond = g_cond_new();
-        read_thread = g_thread_create((GThreadFunc)read_data_thread,
-                                      &stop_read_thread,
-                                      TRUE, NULL);
-
-        if (request_who_am_i(&device_id, &family_id, &product_id) == FALSE) {
+        message_slots_init();
+        output_writer_start();
+        if (read_thread_start() == TRUE) {
+            show_error_message(NULL, "Failed to start MIDI input thread");
+        } else if (request_who_am_i(&device_id, &family_id, &product_id) == FALSE) {
             show_error_message(NULL, "No suitable reply from device");
         } else {
             Device *device = NULL;
@@ -1544,43 +3512,45 @@ int main(int argc, char *argv[]) {
             }
 
             if (device != NULL) {
+                DeviceConfigView config;
+
+                if (request_device_configuration(&config)) {
+                    profile_begin("Load preset cache");
+                    cache_open(device_id, family_id, product_id,
+                               config.os_major, config.os_minor);
+                    profile_end();
+                }
+
                 /* enable GUI mode */
                 set_option(GUI_MODE_ON_OFF, GLOBAL_POSITION, 1);
 
+                profile_begin("Create GUI");
                 gui_create(device);
+                profile_end();
+                profile_startup_done();
+
                 gtk_main();
+                profile_finish();
                 gui_free();
 
                 /* disable GUI mode */
                 set_option(GUI_MODE_ON_OFF, GLOBAL_POSITION, 0);
+
+                cache_close();
             }
         }
     }
 
-    if (read_thread != NULL) {
-        stop_read_thread = TRUE;
-        g_thread_join(read_thread);
-    }
-
-    if (message_queue_mutex != NULL) {
-        g_mutex_free(message_queue_mutex);
-    }
+    read_thread_finish();
 
-    if (message_queue != NULL && g_queue_get_length(message_queue)) {
-        g_warning("%d unread messages in queue",
-                  g_queue_get_length(message_queue));
-        g_queue_foreach(message_queue, (GFunc) message_free_func, NULL);
-        g_queue_free(message_queue);
-    }
+    output_writer_finish();
 
-    if (output != NULL) {
-        snd_rawmidi_drain(output);
-        snd_rawmidi_close(output);
+    if (message_queue_mutex != NULL) {
+        message_slots_free();
     }
 
-    if (input != NULL) {
-        snd_rawmidi_drain(input);
-        snd_rawmidi_close(input);
+    if (transport != NULL) {
+        transport_close(transport);
     }
 
     return EXIT_SUCCESS;
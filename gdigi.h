@@ -30,6 +30,7 @@ typedef enum {
     DEBUG_HEX       = (1 << 4),     // Dump message contents in hex.
     DEBUG_XML       = (1 << 5),
     DEBUG_VERBOSE   = (1 << 6),
+    DEBUG_STATS     = (1 << 7),     // Request and I/O statistics.
 } debug_flags_t;
 
 void debug_msg (debug_flags_t, char *fmt, ...);
@@ -43,6 +44,7 @@ gboolean debug_flag_is_set (debug_flags_t flag);
 #define GNX_CHANNEL_FS_MODE 264
 
 unsigned char product_id;
+extern gboolean verify_edit_buffer;
 
 enum {
   GNX3K_WAH_TYPE_CRY = 129,
@@ -1130,27 +1132,117 @@ typedef struct {
     GString *data;
 } SettingGenetx;
 
+/* Views of received messages. They point into the message buffer, which
+   must outlive them, and are only filled in when the message is long
+   enough for everything they describe. */
+
+typedef struct {
+    const guchar *pos;
+    const guchar *end;
+    gint left;              /**< parameters left according to message */
+} ParamIter;
+
+typedef struct {
+    guint bank;             /**< PresetBank names belong to */
+    const gchar *pos;
+    const gchar *end;
+    gint left;              /**< names left according to message */
+} NameIter;
+
+typedef struct {
+    guint bank;
+    guint index;
+    const gchar *name;      /**< NUL terminated, inside message */
+    gboolean modified;
+    guint n_messages;       /**< amount of messages to follow */
+} PresetStartView;
+
+typedef struct {
+    NotifyCode code;
+    union {
+        struct {
+            guint src_bank;
+            guint src_index;
+            guint dst_bank;
+            guint dst_index;
+        } moved;            /**< NOTIFY_PRESET_MOVED */
+        guint group_id;     /**< NOTIFY_MODIFIER_GROUP_CHANGED */
+    } u;
+} NotificationView;
+
+typedef struct {
+    guint group_id;
+    guint count;
+    const guchar *entries;  /**< count entries, 3 bytes each */
+} LinkableListView;
+
+typedef struct {
+    guint device_id;
+    guint family_id;
+    guint product_id;
+} WhoAmIView;
+
+typedef struct {
+    guint os_major;
+    guint os_minor;
+    guint cpu_major;
+    guint cpu_minor;
+    guint protocol_version;
+    guint current_bank;
+    guint current_preset;
+    gint media_card;        /**< -1 if not reported */
+} DeviceConfigView;
+
+typedef enum {
+    REQUEST_PENDING,
+    REQUEST_DONE,
+    REQUEST_TIMED_OUT,
+    REQUEST_CANCELLED
+} RequestStatus;
+
+typedef struct _DeviceRequest DeviceRequest;
+typedef void (*DeviceRequestFunc)(DeviceRequest *request, gpointer data);
+
 void send_message(gint procedure, gchar *data, gint len);
+guint get_output_queue_depth();
+void read_thread_request_reconfigure();
 MessageID get_message_id(GString *msg);
 void append_value(GString *msg, guint value);
-GString *get_message_by_id(MessageID id);
-SettingParam *setting_param_new();
-SettingParam *setting_param_new_from_data(gchar *str, gint *len);
 SettingGenetx *setting_genetx_new();
 void setting_genetx_free(SettingGenetx *genetx);
-void setting_param_free(SettingParam *param);
+gboolean param_iter_init(ParamIter *iter, GString *msg);
+gboolean param_iter_next(ParamIter *iter, SettingParam *param);
+gboolean name_iter_init(NameIter *iter, GString *msg);
+const gchar *name_iter_next(NameIter *iter);
+gboolean preset_start_view_init(PresetStartView *view, GString *msg);
+gboolean notification_view_init(NotificationView *view, GString *msg);
+gboolean linkable_list_view_init(LinkableListView *view, GString *msg);
+void linkable_list_view_get(LinkableListView *view, guint n,
+                            guint *id, guint *position);
+gboolean who_am_i_view_init(WhoAmIView *view, GString *msg);
+gboolean device_config_view_init(DeviceConfigView *view, GString *msg);
 SectionID get_genetx_section_id(gint version, gint type);
 void set_option(guint id, guint position, guint value);
+void set_option_coalesced(guint id, guint position, guint value);
+void flush_pending_options();
 void get_option(guint id, guint position);
 void send_object(SectionID section, guint bank, guint index,
                  gchar *name, GString *data);
-void send_preset_parameters(GList *params);
+void send_preset_parameters(GArray *params);
 void switch_preset(guint bank, guint x);
 void store_preset_name(int x, const gchar *name);
+void set_edit_buffer_name(const gchar *name);
 void set_preset_level(int level);
+GStrv parse_preset_names(GString *data);
 GStrv query_preset_names(gchar bank);
 void message_list_free(GList *list);
-GList *get_current_preset();
 GString *format_ipv(guint id, guint pos, guint val);
+DeviceRequest *device_request_send(gint procedure, gchar *data, gint len,
+                                   MessageID reply_id, guint timeout,
+                                   DeviceRequestFunc callback,
+                                   gpointer user_data);
+void device_request_cancel(DeviceRequest *request);
+RequestStatus device_request_get_status(DeviceRequest *request);
+gpointer device_request_steal_reply(DeviceRequest *request);
 
 #endif /* GDIGI_H */
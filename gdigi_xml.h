@@ -31,10 +31,15 @@ typedef struct {
     EffectValues   *values;
     XmlLabel       *xml_labels;        /* 'type' id's have a label group. */
     guint           xml_labels_amt;
+    gchar         **label_map;         /* labels indexed by value - label_min,
+                                          filled in by index build */
+    gint            label_min;
+    guint           label_map_len;
 } XmlSettings;
 
 XmlSettings *get_xml_settings(guint id, guint position);
 gboolean value_is_extra(EffectValues *val, int value);
 gchar * map_xml_value(XmlSettings *xml, EffectValues *values, gint value);
+GString *format_value(XmlSettings *xml, guint value);
 
 #endif /* GDIGI_XML_H */
@@ -72,6 +72,16 @@ static void gtk_knob_adjustment_value_changed(GtkAdjustment *adjustment, gpointe
 
 static GtkWidgetClass *parent_class = NULL;
 
+/* Knob animation copied into surface of the type preferred by backend
+   (server side on X11), so drawing a frame doesn't upload pixels.
+   Sub-surface of each frame is created on first use and kept. */
+typedef struct {
+    GdkDisplay *display;
+    gint scale;                 /* window scale factor */
+    cairo_surface_t *surface;   /* whole animation strip */
+    cairo_surface_t **frames;   /* per frame sub-surfaces of surface */
+} GtkKnobAtlas;
+
 
 /*****************************************************************************
  *
@@ -145,6 +155,7 @@ gtk_knob_init (GtkKnob *knob) {
     knob->saved_y    = 0;
     knob->timer      = 0;
     knob->anim       = NULL;
+    knob->frame      = -1;
     knob->old_value  = 0.0;
     knob->old_lower  = 0.0;
     knob->old_upper  = 0.0;
@@ -408,6 +419,83 @@ gtk_knob_size_allocate (GtkWidget *widget, GtkAllocation *allocation) {
 }
 
 
+/*****************************************************************************
+ *
+ * gtk_knob_get_frame()
+ *
+ *****************************************************************************/
+static gint
+gtk_knob_get_frame(GtkKnob *knob) {
+    gdouble dx, dy;
+    gint frame;
+
+    dx = gtk_adjustment_get_value(knob->adjustment) - gtk_adjustment_get_lower(knob->adjustment);	/* value, from 0 */
+    dy = gtk_adjustment_get_upper(knob->adjustment) - gtk_adjustment_get_lower(knob->adjustment);	/* range */
+
+    if (dy <= 0.0) {
+	return 0;
+    }
+
+    frame = (int)((knob->anim->n_frames - 1) * dx / dy);
+
+    return CLAMP(frame, 0, knob->anim->n_frames - 1);
+}
+
+
+/*****************************************************************************
+ *
+ * gtk_knob_animation_get_frame()
+ *
+ *****************************************************************************/
+static cairo_surface_t *
+gtk_knob_animation_get_frame(GtkKnobAnim *anim, GtkWidget *widget, gint frame) {
+    GdkWindow *window = gtk_widget_get_window(widget);
+    GdkDisplay *display = gtk_widget_get_display(widget);
+    gint scale = gtk_widget_get_scale_factor(widget);
+    GtkKnobAtlas *atlas = NULL;
+    GSList *iter;
+    cairo_t *cr;
+
+    for (iter = anim->atlases; iter; iter = iter->next) {
+	GtkKnobAtlas *a = iter->data;
+	if (a->display == display && a->scale == scale) {
+	    atlas = a;
+	    break;
+	}
+    }
+
+    if (atlas == NULL) {
+	atlas = g_slice_new(GtkKnobAtlas);
+	atlas->display = display;
+	atlas->scale   = scale;
+	atlas->frames  = g_new0(cairo_surface_t *, anim->n_frames);
+
+	/* similar surface already has window scale factor applied */
+	atlas->surface = gdk_window_create_similar_surface(window,
+							   CAIRO_CONTENT_COLOR_ALPHA,
+							   anim->width,
+							   anim->height);
+	cr = cairo_create(atlas->surface);
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cr, anim->image, 0, 0);
+	cairo_paint(cr);
+	cairo_destroy(cr);
+
+	anim->atlases = g_slist_prepend(anim->atlases, atlas);
+    }
+
+    if (atlas->frames[frame] == NULL) {
+	atlas->frames[frame] =
+	    cairo_surface_create_for_rectangle(atlas->surface,
+					       frame * anim->frame_width, 0.0,
+					       (double)anim->frame_width,
+					       (double)anim->height);
+    }
+
+    return atlas->frames[frame];
+}
+
+
 /*****************************************************************************
  *
  * gtk_knob_draw()
@@ -416,8 +504,6 @@ gtk_knob_size_allocate (GtkWidget *widget, GtkAllocation *allocation) {
 static gboolean
 gtk_knob_draw(GtkWidget *widget, cairo_t *cr) {
     GtkKnob *knob;
-    gdouble dx, dy;
-    gint frames;
 
     g_return_val_if_fail (widget != NULL, FALSE);
     g_return_val_if_fail (GTK_IS_KNOB (widget), FALSE);
@@ -426,20 +512,13 @@ gtk_knob_draw(GtkWidget *widget, cairo_t *cr) {
 
     knob = GTK_KNOB (widget);
 
-    frames = ((knob->anim->width / knob->anim->frame_width) - 1);
-    dx = gtk_adjustment_get_value(knob->adjustment) - gtk_adjustment_get_lower(knob->adjustment);	/* value, from 0 */
-    dy = gtk_adjustment_get_upper(knob->adjustment) - gtk_adjustment_get_lower(knob->adjustment);	/* range */
-
-    dx = (int)(frames * dx / dy) * knob->width;  /* check this for height != width */
+    knob->frame = gtk_knob_get_frame(knob);
 
-    cairo_surface_t *surface =
-        cairo_surface_create_for_rectangle(knob->anim->image,
-                                           dx, 0.0,
-                                           (double)knob->width,
-                                           (double)knob->height);
-    cairo_set_source_surface(cr, surface, 0, 0);
+    cairo_set_source_surface(cr,
+			     gtk_knob_animation_get_frame(knob->anim, widget,
+							  knob->frame),
+			     0, 0);
     cairo_paint(cr);
-    cairo_surface_destroy(surface);
 
     if (gtk_widget_has_focus(widget)) {
         GtkStyleContext *context;
@@ -702,7 +781,9 @@ gtk_knob_update_mouse_update(GtkKnob *knob) {
 	g_signal_emit_by_name (knob->adjustment, "value_changed");
     }
     else {
-	gtk_widget_queue_draw (GTK_WIDGET (knob));
+	if (gtk_knob_get_frame(knob) != knob->frame) {
+	    gtk_widget_queue_draw (GTK_WIDGET (knob));
+	}
 
 	if (knob->policy == GTK_KNOB_UPDATE_DELAYED) {
 	    if (knob->timer) {
@@ -796,7 +877,10 @@ gtk_knob_update(GtkKnob *knob) {
 	g_signal_emit_by_name (knob->adjustment, "value_changed");
     }
 
-    gtk_widget_queue_draw (GTK_WIDGET (knob));
+    /* values mapping to the frame already shown need no redraw */
+    if (gtk_knob_get_frame(knob) != knob->frame) {
+	gtk_widget_queue_draw (GTK_WIDGET (knob));
+    }
 }
 
 
@@ -862,6 +946,7 @@ gtk_knob_set_animation (GtkKnob *knob, GtkKnobAnim *anim) {
     knob->anim   = (GtkKnobAnim *)anim;
     knob->width  = anim->frame_width;
     knob->height = anim->height;
+    knob->frame  = -1;
 
     if (gtk_widget_get_realized (GTK_WIDGET(knob))) {
     	gtk_widget_queue_resize (GTK_WIDGET (knob));
@@ -901,6 +986,8 @@ gtk_knob_animation_new_from_inline() {
     anim->width       = cairo_image_surface_get_width(anim->image);
     anim->height      = cairo_image_surface_get_height(anim->image);
     anim->frame_width = anim->height;
+    anim->n_frames    = MAX(anim->width / anim->frame_width, 1);
+    anim->atlases     = NULL;
 
     return anim;
 }
@@ -914,6 +1001,21 @@ void
 gtk_knob_animation_free(GtkKnobAnim *anim) {
     g_return_if_fail (anim != NULL);
 
+    while (anim->atlases) {
+	GtkKnobAtlas *atlas = anim->atlases->data;
+	gint i;
+
+	for (i = 0; i < anim->n_frames; i++) {
+	    if (atlas->frames[i])
+		cairo_surface_destroy(atlas->frames[i]);
+	}
+	g_free(atlas->frames);
+	cairo_surface_destroy(atlas->surface);
+	g_slice_free(GtkKnobAtlas, atlas);
+
+	anim->atlases = g_slist_delete_link(anim->atlases, anim->atlases);
+    }
+
     if (anim->image)
         cairo_surface_destroy(anim->image);
 
@@ -50,6 +50,8 @@ typedef enum
 	gint width;  /* derived from image width */
 	gint height;  /* derived from image height. */
 	gint frame_width;  /* derived from pixbuf (width / height) or provided override for rectangular frames */
+	gint n_frames;  /* width / frame_width */
+	GSList *atlases;  /* frames prepared for drawing, one per window scale factor */
     };
 
     struct _GtkKnob {
@@ -69,6 +71,7 @@ typedef enum
 	/* knob animation */
 	GtkKnobAnim *anim;
 	gint width, height;
+	gint frame;  /* animation frame drawn, -1 if not drawn yet */
 
 	/* Old values from adjustment stored so we know when something changes */
 	gdouble old_value;
@@ -17,11 +17,15 @@
 #include <gtk/gtk.h>
 #include <glib-object.h>
 #include <string.h>
+#include <stdlib.h>
 #include <alsa/asoundlib.h>
 #include "gdigi.h"
 #include "gui.h"
 #include "effects.h"
 #include "preset.h"
+#include "cache.h"
+#include "library.h"
+#include "profile.h"
 #include "gtkknob.h"
 #include "images/gdigi_icon.h"
 #include "gdigi_xml.h"
@@ -91,20 +95,43 @@ get_message_name(MessageID msgid)
 
 }
 
+/** kind of widget in widget index, decided when widget is added */
+typedef enum {
+    WIDGET_ADJUSTMENT,
+    WIDGET_TOGGLE_BUTTON,
+    WIDGET_COMBO_BOX,
+} WidgetKind;
+
 typedef struct {
+    guint32 key;          /**< (position << 16) | id */
+    guint32 seq;          /**< insertion order, keeps sort stable */
     GObject *widget;
+    WidgetKind kind;
 
     /* used for combo boxes, if widget isn't combo box, then both value and x are -1 */
     gint value;           /**< effect type value */
     gint x;               /**< combo box item number */
-} WidgetTreeElem;
+} WidgetElem;
+
+/** widgets controlling one parameter, stored next to each other */
+typedef struct {
+    guint32 key;          /**< (position << 16) | id */
+    guint first;          /**< index of first WidgetElem */
+    guint n;              /**< number of WidgetElems */
+} WidgetSpan;
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 static GtkKnobAnim *knob_anim = NULL; /* animation used by knobs */
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
-static GTree *widget_tree = NULL;     /**< this tree contains lists containing WidgetTreeElem data elements */
+static GArray *widget_elems = NULL;   /**< WidgetElem, sorted by key unless widget_index_dirty */
+static GArray *widget_spans = NULL;   /**< WidgetSpan, sorted by key */
+static gboolean widget_index_dirty = FALSE; /**< TRUE if widget_spans is out of date */
+static guint32 widget_elem_seq = 0;
 static gboolean allow_send = FALSE;   /**< if FALSE GUI parameter changes won't be sent to device */
 
+/** above this many changed parameters presets are sent whole */
+#define MAX_PRESET_CHANGES 32
+
 /**
  *  \param parent transient parent, or NULL for none
  *  \param message error description
@@ -301,7 +328,7 @@ void value_changed_option_cb(GtkAdjustment *adj, EffectSettings *setting)
     if (allow_send) {
         gdouble val;
         g_object_get(G_OBJECT(adj), "value", &val, NULL);
-        set_option(setting->id, setting->position, (gint)val);
+        set_option_coalesced(setting->id, setting->position, (gint)val);
     }
 }
 
@@ -317,124 +344,404 @@ void toggled_cb(GtkToggleButton *button, Effect *effect)
 
     if (allow_send) {
         guint val = gtk_toggle_button_get_active(button);
-        set_option(effect->id, effect->position, val);
+        set_option_coalesced(effect->id, effect->position, val);
+    }
+}
+
+/**
+ *  \param a WidgetElem
+ *  \param b WidgetElem
+ *
+ *  Orders widget elements by key, then by insertion order.
+ *
+ *  \return negative value if a < b, zero if a = b, positive value if a > b.
+ **/
+static gint widget_elem_cmp(gconstpointer a, gconstpointer b)
+{
+    const WidgetElem *el_a = a;
+    const WidgetElem *el_b = b;
+
+    if (el_a->key != el_b->key)
+        return (el_a->key > el_b->key) ? 1 : -1;
+    if (el_a->seq != el_b->seq)
+        return (el_a->seq > el_b->seq) ? 1 : -1;
+    return 0;
+}
+
+/**
+ *  Sorts widget elements and rebuilds spans, if widgets were added or
+ *  removed since last build.
+ **/
+static void widget_index_build()
+{
+    WidgetSpan span;
+    guint i;
+
+    if (!widget_index_dirty)
+        return;
+
+    g_array_sort(widget_elems, widget_elem_cmp);
+    g_array_set_size(widget_spans, 0);
+
+    for (i = 0; i < widget_elems->len; i++) {
+        guint32 key = g_array_index(widget_elems, WidgetElem, i).key;
+
+        if (i == 0 || key != span.key) {
+            if (i != 0)
+                g_array_append_val(widget_spans, span);
+            span.key = key;
+            span.first = i;
+            span.n = 0;
+        }
+        span.n++;
+    }
+    if (widget_elems->len > 0)
+        g_array_append_val(widget_spans, span);
+
+    widget_index_dirty = FALSE;
+    debug_msg(DEBUG_GROUP, "Widget index: %d widgets, %d parameters",
+              widget_elems->len, widget_spans->len);
+}
+
+/**
+ *  \param key (position << 16) | id
+ *  \param first return location for index of first WidgetElem
+ *  \param n return location for number of widgets
+ *
+ *  Looks up widgets controlling parameter. Indexes stay valid while
+ *  widgets are only being added, and until next lookup.
+ *
+ *  \return TRUE if there are any widgets controlling parameter.
+ **/
+static gboolean widget_index_lookup(guint32 key, guint *first, guint *n)
+{
+    guint lo = 0, hi;
+
+    widget_index_build();
+
+    hi = widget_spans->len;
+    while (lo < hi) {
+        guint mid = (lo + hi) / 2;
+        WidgetSpan *span = &g_array_index(widget_spans, WidgetSpan, mid);
+
+        if (span->key == key) {
+            *first = span->first;
+            *n = span->n;
+            return TRUE;
+        } else if (span->key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
     }
+
+    *first = 0;
+    *n = 0;
+    return FALSE;
 }
 
 /**
- *  \param widget GObject to add to widget tree
+ *  \param widget GObject to add to widget index
  *  \param id object controlled ID
  *  \param position object controlled position
  *  \param value effect value type (if widget is GtkComboBox, otherwise -1)
  *  \param x combo box item number (if widget is GtkComboBox, otherwise -1)
  *
- *  Adds widget to widget tree.
+ *  Adds widget to widget index.
  **/
-static WidgetTreeElem *widget_tree_add(GObject *widget, gint id, gint position, gint value, gint x)
+static void widget_index_add(GObject *widget, gint id, gint position, gint value, gint x)
 {
-    GList *list;
-    WidgetTreeElem *el;
-    gpointer key;
+    WidgetElem el;
+
+    el.key = (position << 16) | id;
+    el.seq = widget_elem_seq++;
+    el.widget = widget;
+    el.value = value;
+    el.x = x;
+
+    if (value != -1)
+        el.kind = WIDGET_COMBO_BOX;
+    else if (GTK_IS_TOGGLE_BUTTON(widget))
+        el.kind = WIDGET_TOGGLE_BUTTON;
+    else
+        el.kind = WIDGET_ADJUSTMENT;
 
-    el = g_slice_new(WidgetTreeElem);
-    el->widget = widget;
-    el->value = value;
-    el->x = x;
+    g_array_append_val(widget_elems, el);
+    widget_index_dirty = TRUE;
+}
 
-    key = GINT_TO_POINTER((position << 16) | id);
+static void apply_widget_setting(WidgetElem *el, SettingParam *param);
 
-    list = g_tree_lookup(widget_tree, key);
+/**
+ *  \param first index of first WidgetElem to set
+ *
+ *  Sets widgets added to index since first was its length to values
+ *  from edit buffer. Must be called before next lookup.
+ **/
+static void widget_index_apply_edit_buffer(guint first)
+{
+    gboolean old_allow_send = allow_send;
+    SettingParam param;
+    guint i, value;
 
-    if (list == NULL) {
-        list = g_list_append(list, el);
-        g_tree_insert(widget_tree, key, list);
-    } else {
-        list = g_list_append(list, el);
+    allow_send = FALSE;
+    for (i = first; i < widget_elems->len; i++) {
+        /* copy, as setting combo box may build more widgets */
+        WidgetElem el = g_array_index(widget_elems, WidgetElem, i);
+
+        param.id = el.key & 0xFFFF;
+        param.position = el.key >> 16;
+        if (edit_buffer_get_param(param.id, param.position, &value)) {
+            param.value = value;
+            apply_widget_setting(&el, &param);
+        }
+    }
+    allow_send = old_allow_send;
+}
+
+/**
+ *  \param key (position << 16) | id
+ *  \param data_key if not NULL, only widgets having this object data
+ *                  are removed
+ *
+ *  Removes widgets controlling parameter from widget index.
+ **/
+static void widget_index_remove(guint32 key, const gchar *data_key)
+{
+    guint i, j;
+
+    for (i = 0, j = 0; i < widget_elems->len; i++) {
+        WidgetElem *el = &g_array_index(widget_elems, WidgetElem, i);
+
+        if (el->key == key &&
+            (data_key == NULL || g_object_get_data(el->widget, data_key)))
+            continue;
 
-        /* replace the list pointer */
-        g_tree_steal(widget_tree, key);
-        g_tree_insert(widget_tree, key, list);
+        if (i != j)
+            g_array_index(widget_elems, WidgetElem, j) = *el;
+        j++;
     }
 
-    return el;
+    if (j != widget_elems->len) {
+        g_array_set_size(widget_elems, j);
+        widget_index_dirty = TRUE;
+    }
 }
 
 /**
- *  \param el widget tree element
+ *  \param el widget index element
  *  \param param parameter to set
  *
- *  Sets widget tree element value to param value.
+ *  Sets widget index element value to param value.
  **/
-static void apply_widget_setting(WidgetTreeElem *el, SettingParam *param)
-{
-    if (el->value == -1) {
-        if (GTK_IS_TOGGLE_BUTTON(el->widget))
-            gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(el->widget), (param->value == 0) ? FALSE : TRUE);
-        else if (GTK_IS_ADJUSTMENT(el->widget))
-            gtk_adjustment_set_value(GTK_ADJUSTMENT(el->widget), (gdouble)param->value);
-    } else { /* combo box */
+static void apply_widget_setting(WidgetElem *el, SettingParam *param)
+{
+    switch (el->kind) {
+    case WIDGET_TOGGLE_BUTTON:
+        gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(el->widget), (param->value == 0) ? FALSE : TRUE);
+        break;
+    case WIDGET_ADJUSTMENT:
+        gtk_adjustment_set_value(GTK_ADJUSTMENT(el->widget), (gdouble)param->value);
+        break;
+    case WIDGET_COMBO_BOX:
         if (el->value == param->value) {
             gtk_combo_box_set_active(GTK_COMBO_BOX(el->widget), el->x);
         }
+        break;
     }
 }
 
 /**
- *  \param param SettingParam to apply to GUI
+ *  \param params SettingParams to apply to GUI
+ *  \param n number of params
  *
- *  Applies SettingParam to GUI
+ *  Applies SettingParams to GUI. Must be called from main context.
  **/
-void apply_setting_param_to_gui(SettingParam *param)
+void apply_setting_params_to_gui(SettingParam *params, guint n)
 {
-    gpointer key;
-    g_return_if_fail(param != NULL);
+    guint i, j, first, amt;
+
+    /* parameters may arrive before GUI is created */
+    if (widget_elems == NULL)
+        return;
 
     allow_send = FALSE;
-    key = GINT_TO_POINTER((param->position << 16) | param->id);
-    GList *list = g_tree_lookup(widget_tree, key);
-    g_list_foreach(list, (GFunc)apply_widget_setting, param);
+    for (i = 0; i < n; i++) {
+        widget_index_lookup((params[i].position << 16) | params[i].id,
+                            &first, &amt);
+        for (j = first; j < first + amt; j++) {
+            /* copy, as setting combo box may build more widgets */
+            WidgetElem el = g_array_index(widget_elems, WidgetElem, j);
+            apply_widget_setting(&el, &params[i]);
+        }
+    }
     allow_send = TRUE;
 }
 
 /**
  *  \param preset preset to sync
  *
- *  Synces GUI with preset.
+ *  Synces GUI with preset. Preset params and widget spans are both
+ *  sorted by position and ID, so they are walked side by side.
  **/
 static void apply_preset_to_gui(Preset *preset)
 {
+    gint64 start = g_get_monotonic_time();
+    guint i, j, first, span = 0;
+
     g_return_if_fail(preset != NULL);
-    g_return_if_fail(widget_tree != NULL);
+    g_return_if_fail(widget_elems != NULL);
+
+    widget_index_build();
+    first = widget_elems->len;
 
     allow_send = FALSE;
 
-    GList *iter = preset->params;
-    while (iter) {
-        gpointer key;
+    for (i = 0; i < preset->params->len; i++) {
+        SettingParam *param = &g_array_index(preset->params, SettingParam, i);
+        guint32 key = (param->position << 16) | param->id;
+        WidgetSpan *s;
 
-        SettingParam *param = iter->data;
-        iter = iter->next;
+        while (span < widget_spans->len &&
+               g_array_index(widget_spans, WidgetSpan, span).key < key)
+            span++;
+        if (span == widget_spans->len)
+            break;
+
+        s = &g_array_index(widget_spans, WidgetSpan, span);
+        if (s->key != key)
+            continue;
 
-        if (param != NULL) {
-            key = GINT_TO_POINTER((param->position << 16) | param->id);
-            GList *list = g_tree_lookup(widget_tree, key);
-            g_list_foreach(list, (GFunc)apply_widget_setting, param);
+        for (j = s->first; j < s->first + s->n; j++) {
+            WidgetElem el = g_array_index(widget_elems, WidgetElem, j);
+            apply_widget_setting(&el, param);
         }
     }
 
+    /*
+     * Settings grids of newly selected effect types were built meanwhile
+     * and set from edit buffer, which may not hold this preset.
+     */
+    for (i = first; i < widget_elems->len; i++) {
+        WidgetElem el = g_array_index(widget_elems, WidgetElem, i);
+        SettingParam *param, key;
+
+        key.id = el.key & 0xFFFF;
+        key.position = el.key >> 16;
+        param = bsearch(&key, preset->params->data, preset->params->len,
+                        sizeof(SettingParam), params_cmp);
+        if (param != NULL)
+            apply_widget_setting(&el, param);
+    }
+
     allow_send = TRUE;
+
+    debug_msg(DEBUG_STATS, "Applied %d parameters to GUI in %.2f ms",
+              preset->params->len,
+              (g_get_monotonic_time() - start) / 1000.0);
 }
 
+/** how long to wait for edit buffer, in ms */
+#define CURRENT_PRESET_TIMEOUT 30000
+
 /**
- *  Synces GUI with device current edit buffer.
+ *  \param preset current edit buffer, or NULL if device didn't reply;
+ *                freed once callback returns
+ *  \param data user data passed to read_current_preset()
  **/
-static void apply_current_preset()
+typedef void (*CurrentPresetFunc)(Preset *preset, gpointer data);
+
+/** pending REQUEST_PRESET issued by read_current_preset() */
+typedef struct {
+    CurrentPresetFunc callback;
+    gpointer data;
+} CurrentPresetRequest;
+
+/**
+ *  \param request finished REQUEST_PRESET request
+ *  \param data CurrentPresetRequest
+ *
+ *  Records received edit buffer as local edit buffer copy, then hands
+ *  it to requester.
+ **/
+static void current_preset_received_cb(DeviceRequest *request, gpointer data)
 {
-    GList *list = get_current_preset();
-    Preset *preset = create_preset_from_data(list);
-    message_list_free(list);
+    CurrentPresetRequest *current = data;
+    Preset *preset = NULL;
+
+    if (device_request_get_status(request) == REQUEST_DONE) {
+        GList *list = device_request_steal_reply(request);
+
+        preset = create_preset_from_data(list);
+        message_list_free(list);
+
+        if (verify_edit_buffer) {
+            edit_buffer_verify(preset);
+        } else {
+            edit_buffer_set_preset(preset);
+        }
+    }
+
+    current->callback(preset, current->data);
+
+    if (preset != NULL) {
+        preset_free(preset);
+    }
+    g_slice_free(CurrentPresetRequest, current);
+}
+
+/**
+ *  \param callback function to call once edit buffer has been read
+ *  \param data data to pass to callback
+ *
+ *  Requests current edit buffer from device, without waiting for it.
+ **/
+static void read_current_preset(CurrentPresetFunc callback, gpointer data)
+{
+    CurrentPresetRequest *current = g_slice_new(CurrentPresetRequest);
+
+    current->callback = callback;
+    current->data = data;
+
+    device_request_send(REQUEST_PRESET, "\x04\x00", 2,
+                        RECEIVE_PRESET_START, CURRENT_PRESET_TIMEOUT,
+                        current_preset_received_cb, current);
+}
+
+/**
+ *  \param preset current edit buffer, or NULL
+ *  \param data unused
+ *
+ *  Applies edit buffer read from device to GUI.
+ **/
+static void current_preset_apply_cb(Preset *preset, gpointer data)
+{
+    if (preset == NULL) {
+        g_warning("Failed to read current preset from device");
+        return;
+    }
+
     apply_preset_to_gui(preset);
-    preset_free(preset);
+}
+
+/**
+ *  \param preset current edit buffer, or NULL
+ *  \param data unused
+ *
+ *  Applies edit buffer read at startup to GUI.
+ **/
+static void startup_preset_apply_cb(Preset *preset, gpointer data)
+{
+    profile_async_end("Current preset");
+    current_preset_apply_cb(preset, data);
+}
+
+/**
+ *  Synces GUI with device current edit buffer once it arrives.
+ **/
+static void apply_current_preset()
+{
+    read_current_preset(current_preset_apply_cb, NULL);
 }
 
 gboolean apply_current_preset_to_gui(gpointer data)
@@ -450,47 +757,10 @@ gboolean apply_current_preset_to_gui(gpointer data)
 void modifier_settings_exp_free(EffectSettings *settings)
 {
     guint i;
-    guint id = settings->id;
-    guint pos = settings->position;
-    gpointer key;
-    GList *link, *next, *orig_list;
-    WidgetTreeElem *el;
-    GObject *widget;
 
     for (i = 0; i < 2; i++) {
-
-        id = settings[i].id;
-        pos = settings[i].position;
-        key = GINT_TO_POINTER(pos <<16| id);
-        orig_list = g_tree_lookup(widget_tree, key);
-        if (!orig_list) {
-            continue;
-        }
-
-        link = g_list_first(orig_list);
-        while (link != NULL) {
-            next = link->next;
-
-            el = link->data;
-            if (el) {
-
-                widget = el->widget;
-                if (g_object_get_data(G_OBJECT(widget), "exp")) {
-                    g_slice_free(WidgetTreeElem, el);
-                    link->data = NULL;
-                }
-            }
-            link = next;
-        }
-        
-        /* Remove all the list elements from which we freed data. */
-        orig_list = g_list_remove_all(orig_list, NULL);
-
-        /* The list should be empty at this point. */
-        g_assert(!orig_list);
-
-        /* Removed them all, so remove the key from the tree.*/
-        g_tree_steal(widget_tree, key);
+        widget_index_remove((settings[i].position << 16) | settings[i].id,
+                            "exp");
     }
 }
 /**
@@ -540,7 +810,7 @@ GtkWidget *create_grid(EffectSettings *settings, gint amt, GHashTable *widget_ta
             g_signal_connect(G_OBJECT(widget), "output", G_CALLBACK(custom_value_output_cb), settings[x].values);
         }
 
-        widget_tree_add(G_OBJECT(adj), settings[x].id,
+        widget_index_add(G_OBJECT(adj), settings[x].id,
                         settings[x].position, -1, -1);
 
         if (settings[x].position == EXP_POSITION) {
@@ -578,7 +848,7 @@ GtkWidget *create_on_off_button(Effect *effect)
         button = gtk_check_button_new_with_label(effect->label);
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(button), FALSE);
     g_signal_connect(G_OBJECT(button), "toggled", G_CALLBACK(toggled_cb), effect);
-    widget_tree_add(G_OBJECT(button), effect->id, effect->position, -1, -1);
+    widget_index_add(G_OBJECT(button), effect->id, effect->position, -1, -1);
     return button;
 }
 
@@ -586,7 +856,9 @@ typedef struct {
     gint type;             /**< effect group type (value) */
     gint id;               /**< option ID */
     gint position;         /**< position */
-    GtkWidget *child;      /**< child widget */
+    GtkWidget *child;      /**< child widget, or NULL until first selected */
+    EffectSettings *settings; /**< settings shown in child */
+    gint settings_amt;     /**< amount of settings */
 } EffectSettingsGroup;
 
 /**
@@ -633,6 +905,20 @@ void combo_box_changed_cb(GtkComboBox *widget, gpointer data)
         settings = g_object_get_data(G_OBJECT(widget), name);
         g_free(name);
 
+        if (settings != NULL && settings->child == NULL &&
+            settings->settings_amt > 0) {
+            /* build settings grid when type is selected for the first time */
+            GHashTable *widget_table = g_object_get_data(G_OBJECT(widget),
+                                                         "widget_table");
+            guint first = widget_elems->len;
+
+            settings->child = create_grid(settings->settings,
+                                          settings->settings_amt,
+                                          widget_table);
+            g_object_ref_sink(settings->child);
+            widget_index_apply_edit_buffer(first);
+        }
+
         child = g_object_get_data(G_OBJECT(widget), "active_child");
         if (settings != NULL)
         {
@@ -695,26 +981,20 @@ GtkWidget *create_widget_container(EffectGroup *group, gint amt, gint id, gint p
             gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo_box), group[x].label);
             cmbox_no++;
 
-            if ((group[x].settings != NULL) && (group[x].settings_amt > 0)) {
-                /*
-                 * Create a grid for each combo box entry to contain per
-                 * combo box entry settings.
-                 */
-                widget = create_grid(group[x].settings,
-                                     group[x].settings_amt,
-                                     widget_table);
-                g_object_ref_sink(widget);
-            } else {
-                widget = NULL;
-            }
-
+            /*
+             * Grid containing per combo box entry settings is created
+             * by combo_box_changed_cb() when entry is first selected.
+             */
             settings = g_slice_new(EffectSettingsGroup);
             settings->id = id;
             settings->type = group[x].type;
             settings->position = position;
-            settings->child = widget;
+            settings->child = NULL;
+            settings->settings = group[x].settings;
+            settings->settings_amt = (group[x].settings != NULL) ?
+                                     group[x].settings_amt : 0;
 
-            widget_tree_add(G_OBJECT(combo_box), id, position, group[x].type, x);
+            widget_index_add(G_OBJECT(combo_box), id, position, group[x].type, x);
 
             name = g_strdup_printf("SettingsGroup%d", cmbox_no);
             g_object_set_data_full(G_OBJECT(combo_box),
@@ -731,7 +1011,14 @@ GtkWidget *create_widget_container(EffectGroup *group, gint amt, gint id, gint p
         }
     }
 
-    g_hash_table_destroy(widget_table);
+    if (combo_box != NULL) {
+        /* grids of entries sharing settings are shared too */
+        g_object_set_data_full(G_OBJECT(combo_box), "widget_table",
+                               widget_table,
+                               (GDestroyNotify) g_hash_table_destroy);
+    } else {
+        g_hash_table_destroy(widget_table);
+    }
 
     return vbox;
 }
@@ -763,6 +1050,8 @@ static void update_modifier_vbox(GtkWidget *vbox, GObject *combo_box, gint id, g
         settings->id = id;
         settings->type = group[x].type;
         settings->position = position;
+        settings->settings = NULL;
+        settings->settings_amt = 0;
 
         if (position == EXP_POSITION) {
             child = g_object_steal_data(G_OBJECT(combo_box), "active_child");
@@ -780,7 +1069,7 @@ static void update_modifier_vbox(GtkWidget *vbox, GObject *combo_box, gint id, g
         g_free(name);
 
         gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo_box), group[x].label);
-        widget_tree_add(combo_box, id, position, group[x].type, x);
+        widget_index_add(combo_box, id, position, group[x].type, x);
     }
 
     g_hash_table_destroy(widget_table);
@@ -788,29 +1077,19 @@ static void update_modifier_vbox(GtkWidget *vbox, GObject *combo_box, gint id, g
     return;
 }
 
-static void clean_modifier_combo_box(GObject *combo_box, GList *list)
+static void clean_modifier_combo_box(GObject *combo_box, WidgetElem *elems, guint n)
 {
     EffectSettingsGroup *settings = NULL;
-    WidgetTreeElem *el;
     gchar *name;
-    GList *link, *next, *stale_link;
-
-    link = g_list_first(list);
-
-    while (link != NULL) {
-        next = link->next;
-        el = link->data;
-        stale_link = NULL;
+    guint i;
 
+    for (i = 0; i < n; i++) {
         /* We need to clean the data associated with a combo box.
          * This may include the per-entry settings widgets.
          */
-        if (el->value != -1) {
+        if (elems[i].kind == WIDGET_COMBO_BOX) {
             /* This is a combo box entry. Remove the associated data. */
-            stale_link = link;
-            link = g_list_remove_link(list, link);
-            
-            name = g_strdup_printf("SettingsGroup%d", el->x);
+            name = g_strdup_printf("SettingsGroup%d", elems[i].x);
             settings = g_object_steal_data(G_OBJECT(combo_box), name);
             if (settings && settings->child) {
                 gtk_widget_destroy(settings->child);
@@ -818,14 +1097,7 @@ static void clean_modifier_combo_box(GObject *combo_box, GList *list)
 
             g_slice_free(EffectSettingsGroup, settings);
             g_free(name);
-            g_slice_free(WidgetTreeElem, el);
-        }
-
-        if (stale_link) {
-            g_list_free_1(stale_link);
         }
-
-        link = next;
     }
     gtk_combo_box_text_remove_all(GTK_COMBO_BOX_TEXT(combo_box));
 }
@@ -841,40 +1113,33 @@ create_modifier_group (guint pos, guint id)
 {
     
     GtkWidget *vbox;
-    gpointer key;
-    WidgetTreeElem *el;
-    GList *list;
+    guint32 key;
+    WidgetElem *elems;
+    guint first, n;
     GObject *modifier_combo_box;
 
     debug_msg(DEBUG_GROUP, "Building modifier group for position %d id %d \"%s\"",
                            pos, id, get_xml_settings(id, pos)->label);
 
-    key = GINT_TO_POINTER((pos << 16) | id);
-    list = g_tree_lookup(widget_tree, key);
-
-    /* 
-     * The list will be destroyed and recreated, but we don't want to 
-     * handle the teardown ourselves. So steal it from the tree.
-     */
-    g_tree_steal(widget_tree, key);
-    if (!list) {
-        return;
-    }
-
-    el = g_list_nth_data(list, 0);
-    if (!el) {
-        g_warning("No effect settings group for position %d id %d!\n",
-                   pos, id);
+    key = (pos << 16) | id;
+    if (!widget_index_lookup(key, &first, &n)) {
         return;
     }
+    elems = &g_array_index(widget_elems, WidgetElem, first);
 
-    modifier_combo_box = el->widget;
+    modifier_combo_box = elems[0].widget;
     g_assert(modifier_combo_box != NULL);
 
     vbox = g_object_get_data(modifier_combo_box, "vbox");
     g_assert(vbox != NULL);
 
-    clean_modifier_combo_box(modifier_combo_box, list);
+    clean_modifier_combo_box(modifier_combo_box, elems, n);
+
+    /* 
+     * The entries will be recreated by update_modifier_vbox(), so
+     * remove the old ones from the index.
+     */
+    widget_index_remove(key, NULL);
 
     update_modifier_vbox(vbox, modifier_combo_box, id, pos);
 
@@ -951,6 +1216,87 @@ GtkWidget *create_vbox(Effect *widgets, gint amt, gchar *label)
     return frame;
 }
 
+/** modifier groups rebuilt whenever modifier linkable list changes */
+static const struct {
+    guint position;
+    guint id;
+} modifier_groups[] = {
+    {EXP_POSITION, EXP_ASSIGN1},
+    {LFO1_POSITION, LFO_TYPE},
+    {LFO2_POSITION, LFO_TYPE},
+};
+
+/**
+ *  \param vbox notebook page
+ *
+ *  Creates effect widgets of page, unless they were already created,
+ *  and sets them to values from edit buffer.
+ **/
+static void build_page(GtkWidget *vbox)
+{
+    EffectPage *page = g_object_steal_data(G_OBJECT(vbox), "page");
+    gboolean had_modifier[G_N_ELEMENTS(modifier_groups)];
+    GtkWidget *hbox = NULL;
+    GtkWidget *widget;
+    gint64 start;
+    guint first, n, i;
+    gint x;
+
+    if (page == NULL)
+        return;
+
+    start = g_get_monotonic_time();
+    profile_begin("Build page %s", page->name);
+
+    for (i = 0; i < G_N_ELEMENTS(modifier_groups); i++) {
+        had_modifier[i] = widget_index_lookup((modifier_groups[i].position << 16) |
+                                              modifier_groups[i].id, &first, &n);
+    }
+
+    first = widget_elems->len;
+
+    for (x = 0; x<page->n_effects; x++) {
+        if ((x % ((page->n_effects+1)/page->n_rows)) == 0) {
+            hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+            gtk_box_pack_start(GTK_BOX(vbox), hbox, TRUE, TRUE, 2);
+        }
+        widget = create_vbox(page->effects[x].effect, page->effects[x].amt, page->effects[x].label);
+        gtk_box_pack_start(GTK_BOX(hbox), widget, TRUE, TRUE, 2);
+    }
+
+    gtk_widget_show_all(vbox);
+    widget_index_apply_edit_buffer(first);
+    profile_end();
+
+    debug_msg(DEBUG_STATS, "Page \"%s\" created in %.1f ms, %d widgets",
+              page->name, (g_get_monotonic_time() - start) / 1000.0,
+              widget_elems->len - first);
+
+    /* modifier groups on page must match current modifier linkable list */
+    if (get_modifier_amt() > 0) {
+        for (i = 0; i < G_N_ELEMENTS(modifier_groups); i++) {
+            if (!had_modifier[i]) {
+                create_modifier_group(modifier_groups[i].position,
+                                      modifier_groups[i].id);
+            }
+        }
+    }
+}
+
+/**
+ *  \param notebook the object which emitted the signal
+ *  \param page page being switched to
+ *  \param page_num index of page
+ *  \param data user data (unused, can be anything)
+ *
+ *  Creates page contents when page is shown for the first time.
+ **/
+static void notebook_switch_page_cb(GtkNotebook *notebook, GtkWidget *page,
+                                    guint page_num, gpointer data)
+{
+    build_page(page);
+}
+
 enum {
   PRESET_NAME_COLUMN = 0,
   PRESET_NUMBER_COLUMN,
@@ -958,6 +1304,26 @@ enum {
   NUM_COLUMNS
 };
 
+/**
+ *  \param preset current edit buffer, or NULL
+ *  \param data bank and index of preset switched to, as (bank << 8) | index
+ *
+ *  Caches freshly loaded edit buffer, which holds stored preset, and
+ *  applies it to GUI.
+ **/
+static void switched_preset_received_cb(Preset *preset, gpointer data)
+{
+    gint slot = GPOINTER_TO_INT(data);
+
+    if (preset == NULL) {
+        g_warning("Failed to read current preset from device");
+        return;
+    }
+
+    cache_set_preset(slot >> 8, slot & 0xFF, preset);
+    apply_preset_to_gui(preset);
+}
+
 /**
  *  \param treeview the object which emitted the signal
  *  \param path the GtkTreePath for the activated row
@@ -976,37 +1342,331 @@ void row_activate_cb(GtkTreeView *treeview, GtkTreePath *path, GtkTreeViewColumn
 
     if ((bank != -1) && (id != -1)) {
         switch_preset(bank, id);
-        apply_current_preset();
+        read_current_preset(switched_preset_received_cb,
+                            GINT_TO_POINTER((bank << 8) | id));
     }
 }
 
+enum {
+    COMPARE_PARAM_COLUMN,
+    COMPARE_CURRENT_COLUMN,
+    COMPARE_STORED_COLUMN,
+    COMPARE_NUM_COLUMNS
+};
+
 /**
- *  \param model model to fill
+ *  \param id parameter ID
+ *  \param position parameter position
+ *  \param present whether parameter is present in preset
+ *  \param value parameter value
+ *
+ *  \return parameter value formatted for display, must be freed using g_free.
+ **/
+static gchar *format_compare_value(guint id, guint position,
+                                   gboolean present, guint value)
+{
+    XmlSettings *xml;
+    GString *buf;
+
+    if (!present) {
+        return g_strdup("-");
+    }
+
+    xml = get_xml_settings(id, position);
+    if (xml == NULL) {
+        return g_strdup_printf("%d", value);
+    }
+
+    buf = format_value(xml, value);
+    return g_string_free(buf, FALSE);
+}
+
+/**
+ *  \param window application toplevel window
+ *  \param current current edit buffer
+ *  \param stored preset stored in library
+ *
+ *  Shows parameters in which preset stored in library differs from
+ *  current edit buffer.
+ **/
+static void show_compare_dialog(GtkWidget *window, Preset *current,
+                                Preset *stored)
+{
+    GtkWidget *dialog, *sw, *treeview, *vbox;
+    GtkListStore *store;
+    GtkTreeIter iter;
+    GtkCellRenderer *renderer;
+    GArray *diffs;
+    guint i;
+
+    store = gtk_list_store_new(COMPARE_NUM_COLUMNS,
+                               G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+
+    if (g_strcmp0(current->name, stored->name) != 0) {
+        gtk_list_store_append(store, &iter);
+        gtk_list_store_set(store, &iter,
+                           COMPARE_PARAM_COLUMN, "Name",
+                           COMPARE_CURRENT_COLUMN, current->name,
+                           COMPARE_STORED_COLUMN, stored->name,
+                           -1);
+    }
+
+    diffs = preset_diff(current, stored);
+    for (i = 0; i < diffs->len; i++) {
+        ParamDiff *diff = &g_array_index(diffs, ParamDiff, i);
+        XmlSettings *xml = get_xml_settings(diff->id, diff->position);
+        gchar *label, *value_a, *value_b;
+
+        if (xml != NULL) {
+            label = g_strdup_printf("%s %s", get_position(diff->position),
+                                    xml->label);
+        } else {
+            label = g_strdup_printf("ID %d position %d",
+                                    diff->id, diff->position);
+        }
+        value_a = format_compare_value(diff->id, diff->position,
+                                       diff->in_a, diff->value_a);
+        value_b = format_compare_value(diff->id, diff->position,
+                                       diff->in_b, diff->value_b);
+
+        gtk_list_store_append(store, &iter);
+        gtk_list_store_set(store, &iter,
+                           COMPARE_PARAM_COLUMN, label,
+                           COMPARE_CURRENT_COLUMN, value_a,
+                           COMPARE_STORED_COLUMN, value_b,
+                           -1);
+
+        g_free(label);
+        g_free(value_a);
+        g_free(value_b);
+    }
+    g_array_free(diffs, TRUE);
+
+    dialog = gtk_dialog_new_with_buttons("Compare with library",
+                                         GTK_WINDOW(window),
+                                         GTK_DIALOG_DESTROY_WITH_PARENT,
+                                         GTK_STOCK_CLOSE, GTK_RESPONSE_CLOSE,
+                                         NULL);
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 480, 360);
+
+    vbox = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+
+    if (gtk_tree_model_iter_n_children(GTK_TREE_MODEL(store), NULL) == 0) {
+        gtk_box_pack_start(GTK_BOX(vbox),
+                           gtk_label_new("Edit buffer matches stored preset"),
+                           TRUE, TRUE, 6);
+    } else {
+        sw = gtk_scrolled_window_new(NULL, NULL);
+        gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(sw),
+                                       GTK_POLICY_AUTOMATIC,
+                                       GTK_POLICY_AUTOMATIC);
+        gtk_box_pack_start(GTK_BOX(vbox), sw, TRUE, TRUE, 0);
+
+        treeview = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
+        renderer = gtk_cell_renderer_text_new();
+        gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(treeview),
+                                                    -1, "Parameter",
+                                                    renderer, "text",
+                                                    COMPARE_PARAM_COLUMN, NULL);
+        gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(treeview),
+                                                    -1, "Edit buffer",
+                                                    renderer, "text",
+                                                    COMPARE_CURRENT_COLUMN, NULL);
+        gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(treeview),
+                                                    -1, "Library",
+                                                    renderer, "text",
+                                                    COMPARE_STORED_COLUMN, NULL);
+        gtk_container_add(GTK_CONTAINER(sw), treeview);
+    }
+    g_object_unref(store);
+
+    gtk_widget_show_all(vbox);
+    (void)gtk_dialog_run(GTK_DIALOG(dialog));
+    gtk_widget_destroy(dialog);
+}
+
+/** comparison waiting for edit buffer, see show_compare_window() */
+typedef struct {
+    GtkWidget *window;
+    Preset *stored;
+} CompareRequest;
+
+/**
+ *  \param preset current edit buffer, or NULL
+ *  \param data CompareRequest
+ *
+ *  Compares edit buffer read from device with stored preset.
+ **/
+static void compare_preset_received_cb(Preset *preset, gpointer data)
+{
+    CompareRequest *compare = data;
+
+    if (preset == NULL) {
+        show_error_message(compare->window,
+                           "Failed to read current preset from device");
+    } else {
+        show_compare_dialog(compare->window, preset, compare->stored);
+    }
+
+    preset_free(compare->stored);
+    g_slice_free(CompareRequest, compare);
+}
+
+/**
+ *  \param window application toplevel window
  *  \param bank preset bank
- *  \param name preset bank description visible to user
+ *  \param index preset index
+ *
+ *  Compares preset stored in library with current edit buffer. If there
+ *  is no local edit buffer copy, it is read from device first.
+ **/
+static void show_compare_window(GtkWidget *window, gint bank, gint index)
+{
+    CompareRequest *compare;
+    Preset *stored, *current;
+
+    stored = cache_get_preset(bank, index);
+    if (stored == NULL) {
+        show_error_message(window,
+                           "Preset is not in library, use Sync Library first");
+        return;
+    }
+
+    current = edit_buffer_get_preset();
+    if (current != NULL) {
+        show_compare_dialog(window, current, stored);
+        preset_free(current);
+        preset_free(stored);
+        return;
+    }
+
+    compare = g_slice_new(CompareRequest);
+    compare->window = window;
+    compare->stored = stored;
+    read_current_preset(compare_preset_received_cb, compare);
+}
+
+/**
+ *  \param item the menu item which was activated
+ *  \param treeview preset treeview
  *
- *  Appends to model preset names found in device preset bank.
+ *  Compares edit buffer with preset selected in treeview.
  **/
-static void fill_store_with_presets(GtkTreeStore *model, guint bank, gchar *name)
+static void compare_activate_cb(GtkMenuItem *item, GtkTreeView *treeview)
 {
+    GtkTreeSelection *selection;
+    GtkTreeModel *model;
     GtkTreeIter iter;
+    gint id;
+    gint bank;
+
+    selection = gtk_tree_view_get_selection(treeview);
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        return;
+    }
+
+    gtk_tree_model_get(model, &iter, PRESET_NUMBER_COLUMN, &id, PRESET_BANK_COLUMN, &bank, -1);
+    if ((bank != -1) && (id != -1)) {
+        show_compare_window(gtk_widget_get_toplevel(GTK_WIDGET(treeview)),
+                           bank, id);
+    }
+}
+
+/**
+ *  \param treeview the object which received the signal
+ *  \param event the GdkEventButton which triggered this signal
+ *  \param data unused
+ *
+ *  Shows preset context menu on right click.
+ *
+ *  \return TRUE if event was handled, otherwise FALSE.
+ **/
+static gboolean preset_tree_button_press_cb(GtkWidget *treeview,
+                                            GdkEventButton *event,
+                                            gpointer data)
+{
+    GtkTreePath *path;
+    GtkWidget *menu, *item;
+
+    if (event->type != GDK_BUTTON_PRESS || event->button != 3) {
+        return FALSE;
+    }
+
+    if (!gtk_tree_view_get_path_at_pos(GTK_TREE_VIEW(treeview),
+                                       event->x, event->y,
+                                       &path, NULL, NULL, NULL)) {
+        return FALSE;
+    }
+
+    gtk_tree_selection_select_path(
+        gtk_tree_view_get_selection(GTK_TREE_VIEW(treeview)), path);
+    gtk_tree_path_free(path);
+
+    menu = gtk_menu_new();
+    item = gtk_menu_item_new_with_label("Compare with Edit Buffer");
+    g_signal_connect(G_OBJECT(item), "activate",
+                     G_CALLBACK(compare_activate_cb), treeview);
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), item);
+    gtk_widget_show_all(menu);
+
+    /* menu is destroyed once hidden */
+    g_signal_connect(G_OBJECT(menu), "selection-done",
+                     G_CALLBACK(gtk_widget_destroy), NULL);
+    gtk_menu_popup(GTK_MENU(menu), NULL, NULL, NULL, NULL,
+                   event->button, event->time);
+
+    return TRUE;
+}
+
+/** how long to wait for each bank's preset names, in ms */
+#define PRESET_NAMES_TIMEOUT 2000
+
+/**
+ *  \param model model holding preset names
+ *  \param bank preset bank
+ *  \param iter return location for bank row
+ *
+ *  \return TRUE if bank row was found, otherwise FALSE.
+ **/
+static gboolean find_bank_row(GtkTreeModel *model, guint bank,
+                              GtkTreeIter *iter)
+{
+    gint row_bank;
+
+    if (!gtk_tree_model_get_iter_first(model, iter))
+        return FALSE;
+
+    do {
+        gtk_tree_model_get(model, iter, PRESET_BANK_COLUMN, &row_bank, -1);
+        if (row_bank == bank)
+            return TRUE;
+    } while (gtk_tree_model_iter_next(model, iter));
+
+    return FALSE;
+}
+
+/**
+ *  \param model model to fill
+ *  \param iter bank row
+ *  \param bank preset bank
+ *  \param names preset names
+ *
+ *  Replaces children of bank row with preset names.
+ **/
+static void fill_bank_with_presets(GtkTreeStore *model, GtkTreeIter *iter,
+                                   guint bank, GStrv names)
+{
     GtkTreeIter child_iter;
+    gint n_old;
     int x;
 
-    GStrv presets = query_preset_names(bank);
-    g_return_if_fail(presets != NULL);
-
-    gtk_tree_store_append(model, &iter, NULL);
-    gtk_tree_store_set(model, &iter,
-                       PRESET_NAME_COLUMN, name,
-                       PRESET_NUMBER_COLUMN, -1,
-                       PRESET_BANK_COLUMN, -1,
-                       -1);
+    /* append new rows before removing old ones, so bank stays expanded */
+    n_old = gtk_tree_model_iter_n_children(GTK_TREE_MODEL(model), iter);
 
-    for (x=0; x<g_strv_length(presets); x++) {
-        gchar *tmp = g_strdup_printf("%d - %s", x+1, presets[x]);
+    for (x=0; names[x] != NULL; x++) {
+        gchar *tmp = g_strdup_printf("%d - %s", x+1, names[x]);
 
-        gtk_tree_store_append(model, &child_iter, &iter);
+        gtk_tree_store_append(model, &child_iter, iter);
         gtk_tree_store_set(model, &child_iter,
                            PRESET_NAME_COLUMN, tmp,
                            PRESET_NUMBER_COLUMN, x,
@@ -1015,25 +1675,147 @@ static void fill_store_with_presets(GtkTreeStore *model, guint bank, gchar *name
 
         g_free(tmp);
     }
-    g_strfreev(presets);
+
+    while (n_old-- > 0 &&
+           gtk_tree_model_iter_children(GTK_TREE_MODEL(model),
+                                        &child_iter, iter)) {
+        gtk_tree_store_remove(model, &child_iter);
+    }
 }
 
 /**
  *  \param model model to fill
+ *  \param reply RECEIVE_PRESET_NAMES message
  *
- *  Fills model with preset names found on device.
+ *  Updates bank the reply belongs to with received preset names.
+ *  The bank is taken from the reply, as a reply requested again after
+ *  corruption arrives after replies to later requests.
+ **/
+static void update_bank_from_reply(GtkTreeStore *model, GString *reply)
+{
+    GtkTreeIter iter;
+    NameIter names;
+    GPtrArray *received;
+    const gchar *name;
+
+    if (!name_iter_init(&names, reply)) {
+        g_warning("Invalid preset names reply");
+        return;
+    }
+
+    if (!find_bank_row(GTK_TREE_MODEL(model), names.bank, &iter)) {
+        g_warning("Received preset names of unknown bank %d", names.bank);
+        return;
+    }
+
+    received = g_ptr_array_sized_new(names.left + 1);
+    while ((name = name_iter_next(&names)) != NULL)
+        g_ptr_array_add(received, (gpointer) name);
+    g_ptr_array_add(received, NULL);
+
+    /* rows rendered from cache are only replaced if names changed */
+    if (cache_set_preset_names(names.bank,
+                               (const gchar * const *) received->pdata)) {
+        fill_bank_with_presets(model, &iter, names.bank,
+                               (GStrv) received->pdata);
+    }
+
+    g_ptr_array_free(received, TRUE);
+}
+
+/** pending REQUEST_PRESET_NAMES issued by fill_store() */
+typedef struct {
+    GtkTreeStore *model;
+    guint bank;
+} PresetNamesRequest;
+
+/**
+ *  \param request finished REQUEST_PRESET_NAMES request
+ *  \param data PresetNamesRequest
+ *
+ *  Fills bank with received preset names, or marks bank as unavailable
+ *  if no reply came.
+ **/
+static void preset_names_received_cb(DeviceRequest *request, gpointer data)
+{
+    PresetNamesRequest *names = data;
+    GtkTreeModel *model = GTK_TREE_MODEL(names->model);
+    GtkTreeIter iter, child_iter;
+    gint number;
+
+    profile_async_end("Preset names, bank %d", names->bank);
+
+    if (device_request_get_status(request) == REQUEST_DONE) {
+        GString *reply = device_request_steal_reply(request);
+
+        update_bank_from_reply(names->model, reply);
+        g_string_free(reply, TRUE);
+    } else if (find_bank_row(model, names->bank, &iter) &&
+               gtk_tree_model_iter_children(model, &child_iter, &iter)) {
+        gtk_tree_model_get(model, &child_iter,
+                           PRESET_NUMBER_COLUMN, &number, -1);
+        if (number == -1) {
+            gtk_tree_store_set(names->model, &child_iter,
+                               PRESET_NAME_COLUMN, "Not available", -1);
+        }
+    }
+
+    g_object_unref(names->model);
+    g_slice_free(PresetNamesRequest, names);
+}
+
+/**
+ *  \param model model to fill
+ *
+ *  Adds row for every device preset bank, holding cached preset names
+ *  or a placeholder child, then requests preset names of all banks at
+ *  once. Banks are updated by preset_names_received_cb() as replies
+ *  arrive.
  **/
 static void fill_store(GtkTreeStore *model)
 {
     Device *device = g_object_get_data(G_OBJECT(model), "device");
+    GtkTreeIter iter;
+    GtkTreeIter child_iter;
 
     g_return_if_fail(device != NULL);
 
     gint i;
-    for (i=0; i<device->n_banks; i++)
-        fill_store_with_presets(model,
-                                device->banks[i].bank,
-                                device->banks[i].name);
+    for (i=0; i<device->n_banks; i++) {
+        gchar bank = device->banks[i].bank;
+
+        gtk_tree_store_append(model, &iter, NULL);
+        gtk_tree_store_set(model, &iter,
+                           PRESET_NAME_COLUMN, device->banks[i].name,
+                           PRESET_NUMBER_COLUMN, -1,
+                           PRESET_BANK_COLUMN, device->banks[i].bank,
+                           -1);
+
+        GStrv cached = cache_get_preset_names(device->banks[i].bank);
+        if (cached != NULL) {
+            fill_bank_with_presets(model, &iter, device->banks[i].bank,
+                                   cached);
+            g_strfreev(cached);
+        } else {
+            gtk_tree_store_append(model, &child_iter, &iter);
+            gtk_tree_store_set(model, &child_iter,
+                               PRESET_NAME_COLUMN, "Loading...",
+                               PRESET_NUMBER_COLUMN, -1,
+                               PRESET_BANK_COLUMN, -1,
+                               -1);
+        }
+
+        PresetNamesRequest *names = g_slice_new(PresetNamesRequest);
+        names->model = g_object_ref(model);
+        names->bank = device->banks[i].bank;
+
+        /* replies come in order, so each one waits for those before it */
+        profile_async_begin("Preset names, bank %d", names->bank);
+        device_request_send(REQUEST_PRESET_NAMES, &bank, 1,
+                            RECEIVE_PRESET_NAMES,
+                            PRESET_NAMES_TIMEOUT * (i + 1),
+                            preset_names_received_cb, names);
+    }
 }
 
 /**
@@ -1065,20 +1847,22 @@ GtkWidget *create_preset_tree(Device *device)
     g_object_set(G_OBJECT(treeview), "headers-visible", FALSE, NULL);
     g_signal_connect(G_OBJECT(treeview), "realize", G_CALLBACK(gtk_tree_view_expand_all), NULL);
     g_signal_connect(G_OBJECT(treeview), "row-activated", G_CALLBACK(row_activate_cb), GTK_TREE_MODEL(store));
+    g_signal_connect(G_OBJECT(treeview), "button-press-event", G_CALLBACK(preset_tree_button_press_cb), NULL);
 
     return treeview;
 }
 
 /**
  *  \param window application toplevel window
+ *  \param names user preset names
  *  \param default_name default preset name
  *
- *  Shows window allowing user to store current edit buffer.
+ *  Runs dialog allowing user to store current edit buffer.
  **/
-static void show_store_preset_window(GtkWidget *window, gchar *default_name)
+static void run_store_preset_dialog(GtkWidget *window, GStrv names,
+                                    const gchar *default_name)
 {
     GtkWidget *dialog, *cmbox, *entry, *grid, *label, *vbox;
-    GStrv names;
     int x;
 
     dialog = gtk_dialog_new_with_buttons("Store preset",
@@ -1094,13 +1878,11 @@ static void show_store_preset_window(GtkWidget *window, gchar *default_name)
     gtk_container_add(GTK_CONTAINER(vbox), grid);
 
     cmbox = gtk_combo_box_text_new();
-    names = query_preset_names(PRESETS_USER);
     for (x=0; x<g_strv_length(names); x++) {
         gchar *title = g_strdup_printf("%d - %s", x+1, names[x]);
         gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(cmbox), NULL, title);
         g_free(title);
     }
-    g_strfreev(names);
     gtk_grid_attach(GTK_GRID(grid), cmbox, 1, 0, 1, 1);
 
     entry = gtk_entry_new();
@@ -1125,6 +1907,63 @@ static void show_store_preset_window(GtkWidget *window, gchar *default_name)
     gtk_widget_destroy(dialog);
 }
 
+/** store preset window waiting for preset names */
+typedef struct {
+    GtkWidget *window;
+    gchar *default_name;
+} StorePresetRequest;
+
+/**
+ *  \param request finished REQUEST_PRESET_NAMES request
+ *  \param data StorePresetRequest
+ *
+ *  Shows store preset window once user preset names arrived.
+ **/
+static void store_names_received_cb(DeviceRequest *request, gpointer data)
+{
+    StorePresetRequest *store = data;
+    GStrv names = NULL;
+
+    if (device_request_get_status(request) == REQUEST_DONE) {
+        GString *reply = device_request_steal_reply(request);
+
+        names = parse_preset_names(reply);
+        g_string_free(reply, TRUE);
+    }
+
+    if (names == NULL) {
+        show_error_message(store->window,
+                           "Failed to read preset names from device");
+    } else {
+        run_store_preset_dialog(store->window, names, store->default_name);
+        g_strfreev(names);
+    }
+
+    g_free(store->default_name);
+    g_slice_free(StorePresetRequest, store);
+}
+
+/**
+ *  \param window application toplevel window
+ *  \param default_name default preset name
+ *
+ *  Shows window allowing user to store current edit buffer, once user
+ *  preset names have been read from device.
+ **/
+static void show_store_preset_window(GtkWidget *window,
+                                     const gchar *default_name)
+{
+    StorePresetRequest *store = g_slice_new(StorePresetRequest);
+    gchar bank = PRESETS_USER;
+
+    store->window = window;
+    store->default_name = g_strdup(default_name);
+
+    device_request_send(REQUEST_PRESET_NAMES, &bank, 1,
+                        RECEIVE_PRESET_NAMES, PRESET_NAMES_TIMEOUT,
+                        store_names_received_cb, store);
+}
+
 /**
  *  \param action the object which emitted the signal
  *
@@ -1136,6 +1975,81 @@ static void action_store_cb(GtkAction *action)
     show_store_preset_window(window, NULL);
 }
 
+/**
+ *  \param sync LibrarySync
+ *  \param data sync dialog
+ *
+ *  Updates library sync dialog progress.
+ **/
+static void library_sync_progress_cb(LibrarySync *sync, gpointer data)
+{
+    GtkWidget *dialog = data;
+    GtkWidget *bar = g_object_get_data(G_OBJECT(dialog), "progress");
+    guint done, failed, total;
+    gdouble rate;
+    gchar *text;
+
+    library_sync_get_progress(sync, &done, &failed, &total, &rate);
+
+    if (library_sync_is_finished(sync)) {
+        text = g_strdup_printf("Read %d presets, %.1f presets/s%s",
+                               done, rate, failed ? ", some failed" : "");
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(bar), 1.0);
+        gtk_dialog_response(GTK_DIALOG(dialog), GTK_RESPONSE_OK);
+    } else {
+        text = g_strdup_printf("%d / %d presets", done + failed, total);
+        if (total > 0) {
+            gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(bar),
+                                          (gdouble) (done + failed) / total);
+        }
+    }
+
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(bar), text);
+    g_free(text);
+}
+
+/**
+ *  \param action the object which emitted the signal
+ *
+ *  Reads all presets stored on device into preset cache, showing progress.
+ **/
+static void action_sync_library_cb(GtkAction *action)
+{
+    GtkWidget *window = g_object_get_data(G_OBJECT(action), "window");
+    Device *device = g_object_get_data(G_OBJECT(window), "device");
+    GtkWidget *dialog, *bar, *vbox;
+    LibrarySync *sync;
+
+    g_return_if_fail(device != NULL);
+
+    dialog = gtk_dialog_new_with_buttons("Sync Library", GTK_WINDOW(window),
+                                         GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                         GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+                                         NULL);
+
+    vbox = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    bar = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(bar), TRUE);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(bar), "Reading preset names");
+    gtk_container_add(GTK_CONTAINER(vbox), bar);
+    g_object_set_data(G_OBJECT(dialog), "progress", bar);
+    gtk_widget_show_all(vbox);
+
+    sync = library_sync_start(device, library_sync_progress_cb, dialog);
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_OK) {
+        /* keep result visible until user closes dialog */
+        gtk_dialog_add_button(GTK_DIALOG(dialog), GTK_STOCK_CLOSE,
+                              GTK_RESPONSE_CLOSE);
+        gtk_dialog_set_response_sensitive(GTK_DIALOG(dialog),
+                                          GTK_RESPONSE_CANCEL, FALSE);
+        gtk_dialog_run(GTK_DIALOG(dialog));
+    }
+
+    library_sync_free(sync);
+    gtk_widget_destroy(dialog);
+}
+
 /**
  *  \param action the object which emitted the signal
  *
@@ -1210,6 +2124,122 @@ get_preset_filename (int prod_id)
 }
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
+/**
+ *  \param preset preset to be sent
+ *
+ *  Sends whole preset to device edit buffer.
+ **/
+static void send_preset(Preset *preset)
+{
+    GString *start = g_string_new(NULL);
+    g_string_append_printf(start,
+                           "%c%c%s%c%c%c",
+                           PRESETS_EDIT_BUFFER, 0,
+                           preset->name, 0 /* NULL terminated string */,
+                           0 /* modified */,
+                           /* messages to follow */
+                           preset->genetxs ? 10 : 2);
+
+    send_message(RECEIVE_PRESET_START, start->str, start->len);
+    send_preset_parameters(preset->params);
+    if (preset->genetxs != NULL) {
+        gint i;
+
+        /* GNX4 sends messages in following order:
+         *   Section Bank  Index
+         *      0x00 0x04 0x0000
+         *      0x00 0x04 0x0001
+         *      0x01 0x04 0x0000
+         *      0x01 0x04 0x0001
+         *      0x00 0x04 0x0002
+         *      0x00 0x04 0x0003
+         *      0x01 0x04 0x0002
+         *      0x01 0x04 0x0003
+         */
+
+        /* GNX3000 sends messages in following order:
+         *   Section Bank  Index
+         *      0x07 0x04 0x0000
+         *      0x07 0x04 0x0001
+         *      0x08 0x04 0x0000
+         *      0x08 0x04 0x0001
+         *      0x07 0x04 0x0002
+         *      0x07 0x04 0x0003
+         *      0x08 0x04 0x0002
+         *      0x08 0x04 0x0003
+         */
+        for (i = 0; i < 2; i++) {
+            GList *iter = preset->genetxs;
+
+            while (iter) {
+                SectionID section;
+                guint bank, index;
+
+                SettingGenetx *genetx = (SettingGenetx *) iter->data;
+                iter = iter->next;
+
+                section = get_genetx_section_id(genetx->version,
+                                                genetx->type);
+                bank = 0x04;
+                index = genetx->channel;
+
+                if (i != 0) {
+                    if (genetx->channel == GENETX_CHANNEL1) {
+                        index = GENETX_CHANNEL1_CUSTOM;
+                    } else if (genetx->channel == GENETX_CHANNEL2) {
+                        index = GENETX_CHANNEL2_CUSTOM;
+                    }
+                }
+
+                send_object(section, bank, index,
+                            genetx->name, genetx->data);
+            }
+        }
+    }
+    send_message(RECEIVE_PRESET_END, NULL, 0);
+    edit_buffer_set_preset(preset);
+    g_string_free(start, TRUE);
+}
+
+/**
+ *  \param preset preset to be sent
+ *
+ *  Turns device edit buffer into preset by sending only parameters that
+ *  differ from it, one RECEIVE_PARAMETER_VALUE message per parameter,
+ *  followed by preset name.
+ *
+ *  \return TRUE if preset was sent, FALSE if it has to be sent whole.
+ **/
+static gboolean send_preset_changes(Preset *preset)
+{
+    GList *changed, *iter;
+    gint n;
+
+    if (preset->genetxs != NULL)
+        return FALSE;
+
+    n = edit_buffer_diff(preset, &changed);
+    if (n < 0 || n > MAX_PRESET_CHANGES) {
+        debug_msg(DEBUG_VERBOSE, "Sending whole preset (%d changes)", n);
+        g_list_free(changed);
+        return FALSE;
+    }
+
+    debug_msg(DEBUG_VERBOSE, "Sending %d changed parameters", n);
+    for (iter = changed; iter; iter = iter->next) {
+        SettingParam *param = iter->data;
+        set_option(param->id, param->position, param->value);
+    }
+    g_list_free(changed);
+
+    /* the store dialog may get cancelled, so name can't wait for it */
+    if (preset->name != NULL) {
+        set_edit_buffer_name(preset->name);
+    }
+
+    return TRUE;
+}
+
 /**
  *  \param action the object which emitted the signal
  *
@@ -1269,76 +2299,12 @@ static void action_open_preset_cb(GtkAction *action)
 
             gtk_widget_hide(dialog);
 
-            GString *start = g_string_new(NULL);
-            g_string_append_printf(start,
-                                   "%c%c%s%c%c%c",
-                                   PRESETS_EDIT_BUFFER, 0,
-                                   preset->name, 0 /* NULL terminated string */,
-                                   0 /* modified */,
-                                   /* messages to follow */
-                                   preset->genetxs ? 10 : 2);
-
-            send_message(RECEIVE_PRESET_START, start->str, start->len);
-            send_preset_parameters(preset->params);
-            if (preset->genetxs != NULL) {
-                gint i;
-
-                /* GNX4 sends messages in following order:
-                 *   Section Bank  Index
-                 *      0x00 0x04 0x0000
-                 *      0x00 0x04 0x0001
-                 *      0x01 0x04 0x0000
-                 *      0x01 0x04 0x0001
-                 *      0x00 0x04 0x0002
-                 *      0x00 0x04 0x0003
-                 *      0x01 0x04 0x0002
-                 *      0x01 0x04 0x0003
-                 */
-
-                /* GNX3000 sends messages in following order:
-                 *   Section Bank  Index
-                 *      0x07 0x04 0x0000
-                 *      0x07 0x04 0x0001
-                 *      0x08 0x04 0x0000
-                 *      0x08 0x04 0x0001
-                 *      0x07 0x04 0x0002
-                 *      0x07 0x04 0x0003
-                 *      0x08 0x04 0x0002
-                 *      0x08 0x04 0x0003
-                 */
-                for (i = 0; i < 2; i++) {
-                    GList *iter = preset->genetxs;
-
-                    while (iter) {
-                        SectionID section;
-                        guint bank, index;
-
-                        SettingGenetx *genetx = (SettingGenetx *) iter->data;
-                        iter = iter->next;
-
-                        section = get_genetx_section_id(genetx->version,
-                                                        genetx->type);
-                        bank = 0x04;
-                        index = genetx->channel;
-
-                        if (i != 0) {
-                            if (genetx->channel == GENETX_CHANNEL1) {
-                                index = GENETX_CHANNEL1_CUSTOM;
-                            } else if (genetx->channel == GENETX_CHANNEL2) {
-                                index = GENETX_CHANNEL2_CUSTOM;
-                            }
-                        }
-
-                        send_object(section, bank, index,
-                                    genetx->name, genetx->data);
-                    }
-                }
+            if (!send_preset_changes(preset)) {
+                send_preset(preset);
             }
-            send_message(RECEIVE_PRESET_END, NULL, 0);
 
             show_store_preset_window(window, preset->name);
 
-            g_string_free(start, TRUE);
             preset_free(preset);
             loaded = TRUE;
         }
@@ -1349,6 +2315,32 @@ static void action_open_preset_cb(GtkAction *action)
     dialog = NULL;
 }
 
+/** preset file waiting for edit buffer, see action_save_preset_cb() */
+typedef struct {
+    GtkWidget *window;
+    gchar *filename;
+} SavePresetRequest;
+
+/**
+ *  \param preset current edit buffer, or NULL
+ *  \param data SavePresetRequest
+ *
+ *  Writes edit buffer to preset file.
+ **/
+static void save_preset_received_cb(Preset *preset, gpointer data)
+{
+    SavePresetRequest *save = data;
+
+    if (preset == NULL) {
+        show_error_message(save->window, "No reply from device");
+    } else {
+        write_preset_to_xml(preset, save->filename);
+    }
+
+    g_free(save->filename);
+    g_slice_free(SavePresetRequest, save);
+}
+
 /**
  *  \param action the object which emitted the signal
  *
@@ -1376,18 +2368,25 @@ static void action_save_preset_cb(GtkAction *action)
         if (filename == NULL) {
             show_error_message(window, "No file name");
         } else {
-            gchar real_filename[256];
-            GList *list = get_current_preset();
-            Preset *preset = create_preset_from_data(list);
+            SavePresetRequest *save = g_slice_new(SavePresetRequest);
+            Preset *preset = NULL;
 
-            snprintf(real_filename, 256, "%s.%s",
-                     filename, file_types[product_id].suffix + 2);
+            save->window = window;
+            save->filename = g_strdup_printf("%s.%s", filename,
+                                             file_types[product_id].suffix + 2);
+            g_free(filename);
 
             gtk_widget_hide(dialog);
-            write_preset_to_xml(preset, real_filename);
 
-            preset_free(preset);
-            g_free(filename);
+            if (!verify_edit_buffer) {
+                preset = edit_buffer_get_preset();
+            }
+            if (preset != NULL) {
+                save_preset_received_cb(preset, save);
+                preset_free(preset);
+            } else {
+                read_current_preset(save_preset_received_cb, save);
+            }
         }
     }
 
@@ -1395,20 +2394,6 @@ static void action_save_preset_cb(GtkAction *action)
     dialog = NULL;
 }
 
-/**
- *  \param list widget tree list to be freed
- *
- *  Frees all memory used by widget tree list.
- */
-static void widget_tree_elem_free(GList *list)
-{
-    GList *iter;
-    for (iter = list; iter; iter = iter->next) {
-        g_slice_free(WidgetTreeElem, iter->data);
-    }
-    g_list_free(list);
-}
-
 /**
  *  \param action the object which emitted the signal
  *
@@ -1431,6 +2416,7 @@ static GtkActionEntry entries[] = {
     {"Store", NULL, "_Store Preset to Device", "<control>D", "Store Preset to Device", G_CALLBACK(action_store_cb)},
     {"Load", GTK_STOCK_OPEN, "_Load Preset from File", "<control>O", "Load Preset from File", G_CALLBACK(action_open_preset_cb)},
     {"Save", GTK_STOCK_SAVE, "_Save Preset to File", "<control>S", "Save Preset to File", G_CALLBACK(action_save_preset_cb)},
+    {"SyncLibrary", GTK_STOCK_REFRESH, "S_ync Library", NULL, "Read All Presets from Device", G_CALLBACK(action_sync_library_cb)},
     {"Help", NULL, "_Help"},
     {"About", GTK_STOCK_ABOUT, "_About", "<control>A", "About", G_CALLBACK(action_show_about_dialog_cb)},
 };
@@ -1448,6 +2434,8 @@ static const gchar *menu_info =
 "   <separator/>"
 "   <menuitem action='Load'/>"
 "   <menuitem action='Save'/>"
+"   <separator/>"
+"   <menuitem action='SyncLibrary'/>"
 "  </menu>"
 "  <menu action='Help'>"
 "   <menuitem action='About'/>"
@@ -1507,26 +2495,12 @@ static void add_menubar(GtkWidget *window, GtkWidget *vbox)
     add_action_data(ui, "/MenuBar/Preset/Store", window);
     add_action_data(ui, "/MenuBar/Preset/Save", window);
     add_action_data(ui, "/MenuBar/Preset/Load", window);
+    add_action_data(ui, "/MenuBar/Preset/SyncLibrary", window);
     add_action_data(ui, "/MenuBar/Help/About", window);
 
     g_object_unref(ui);
 }
 
-static gint widget_tree_key_compare_func(gconstpointer a, gconstpointer b, gpointer data)
-{
-    gint position_a = GPOINTER_TO_INT(a) & 0xFF0000;
-    gint position_b = GPOINTER_TO_INT(b) & 0xFF0000;
-
-    if (position_a > position_b) {
-        return 1;
-    } else if (position_a == position_b) {
-        gint val_a = GPOINTER_TO_INT(a) & 0xFFFF;
-        gint val_b = GPOINTER_TO_INT(b) & 0xFFFF;
-        return val_a - val_b;
-    } else
-        return -1;
-}
-
 /**
  *  Creates main window.
  **/
@@ -1539,12 +2513,13 @@ void gui_create(Device *device)
     GtkWidget *notebook;
     GtkWidget *sw;             /* scrolled window to carry preset treeview */
     GdkPixbuf *icon;
+    gint64 start = g_get_monotonic_time();
 
-    gint x;
     gint i;
 
     window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
     gtk_window_set_title(GTK_WINDOW(window), "gdigi");
+    g_object_set_data(G_OBJECT(window), "device", device);
 
     icon = gdk_pixbuf_new_from_inline(-1, gdigi_icon, FALSE, NULL);
     gtk_window_set_icon(GTK_WINDOW(window), icon);
@@ -1561,18 +2536,18 @@ void gui_create(Device *device)
     gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(sw), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
     gtk_box_pack_start(GTK_BOX(hbox), sw, FALSE, FALSE, 0);
 
+    profile_begin("Create preset tree");
     widget = create_preset_tree(device);
     gtk_container_add(GTK_CONTAINER(sw), widget);
+    profile_end();
 
     notebook = gtk_notebook_new();
     gtk_box_pack_start(GTK_BOX(hbox), notebook, TRUE, TRUE, 2);
 
     knob_anim = gtk_knob_animation_new_from_inline();
 
-    widget_tree = g_tree_new_full(widget_tree_key_compare_func,
-                                  NULL, /* key compare data */
-                                  NULL, /* key destroy func */
-                                  (GDestroyNotify) widget_tree_elem_free);
+    widget_elems = g_array_new(FALSE, FALSE, sizeof(WidgetElem));
+    widget_spans = g_array_new(FALSE, FALSE, sizeof(WidgetSpan));
 
     gtk_notebook_set_show_tabs(GTK_NOTEBOOK(notebook), device->n_pages > 1 ? TRUE : FALSE);
 
@@ -1581,25 +2556,34 @@ void gui_create(Device *device)
         vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
         label = gtk_label_new(device->pages[i].name);
 
+        /* page contents are created by build_page() when first shown */
+        g_object_set_data(G_OBJECT(vbox), "page", &device->pages[i]);
         gtk_notebook_append_page(GTK_NOTEBOOK(notebook), vbox, label);
-
-        for (x = 0; x<device->pages[i].n_effects; x++) {
-            if ((x % ((device->pages[i].n_effects+1)/device->pages[i].n_rows)) == 0) {
-                hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
-                gtk_box_pack_start(GTK_BOX(vbox), hbox, TRUE, TRUE, 2);
-            }
-            widget = create_vbox(device->pages[i].effects[x].effect, device->pages[i].effects[x].amt, device->pages[i].effects[x].label);
-            gtk_box_pack_start(GTK_BOX(hbox), widget, TRUE, TRUE, 2);
-        }
     }
 
-    apply_current_preset();
+    profile_begin("Show main window");
     gtk_widget_show_all(window);
+    profile_end();
+
+    if (device->n_pages > 0) {
+        build_page(gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook),
+                   gtk_notebook_get_current_page(GTK_NOTEBOOK(notebook))));
+    }
+    g_signal_connect(G_OBJECT(notebook), "switch-page",
+                     G_CALLBACK(notebook_switch_page_cb), NULL);
+
+    profile_async_begin("Current preset");
+    read_current_preset(startup_preset_apply_cb, NULL);
+
+    debug_msg(DEBUG_STATS, "Main window created in %.1f ms, %d widgets",
+              (g_get_monotonic_time() - start) / 1000.0, widget_elems->len);
 
     g_signal_connect(G_OBJECT(window), "delete_event", G_CALLBACK(gtk_main_quit), NULL);
 
     /* Get the initial values for the linkable parameters and the globals. */
+    profile_async_begin("Modifier linkable list");
     send_message(REQUEST_MODIFIER_LINKABLE_LIST, "\x00\x01", 2);
+    profile_async_begin("Global parameters");
     send_message(REQUEST_GLOBAL_PARAMETERS, "\x00\x01", 2);
 }
 
@@ -1608,8 +2592,10 @@ void gui_create(Device *device)
  **/
 void gui_free()
 {
-    g_tree_destroy(widget_tree);
-    widget_tree = NULL;
+    g_array_free(widget_elems, TRUE);
+    widget_elems = NULL;
+    g_array_free(widget_spans, TRUE);
+    widget_spans = NULL;
 
     gtk_knob_animation_free(knob_anim);
     knob_anim = NULL;
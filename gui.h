@@ -23,7 +23,7 @@
 
 gchar * get_preset_filename(int prod_id);
 void show_error_message(GtkWidget *parent, gchar *message);
-void apply_setting_param_to_gui(SettingParam *param);
+void apply_setting_params_to_gui(SettingParam *params, guint n);
 gboolean apply_current_preset_to_gui(gpointer data);
 void gui_create(Device *device);
 void gui_free();
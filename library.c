@@ -0,0 +1,304 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <glib.h>
+#include "gdigi.h"
+#include "preset.h"
+#include "cache.h"
+#include "library.h"
+
+/*
+ * Library sync reads every preset stored on device into the preset cache.
+ * Presets are requested directly from their bank slots, so the edit
+ * buffer is left alone. A few requests are kept in flight, so the device
+ * always has the next request queued when it finishes sending a preset.
+ */
+
+/** REQUEST_PRESET requests kept in flight */
+#define LIBRARY_SYNC_WINDOW 4
+/** how long to wait for each reply queued before and including own one */
+#define LIBRARY_SYNC_TIMEOUT 5000
+
+struct _LibrarySync {
+    gint ref_count;              /**< owner and every pending request */
+    gboolean cancelled;
+    LibrarySyncFunc progress;
+    gpointer data;
+
+    gint names_left;             /**< banks whose names are still unknown */
+    GQueue *slots;               /**< (bank << 8) | index still to request */
+    GList *requests;             /**< REQUEST_PRESET in flight */
+
+    guint total;
+    guint done;
+    guint failed;
+    gint64 start_time;
+    gint64 end_time;             /**< 0 until finished */
+};
+
+static void library_sync_pump(LibrarySync *sync);
+
+/**
+ *  \param sync LibrarySync
+ *
+ *  Drops reference, freeing sync once owner and all requests released it.
+ **/
+static void library_sync_unref(LibrarySync *sync)
+{
+    if (--sync->ref_count > 0)
+        return;
+
+    g_queue_free(sync->slots);
+    g_list_free(sync->requests);
+    g_slice_free(LibrarySync, sync);
+}
+
+/**
+ *  \param sync LibrarySync
+ *
+ *  Notifies owner about progress, checking whether sync has finished.
+ **/
+static void library_sync_update(LibrarySync *sync)
+{
+    if (sync->cancelled)
+        return;
+
+    if (sync->end_time == 0 && sync->names_left == 0 &&
+        sync->requests == NULL && g_queue_is_empty(sync->slots)) {
+        gdouble rate;
+
+        sync->end_time = g_get_monotonic_time();
+        library_sync_get_progress(sync, NULL, NULL, NULL, &rate);
+        debug_msg(DEBUG_STATS,
+                  "Library sync: %d presets in %.2f s, %.1f presets/s, "
+                  "%d failed", sync->done,
+                  (sync->end_time - sync->start_time) / 1000000.0,
+                  rate, sync->failed);
+    }
+
+    if (sync->progress != NULL)
+        sync->progress(sync, sync->data);
+}
+
+/**
+ *  \param request finished REQUEST_PRESET request
+ *  \param data LibrarySync
+ *
+ *  Decodes received preset into preset cache.
+ **/
+static void library_preset_received_cb(DeviceRequest *request, gpointer data)
+{
+    LibrarySync *sync = data;
+    PresetStartView start;
+    GList *list;
+
+    sync->requests = g_list_remove(sync->requests, request);
+
+    if (device_request_get_status(request) != REQUEST_DONE) {
+        if (!sync->cancelled)
+            sync->failed++;
+    } else {
+        list = device_request_steal_reply(request);
+
+        /* the slot is taken from reply, as replies requested again
+           after corruption don't arrive in request order */
+        if (!sync->cancelled && list != NULL &&
+            preset_start_view_init(&start, list->data)) {
+            Preset *preset = create_preset_from_data(list);
+
+            cache_set_preset(start.bank, start.index, preset);
+            preset_free(preset);
+            sync->done++;
+        }
+
+        if (list != NULL)
+            message_list_free(list);
+    }
+
+    library_sync_pump(sync);
+    library_sync_update(sync);
+    library_sync_unref(sync);
+}
+
+/**
+ *  \param request finished REQUEST_PRESET_NAMES request
+ *  \param data LibrarySync
+ *
+ *  Queues every preset of the bank for reading.
+ **/
+static void library_names_received_cb(DeviceRequest *request, gpointer data)
+{
+    LibrarySync *sync = data;
+    NameIter names;
+    GString *reply;
+    GPtrArray *received;
+    const gchar *name;
+    guint x;
+
+    sync->names_left--;
+
+    if (device_request_get_status(request) != REQUEST_DONE) {
+        g_warning("Library sync: failed to read preset names");
+    } else {
+        reply = device_request_steal_reply(request);
+
+        if (!sync->cancelled && name_iter_init(&names, reply)) {
+            received = g_ptr_array_sized_new(names.left + 1);
+            while ((name = name_iter_next(&names)) != NULL)
+                g_ptr_array_add(received, (gpointer) name);
+            g_ptr_array_add(received, NULL);
+
+            cache_set_preset_names(names.bank,
+                                   (const gchar * const *) received->pdata);
+
+            for (x = 0; x + 1 < received->len; x++) {
+                g_queue_push_tail(sync->slots,
+                                  GUINT_TO_POINTER((names.bank << 8) | x));
+            }
+            sync->total += received->len - 1;
+
+            g_ptr_array_free(received, TRUE);
+        }
+
+        g_string_free(reply, TRUE);
+    }
+
+    library_sync_pump(sync);
+    library_sync_update(sync);
+    library_sync_unref(sync);
+}
+
+/**
+ *  \param sync LibrarySync
+ *
+ *  Sends REQUEST_PRESET for queued slots until window is full.
+ **/
+static void library_sync_pump(LibrarySync *sync)
+{
+    while (!sync->cancelled &&
+           g_list_length(sync->requests) < LIBRARY_SYNC_WINDOW &&
+           !g_queue_is_empty(sync->slots)) {
+        guint slot = GPOINTER_TO_UINT(g_queue_pop_head(sync->slots));
+        gchar msg[2] = {slot >> 8, slot & 0xFF};
+        DeviceRequest *request;
+
+        sync->ref_count++;
+        request = device_request_send(REQUEST_PRESET, msg, sizeof(msg),
+                                      RECEIVE_PRESET_START,
+                                      LIBRARY_SYNC_TIMEOUT *
+                                          (g_list_length(sync->requests) + 1),
+                                      library_preset_received_cb, sync);
+        sync->requests = g_list_append(sync->requests, request);
+    }
+}
+
+/**
+ *  \param device device which presets to read
+ *  \param progress function called on main context whenever preset
+ *                  arrives, and once sync has finished (may be NULL)
+ *  \param data data to pass to progress
+ *
+ *  Starts reading all presets stored on device into preset cache.
+ *
+ *  \return LibrarySync which must be freed using library_sync_free.
+ **/
+LibrarySync *library_sync_start(Device *device, LibrarySyncFunc progress,
+                                gpointer data)
+{
+    LibrarySync *sync = g_slice_new0(LibrarySync);
+    gint i;
+
+    sync->ref_count = 1;
+    sync->progress = progress;
+    sync->data = data;
+    sync->slots = g_queue_new();
+    sync->start_time = g_get_monotonic_time();
+
+    for (i = 0; i < device->n_banks; i++) {
+        gchar bank = device->banks[i].bank;
+
+        sync->names_left++;
+        sync->ref_count++;
+        device_request_send(REQUEST_PRESET_NAMES, &bank, 1,
+                            RECEIVE_PRESET_NAMES,
+                            LIBRARY_SYNC_TIMEOUT * (i + 1),
+                            library_names_received_cb, sync);
+    }
+
+    return sync;
+}
+
+/**
+ *  \param sync LibrarySync
+ *
+ *  \return TRUE if all presets were read, or failed to be read.
+ **/
+gboolean library_sync_is_finished(LibrarySync *sync)
+{
+    return sync->end_time != 0;
+}
+
+/**
+ *  \param sync LibrarySync
+ *  \param done return location for amount of presets read, or NULL
+ *  \param failed return location for amount of presets which couldn't be
+ *                read, or NULL
+ *  \param total return location for amount of presets known so far, or NULL
+ *  \param rate return location for presets read per second, or NULL
+ **/
+void library_sync_get_progress(LibrarySync *sync, guint *done,
+                               guint *failed, guint *total, gdouble *rate)
+{
+    gint64 end = sync->end_time ? sync->end_time : g_get_monotonic_time();
+
+    if (done != NULL)
+        *done = sync->done;
+    if (failed != NULL)
+        *failed = sync->failed;
+    if (total != NULL)
+        *total = sync->total;
+    if (rate != NULL)
+        *rate = (end > sync->start_time) ?
+                sync->done * 1000000.0 / (end - sync->start_time) : 0.0;
+}
+
+/**
+ *  \param sync LibrarySync
+ *
+ *  Cancels sync unless it has finished, then releases it. Progress
+ *  function is not called anymore. Must be called from main context.
+ **/
+void library_sync_free(LibrarySync *sync)
+{
+    GList *requests, *iter;
+
+    g_return_if_fail(sync != NULL);
+
+    sync->cancelled = TRUE;
+    sync->progress = NULL;
+    g_queue_clear(sync->slots);
+
+    /* requests whose reply already arrived can't be cancelled,
+       their callbacks only drop the reply */
+    requests = sync->requests;
+    sync->requests = NULL;
+    for (iter = requests; iter; iter = iter->next) {
+        device_request_cancel(iter->data);
+    }
+    g_list_free(requests);
+
+    library_sync_unref(sync);
+}
@@ -0,0 +1,34 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef GDIGI_LIBRARY_H
+#define GDIGI_LIBRARY_H
+
+#include <glib.h>
+#include "effects.h"
+
+typedef struct _LibrarySync LibrarySync;
+
+typedef void (*LibrarySyncFunc)(LibrarySync *sync, gpointer data);
+
+LibrarySync *library_sync_start(Device *device, LibrarySyncFunc progress,
+                                gpointer data);
+gboolean library_sync_is_finished(LibrarySync *sync);
+void library_sync_get_progress(LibrarySync *sync, guint *done,
+                               guint *failed, guint *total, gdouble *rate);
+void library_sync_free(LibrarySync *sync);
+
+#endif /* GDIGI_LIBRARY_H */
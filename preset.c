@@ -19,6 +19,7 @@
 #include <string.h>
 #include "preset.h"
 #include "gdigi.h"
+#include "gdigi_xml.h"
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 
@@ -68,11 +69,11 @@ static void XMLCALL start(void *data, const char *el, const char **attr) {
 
     if (g_strcmp0(el, "Params") == 0) {
         ad->section = SECTION_PARAMS;
-        if (ad->preset->params != NULL)
+        if (ad->preset->params->len != 0)
             g_warning("Params aleady exists!");
     } else if (g_strcmp0(el, "Param") == 0) {
-        SettingParam *param = setting_param_new();
-        ad->preset->params = g_list_prepend(ad->preset->params, param);
+        SettingParam param = {-1, -1, -1};
+        g_array_append_val(ad->preset->params, param);
     } else if (g_strcmp0(el, "ID") == 0) {
         ad->id = PARSER_TYPE_PARAM_ID;
     } else if (g_strcmp0(el, "Position") == 0) {
@@ -121,12 +122,11 @@ static void XMLCALL text_cb(void *data, const char* text, int len)
     }
 
     if (ad->section == SECTION_PARAMS) {
-        if (ad->preset->params == NULL)
+        if (ad->preset->params->len == 0)
             return;
 
-        SettingParam *param = (SettingParam *) ad->preset->params->data;
-        if (param == NULL)
-            return;
+        SettingParam *param = &g_array_index(ad->preset->params, SettingParam,
+                                             ad->preset->params->len - 1);
 
         gchar *value = g_strndup(text, len);
 
@@ -205,6 +205,22 @@ static void XMLCALL text_cb(void *data, const char* text, int len)
 
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
+/**
+ *  Allocates empty preset.
+ *
+ *  \return Preset which must be freed using preset_free.
+ **/
+Preset *preset_new()
+{
+    Preset *preset = g_slice_new(Preset);
+
+    preset->name = NULL;
+    preset->params = g_array_new(FALSE, FALSE, sizeof(SettingParam));
+    preset->genetxs = NULL;
+
+    return preset;
+}
+
 /**
  *  \param filename valid path to file
  *  \param error return location for an error
@@ -227,10 +243,7 @@ Preset *create_preset_from_xml_file(gchar *filename, GError **error)
 
     AppData *ad = g_slice_new(AppData);
     ad->depth = 0;
-    ad->preset = g_slice_new(Preset);
-    ad->preset->name = NULL;
-    ad->preset->params = NULL;
-    ad->preset->genetxs = NULL;
+    ad->preset = preset_new();
     ad->id = PARSER_TYPE_NOT_SET;
 
     XML_Parser p;
@@ -250,7 +263,7 @@ Preset *create_preset_from_xml_file(gchar *filename, GError **error)
     }
 
     Preset *preset = ad->preset;
-    preset->params = g_list_reverse(preset->params);
+    g_array_sort(preset->params, params_cmp);
     preset->genetxs = g_list_reverse(preset->genetxs);
 
     XML_ParserFree(p);
@@ -260,6 +273,15 @@ Preset *create_preset_from_xml_file(gchar *filename, GError **error)
     return preset;
 }
 
+/**
+ *  \param a SettingParam
+ *  \param b SettingParam
+ *
+ *  Orders parameters by position, then by ID. Preset params are kept
+ *  in this order.
+ *
+ *  \return negative value if a < b, zero if a = b, positive value if a > b.
+ **/
 gint params_cmp(gconstpointer a, gconstpointer b)
 {
     const SettingParam *param_a = a;
@@ -275,6 +297,57 @@ gint params_cmp(gconstpointer a, gconstpointer b)
     return 0;
 }
 
+/**
+ *  \param a first Preset
+ *  \param b second Preset
+ *
+ *  Compares parameters of both presets. Names are not compared.
+ *
+ *  \return GArray of ParamDiff, one entry for each parameter whose value
+ *          differs or which is present in only one preset. Must be freed
+ *          using g_array_free.
+ **/
+GArray *preset_diff(Preset *a, Preset *b)
+{
+    GArray *diffs = g_array_new(FALSE, FALSE, sizeof(ParamDiff));
+    guint i = 0, j = 0;
+
+    /* both arrays are sorted using params_cmp */
+    while (i < a->params->len || j < b->params->len) {
+        SettingParam *pa = (i < a->params->len) ?
+            &g_array_index(a->params, SettingParam, i) : NULL;
+        SettingParam *pb = (j < b->params->len) ?
+            &g_array_index(b->params, SettingParam, j) : NULL;
+        gint cmp = (pa && pb) ? params_cmp(pa, pb) : (pa ? -1 : 1);
+        ParamDiff diff = { 0, };
+
+        if (cmp == 0 && pa->value == pb->value) {
+            i++;
+            j++;
+            continue;
+        }
+
+        if (cmp <= 0) {
+            diff.id = pa->id;
+            diff.position = pa->position;
+            diff.in_a = TRUE;
+            diff.value_a = pa->value;
+            i++;
+        }
+        if (cmp >= 0) {
+            diff.id = pb->id;
+            diff.position = pb->position;
+            diff.in_b = TRUE;
+            diff.value_b = pb->value;
+            j++;
+        }
+
+        g_array_append_val(diffs, diff);
+    }
+
+    return diffs;
+}
+
 /**
  *  \param list list containing unpacked preset SysEx messages.
  *
@@ -286,58 +359,60 @@ Preset *create_preset_from_data(GList *list)
 {
     GString *data;
     GList *iter;
-    gint total, n, x;
-    gint bank, number, modified;
-    gchar *name;
+    PresetStartView start;
+    ParamIter params;
+    SettingParam param;
+    gint total, n;
 
     g_return_val_if_fail(list != NULL, NULL);
 
-    Preset *preset = g_slice_new(Preset);
-    preset->name = NULL;
-    preset->params = NULL;
-    preset->genetxs = NULL;
+    Preset *preset = preset_new();
 
     iter = list;
     for (iter = list; iter; iter = g_list_next(iter)) {
         data = (GString*) iter->data;
         switch (get_message_id(data)) {
             case RECEIVE_PRESET_START:
-                bank = (unsigned char)data->str[8];
-                number = (unsigned char)data->str[9];
-                name = g_strdup(&data->str[10]);
-                modified = (unsigned char)data->str[11+strlen(name)];
+                if (!preset_start_view_init(&start, data)) {
+                    g_warning("Truncated RECEIVE_PRESET_START message");
+                    break;
+                }
 
-                if ((bank == PRESETS_EDIT_BUFFER) && (number == 0)) {
+                if ((start.bank == PRESETS_EDIT_BUFFER) && (start.index == 0)) {
                     debug_msg(DEBUG_MSG2HOST,
                               "RECEIVE_PRESET_START:  current edit buffer");
                 } else {
                     debug_msg(DEBUG_MSG2HOST,
                               "RECEIVE_PRESET_START: preset %d from bank %d",
-                              number, bank);
+                              start.index, start.bank);
                 }
 
                 debug_msg(DEBUG_MSG2HOST, "Name: %s, %sodified",
-                                          name, modified ? "M" : "Not m");
-                preset->name = name;
+                                          start.name,
+                                          start.modified ? "M" : "Not m");
+                g_free(preset->name);
+                preset->name = g_strdup(start.name);
                 break;
             case RECEIVE_PRESET_PARAMETERS:
-                x = 0x09;
+                if (!param_iter_init(&params, data)) {
+                    g_warning("Truncated RECEIVE_PRESET_PARAMETERS message");
+                    break;
+                }
+
                 n = 0;
-                total = (unsigned char)data->str[x];
-                x++;
+                total = params.left;
 
-                do {
-                    SettingParam *param = setting_param_new_from_data(&data->str[x], &x);
+                while (param_iter_next(&params, &param)) {
                     n++;
-                    preset->params = g_list_prepend(preset->params, param);
+                    g_array_append_val(preset->params, param);
                     if (debug_flag_is_set(DEBUG_MSG2HOST)) {
-                        GString *ipv = format_ipv(param->id, param->position, param->value);
+                        GString *ipv = format_ipv(param.id, param.position, param.value);
                         debug_msg(DEBUG_MSG2HOST, "%3d %s", n, ipv->str);
                         g_string_free(ipv, TRUE);
                     }
-                } while ((x < data->len) && n<total);
+                }
                 debug_msg(DEBUG_MSG2HOST, "TOTAL %d", total);
-                preset->params = g_list_sort(preset->params, params_cmp);
+                g_array_sort(preset->params, params_cmp);
                 break;
             case RECEIVE_PRESET_END:
                 break;
@@ -359,13 +434,7 @@ void preset_free(Preset *preset)
 {
     g_return_if_fail(preset != NULL);
 
-    if (preset->params != NULL) {
-        GList *iter;
-        for (iter = preset->params; iter; iter = iter->next) {
-            setting_param_free((SettingParam*)iter->data);
-        }
-        g_list_free(preset->params);
-    }
+    g_array_free(preset->params, TRUE);
 
     if (preset->genetxs != NULL) {
         GList *iter;
@@ -379,3 +448,346 @@ void preset_free(Preset *preset)
 
     g_slice_free(Preset, preset);
 }
+
+extern XmlSettings xml_settings[];
+extern guint n_xml_settings;
+extern EffectValues values_on_off;
+
+enum {
+    EDIT_BUFFER_VALID = 1 << 0,     /**< value is known */
+    EDIT_BUFFER_IN_PRESET = 1 << 1, /**< parameter is part of preset */
+};
+
+/**
+ *  Host side copy of device edit buffer.
+ *  Values and flags are indexed the same way as xml_settings.
+ **/
+typedef struct {
+    gchar *name;
+    guint *values;
+    guint8 *flags;
+    GHashTable *extra;      /**< preset parameters missing in xml_settings */
+    gboolean complete;      /**< TRUE if whole preset is known */
+} EditBuffer;
+
+G_LOCK_DEFINE_STATIC(edit_buffer);
+static EditBuffer edit_buffer = {NULL, NULL, NULL, NULL, FALSE};
+
+/**
+ *  Allocates edit buffer storage. Must be called with edit_buffer lock held.
+ **/
+static void edit_buffer_init()
+{
+    if (edit_buffer.values != NULL)
+        return;
+
+    edit_buffer.values = g_new0(guint, n_xml_settings);
+    edit_buffer.flags = g_new0(guint8, n_xml_settings);
+    edit_buffer.extra = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+/**
+ *  \param id parameter ID
+ *  \param position parameter position
+ *
+ *  \return index into edit buffer arrays, or -1 if parameter is unknown.
+ **/
+static gint edit_buffer_index(guint id, guint position)
+{
+    XmlSettings *xml = get_xml_settings(id, position);
+
+    return xml ? xml - xml_settings : -1;
+}
+
+/**
+ *  \param id parameter ID
+ *  \param position parameter position
+ *  \param value new value
+ *
+ *  Records parameter value sent to, or received from device.
+ **/
+void edit_buffer_set_param(guint id, guint position, guint value)
+{
+    gint x = edit_buffer_index(id, position);
+    gpointer key = GUINT_TO_POINTER((position << 16) | id);
+
+    G_LOCK(edit_buffer);
+    edit_buffer_init();
+    if (x >= 0) {
+        edit_buffer.values[x] = value;
+        edit_buffer.flags[x] |= EDIT_BUFFER_VALID;
+    } else if (g_hash_table_lookup_extended(edit_buffer.extra, key,
+                                            NULL, NULL)) {
+        g_hash_table_replace(edit_buffer.extra, key,
+                             GUINT_TO_POINTER(value));
+    }
+    G_UNLOCK(edit_buffer);
+}
+
+/**
+ *  \param id parameter ID
+ *  \param position parameter position
+ *  \param value location to store value
+ *
+ *  \return TRUE if parameter value is known, otherwise FALSE.
+ **/
+gboolean edit_buffer_get_param(guint id, guint position, guint *value)
+{
+    gint x = edit_buffer_index(id, position);
+    gpointer key = GUINT_TO_POINTER((position << 16) | id);
+    gpointer val;
+    gboolean known = FALSE;
+
+    G_LOCK(edit_buffer);
+    edit_buffer_init();
+    if (x >= 0) {
+        known = (edit_buffer.flags[x] & EDIT_BUFFER_VALID) != 0;
+        if (known)
+            *value = edit_buffer.values[x];
+    } else if (g_hash_table_lookup_extended(edit_buffer.extra, key,
+                                            NULL, &val)) {
+        known = TRUE;
+        *value = GPOINTER_TO_UINT(val);
+    }
+    G_UNLOCK(edit_buffer);
+
+    return known;
+}
+
+/**
+ *  \param preset preset now held in device edit buffer
+ *
+ *  Replaces whole edit buffer with preset.
+ **/
+void edit_buffer_set_preset(Preset *preset)
+{
+    guint i;
+    gint x;
+
+    g_return_if_fail(preset != NULL);
+
+    G_LOCK(edit_buffer);
+    edit_buffer_init();
+
+    for (x = 0; x < n_xml_settings; x++)
+        edit_buffer.flags[x] &= ~EDIT_BUFFER_IN_PRESET;
+    g_hash_table_remove_all(edit_buffer.extra);
+
+    for (i = 0; i < preset->params->len; i++) {
+        SettingParam *param = &g_array_index(preset->params, SettingParam, i);
+
+        x = edit_buffer_index(param->id, param->position);
+        if (x >= 0) {
+            edit_buffer.values[x] = param->value;
+            edit_buffer.flags[x] |= EDIT_BUFFER_VALID | EDIT_BUFFER_IN_PRESET;
+        } else {
+            g_hash_table_replace(edit_buffer.extra,
+                GUINT_TO_POINTER((param->position << 16) | param->id),
+                GUINT_TO_POINTER(param->value));
+        }
+    }
+
+    g_free(edit_buffer.name);
+    edit_buffer.name = g_strdup(preset->name);
+    edit_buffer.complete = TRUE;
+    G_UNLOCK(edit_buffer);
+}
+
+/**
+ *  \param name new edit buffer name
+ *
+ *  Records edit buffer name change.
+ **/
+void edit_buffer_set_name(const gchar *name)
+{
+    G_LOCK(edit_buffer);
+    g_free(edit_buffer.name);
+    edit_buffer.name = g_strdup(name);
+    G_UNLOCK(edit_buffer);
+}
+
+/**
+ *  Marks edit buffer contents as unknown, for example after device
+ *  loaded another preset. Single parameter values are kept.
+ **/
+void edit_buffer_invalidate()
+{
+    G_LOCK(edit_buffer);
+    edit_buffer.complete = FALSE;
+    G_UNLOCK(edit_buffer);
+}
+
+/**
+ *  Creates preset out of edit buffer, without asking device.
+ *
+ *  \return Preset which must be freed using preset_free, or NULL if
+ *          edit buffer contents are not completely known.
+ **/
+Preset *edit_buffer_get_preset()
+{
+    Preset *preset;
+    SettingParam param;
+    GHashTableIter iter;
+    gpointer key, value;
+    gint x;
+
+    G_LOCK(edit_buffer);
+    if (!edit_buffer.complete) {
+        G_UNLOCK(edit_buffer);
+        return NULL;
+    }
+
+    preset = preset_new();
+    preset->name = g_strdup(edit_buffer.name);
+
+    for (x = 0; x < n_xml_settings; x++) {
+        if (edit_buffer.flags[x] & EDIT_BUFFER_IN_PRESET) {
+            param.id = xml_settings[x].id;
+            param.position = xml_settings[x].position;
+            param.value = edit_buffer.values[x];
+            g_array_append_val(preset->params, param);
+        }
+    }
+
+    g_hash_table_iter_init(&iter, edit_buffer.extra);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        param.id = GPOINTER_TO_UINT(key) & 0xFFFF;
+        param.position = GPOINTER_TO_UINT(key) >> 16;
+        param.value = GPOINTER_TO_UINT(value);
+        g_array_append_val(preset->params, param);
+    }
+    G_UNLOCK(edit_buffer);
+
+    g_array_sort(preset->params, params_cmp);
+
+    return preset;
+}
+
+/**
+ *  \param preset edit buffer as read from device
+ *
+ *  Compares edit buffer with preset read from device, warns about every
+ *  difference and then replaces edit buffer with preset.
+ *
+ *  \return number of differences found.
+ **/
+gint edit_buffer_verify(Preset *preset)
+{
+    Preset *shadow;
+    GArray *diffs;
+    guint i;
+    gint differences;
+
+    g_return_val_if_fail(preset != NULL, 0);
+
+    shadow = edit_buffer_get_preset();
+    if (shadow == NULL) {
+        debug_msg(DEBUG_VERBOSE, "Edit buffer not known, nothing to verify");
+        edit_buffer_set_preset(preset);
+        return 0;
+    }
+
+    diffs = preset_diff(shadow, preset);
+    for (i = 0; i < diffs->len; i++) {
+        ParamDiff *diff = &g_array_index(diffs, ParamDiff, i);
+
+        if (diff->in_a && diff->in_b) {
+            g_warning("Edit buffer mismatch: ID %d position %d "
+                      "value %d, device has %d",
+                      diff->id, diff->position,
+                      diff->value_a, diff->value_b);
+        } else if (diff->in_a) {
+            g_warning("Edit buffer mismatch: ID %d position %d "
+                      "not in device preset", diff->id, diff->position);
+        } else {
+            g_warning("Edit buffer mismatch: ID %d position %d "
+                      "missing", diff->id, diff->position);
+        }
+    }
+    differences = diffs->len;
+    g_array_free(diffs, TRUE);
+
+    if (g_strcmp0(shadow->name, preset->name) != 0) {
+        g_warning("Edit buffer mismatch: name \"%s\", device has \"%s\"",
+                  shadow->name, preset->name);
+        differences++;
+    }
+
+    preset_free(shadow);
+    edit_buffer_set_preset(preset);
+
+    return differences;
+}
+
+/**
+ *  \param preset preset about to be loaded into edit buffer
+ *  \param changed location to store list of SettingParam from preset
+ *                 which differ from edit buffer. List must be freed
+ *                 using g_list_free, its data belongs to preset.
+ *
+ *  Finds parameters that need to be sent to turn edit buffer into preset.
+ *
+ *  \return number of changed parameters, or -1 if edit buffer can't be
+ *          turned into preset by setting single parameters.
+ **/
+gint edit_buffer_diff(Preset *preset, GList **changed)
+{
+    guint i;
+    gint n_changed = 0;
+    gint n_params = 0;
+    gint x;
+
+    g_return_val_if_fail(preset != NULL, -1);
+    g_return_val_if_fail(changed != NULL, -1);
+
+    *changed = NULL;
+
+    G_LOCK(edit_buffer);
+    if (!edit_buffer.complete) {
+        G_UNLOCK(edit_buffer);
+        return -1;
+    }
+
+    for (i = 0; i < preset->params->len; i++) {
+        SettingParam *param = &g_array_index(preset->params, SettingParam, i);
+
+        x = edit_buffer_index(param->id, param->position);
+        if (x < 0 || !(edit_buffer.flags[x] & EDIT_BUFFER_IN_PRESET)) {
+            /* parameter set differs */
+            break;
+        }
+
+        n_params++;
+        if (edit_buffer.values[x] == param->value)
+            continue;
+
+        /* changing effect type resets other parameters on device */
+        if (xml_settings[x].xml_labels != NULL &&
+            xml_settings[x].values != &values_on_off)
+            break;
+
+        *changed = g_list_prepend(*changed, param);
+        n_changed++;
+    }
+
+    if (i == preset->params->len && g_hash_table_size(edit_buffer.extra) == 0) {
+        /* check that edit buffer has no parameters missing in preset */
+        for (x = 0; x < n_xml_settings; x++) {
+            if (edit_buffer.flags[x] & EDIT_BUFFER_IN_PRESET)
+                n_params--;
+        }
+    } else {
+        n_params = -1;
+    }
+    G_UNLOCK(edit_buffer);
+
+    if (n_params != 0) {
+        g_list_free(*changed);
+        *changed = NULL;
+        return -1;
+    }
+
+    *changed = g_list_reverse(*changed);
+
+    return n_changed;
+}
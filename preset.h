@@ -21,12 +21,33 @@
 
 typedef struct {
     gchar *name;
-    GList *params;
+    GArray *params;     /**< SettingParam, sorted using params_cmp() */
     GList *genetxs;
 } Preset;
 
+typedef struct {
+    guint id;
+    guint position;
+    gboolean in_a;      /**< parameter present in first preset */
+    gboolean in_b;      /**< parameter present in second preset */
+    guint value_a;
+    guint value_b;
+} ParamDiff;
+
+Preset *preset_new();
 Preset *create_preset_from_xml_file(gchar *filename, GError **error);
 Preset *create_preset_from_data(GList *list);
 void preset_free(Preset *preset);
+gint params_cmp(gconstpointer a, gconstpointer b);
+GArray *preset_diff(Preset *a, Preset *b);
 void write_preset_to_xml(Preset *preset, gchar *filename);
+
+void edit_buffer_set_param(guint id, guint position, guint value);
+gboolean edit_buffer_get_param(guint id, guint position, guint *value);
+void edit_buffer_set_preset(Preset *preset);
+void edit_buffer_set_name(const gchar *name);
+void edit_buffer_invalidate();
+Preset *edit_buffer_get_preset();
+gint edit_buffer_verify(Preset *preset);
+gint edit_buffer_diff(Preset *preset, GList **changed);
 #endif /* GDIGI_PRESET_H */
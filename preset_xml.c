@@ -31,6 +31,105 @@ extern XmlSettings xml_settings[];
 extern guint n_xml_settings;
 extern EffectValues values_on_off;
 
+/** xml_settings index size, power of two well above n_xml_settings */
+#define XML_INDEX_SIZE 1024
+/** label groups spread wider than this are searched linearly */
+#define MAX_LABEL_MAP_LEN 1024
+
+/** open addressing hash of (position << 16) | id, stores index + 1 */
+static guint16 xml_index[XML_INDEX_SIZE];
+
+static inline guint xml_index_hash(guint key)
+{
+    /* Fibonacci hashing, XML_INDEX_SIZE is 2^10 */
+    return (key * 2654435769U) >> (32 - 10);
+}
+
+/**
+ *  \param xml settings with label group
+ *  \param maps already built label maps, keyed by label group
+ *
+ *  Builds label map so labels can be looked up by value directly.
+ **/
+static void xml_label_map_build(XmlSettings *xml, GHashTable *maps)
+{
+    gint min, max;
+    guint i;
+    gchar **map;
+
+    min = max = xml->xml_labels[0].type;
+    for (i = 1; i < xml->xml_labels_amt; i++) {
+        min = MIN(min, (gint)xml->xml_labels[i].type);
+        max = MAX(max, (gint)xml->xml_labels[i].type);
+    }
+
+    if (max - min + 1 > MAX_LABEL_MAP_LEN)
+        return;
+
+    map = g_hash_table_lookup(maps, xml->xml_labels);
+    if (map == NULL) {
+        map = g_new0(gchar *, max - min + 1);
+        /* first label wins, as it did with linear search */
+        for (i = xml->xml_labels_amt; i > 0; i--) {
+            map[xml->xml_labels[i - 1].type - min] =
+                xml->xml_labels[i - 1].label;
+        }
+        g_hash_table_insert(maps, xml->xml_labels, map);
+    }
+
+    xml->label_min = min;
+    xml->label_map_len = max - min + 1;
+    xml->label_map = map;
+}
+
+/**
+ *  Builds xml_settings index and label maps. Called once.
+ **/
+static gpointer xml_index_build(gpointer data)
+{
+    GHashTable *maps = g_hash_table_new(g_direct_hash, g_direct_equal);
+    guint x, probes, max_probes = 0;
+
+    g_assert(n_xml_settings < XML_INDEX_SIZE / 2);
+
+    for (x = 0; x < n_xml_settings; x++) {
+        guint key = (xml_settings[x].position << 16) | xml_settings[x].id;
+        guint h = xml_index_hash(key);
+
+        for (probes = 0; xml_index[h] != 0; probes++) {
+            XmlSettings *xml = &xml_settings[xml_index[h] - 1];
+            if (xml->id == xml_settings[x].id &&
+                xml->position == xml_settings[x].position)
+                break;
+            h = (h + 1) & (XML_INDEX_SIZE - 1);
+        }
+
+        /* keep first of duplicated entries */
+        if (xml_index[h] == 0)
+            xml_index[h] = x + 1;
+        max_probes = MAX(max_probes, probes);
+
+        if (xml_settings[x].xml_labels != NULL &&
+            xml_settings[x].xml_labels_amt > 0)
+            xml_label_map_build(&xml_settings[x], maps);
+    }
+
+    /* maps are referenced from xml_settings for program lifetime */
+    g_hash_table_destroy(maps);
+
+    debug_msg(DEBUG_VERBOSE, "xml_settings index: %d entries, "
+              "longest probe %d", n_xml_settings, max_probes);
+
+    return NULL;
+}
+
+static inline void xml_index_init()
+{
+    static GOnce once = G_ONCE_INIT;
+
+    g_once(&once, xml_index_build, NULL);
+}
+
 /**
  *  \param id modifier ID
  *  \param position modifier position
@@ -41,11 +140,16 @@ extern EffectValues values_on_off;
 */
 XmlSettings *get_xml_settings (guint id, guint position)
 {
-    gint x;
+    guint key = (position << 16) | id;
+    guint h;
+
+    xml_index_init();
 
-    for (x=0; x< n_xml_settings; x++) {
-        if ((xml_settings[x].id == id) && (xml_settings[x].position == position)) {
-            return xml_settings + x;
+    for (h = xml_index_hash(key); xml_index[h] != 0;
+         h = (h + 1) & (XML_INDEX_SIZE - 1)) {
+        XmlSettings *xml = &xml_settings[xml_index[h] - 1];
+        if (xml->id == id && xml->position == position) {
+            return xml;
         }
     }
 
@@ -66,12 +170,17 @@ map_xml_value (XmlSettings *xml, EffectValues *values,  gint value)
             g_warning("%s value %d out of range %0.1f %0.1f",
                       xml->label, value, xml->values->min, xml->values->max);
         } 
+        xml_index_init();
+        if (xml->label_map != NULL) {
+            guint i = value - xml->label_min;
+
+            return (i < xml->label_map_len) ? xml->label_map[i] : NULL;
+        }
         {
             XmlLabel *labels = xml->xml_labels;
             guint labels_amt = xml->xml_labels_amt;
             gint i;
 
-            // Maybe this can be a computation: i = xml->values->min + val
             for (i = 0; i < labels_amt; i++) {
                 if (labels[i].type  == value) {
                     return (labels[i].label);
@@ -101,7 +210,7 @@ write_preset_to_xml(Preset *preset, gchar *filename)
 
     int rc;
     xmlTextWriterPtr writer;
-    GList *iter_params = preset->params;
+    guint i;
     guint last_id = 0;
     guint last_position = 0;
 
@@ -141,14 +250,13 @@ write_preset_to_xml(Preset *preset, gchar *filename)
 
     rc = xmlTextWriterStartElement(writer, BAD_CAST "Params");
 
-    while (iter_params) {
+    for (i = 0; i < preset->params->len; i++) {
         XmlSettings *xml;
-        SettingParam *param = (SettingParam *) iter_params->data;
+        SettingParam *param = &g_array_index(preset->params, SettingParam, i);
 
         if (param->id == last_id && param->position == last_position) {
             g_warning("Skipping duplicate parameter id %d position %d",
                        last_id, last_position);
-            iter_params  = iter_params->next;
             continue;
         }
 
@@ -246,8 +354,6 @@ write_preset_to_xml(Preset *preset, gchar *filename)
         }
 
         rc = xmlTextWriterEndElement(writer);
-
-        iter_params  = iter_params->next;
     }
 
     rc = xmlTextWriterEndDocument(writer);
@@ -0,0 +1,380 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include "profile.h"
+
+/*
+ * Startup profiler, enabled with --profile-startup. Phases are timed
+ * with monotonic clock. Synchronous phases nest and must be begun and
+ * ended on main context. Asynchronous phases (replies requested during
+ * startup) may overlap and end on any thread.
+ *
+ * Once startup is done and all asynchronous phases ended, phases are
+ * printed and written as Chrome trace (chrome://tracing, Perfetto).
+ */
+
+/** seconds to wait for replies requested during startup */
+#define PROFILE_ASYNC_TIMEOUT 30
+
+typedef struct {
+    gchar *name;
+    gint64 start;       /**< in microseconds since origin */
+    gint64 end;         /**< in microseconds since origin, -1 if running */
+    gint depth;         /**< nesting level, -1 for asynchronous phase */
+} ProfilePhase;
+
+G_LOCK_DEFINE_STATIC(profile);
+static gboolean profile_enabled = FALSE;
+static gchar *profile_trace_file = NULL;
+static gint64 profile_origin = 0;
+static gint64 profile_window_time = -1;   /**< when startup was done */
+static GArray *profile_phases = NULL;     /**< ProfilePhase */
+static GArray *profile_stack = NULL;      /**< indexes of open phases */
+static guint profile_async_open = 0;
+static gboolean profile_done = FALSE;     /**< profile_startup_done() called */
+static guint profile_timeout_source = 0;
+
+/**
+ *  \param trace_file file to write Chrome trace to
+ *  \param start_time monotonic time of process start
+ *
+ *  Enables profiler. Phases are measured from start_time.
+ **/
+void profile_init(const gchar *trace_file, gint64 start_time)
+{
+    G_LOCK(profile);
+    profile_enabled = TRUE;
+    profile_trace_file = g_strdup(trace_file);
+    profile_origin = start_time;
+    profile_phases = g_array_new(FALSE, FALSE, sizeof(ProfilePhase));
+    profile_stack = g_array_new(FALSE, FALSE, sizeof(guint));
+    G_UNLOCK(profile);
+}
+
+/**
+ *  \return current time in microseconds since origin.
+ **/
+static gint64 profile_now()
+{
+    return g_get_monotonic_time() - profile_origin;
+}
+
+/**
+ *  \param name phase name (taken over)
+ *  \param depth nesting level, -1 for asynchronous phase
+ *
+ *  Records phase start. Must be called with profile lock held.
+ **/
+static void profile_add(gchar *name, gint depth)
+{
+    ProfilePhase phase;
+
+    phase.name = name;
+    phase.start = profile_now();
+    phase.end = -1;
+    phase.depth = depth;
+    g_array_append_val(profile_phases, phase);
+}
+
+/**
+ *  \param format printf-like phase name
+ *
+ *  Starts synchronous phase, nested in currently running one.
+ *  Must be called from main context.
+ **/
+void profile_begin(const gchar *format, ...)
+{
+    va_list args;
+    gchar *name;
+    guint index;
+
+    if (!profile_enabled)
+        return;
+
+    va_start(args, format);
+    name = g_strdup_vprintf(format, args);
+    va_end(args);
+
+    G_LOCK(profile);
+    if (!profile_enabled) {
+        /* finished meanwhile */
+        G_UNLOCK(profile);
+        g_free(name);
+        return;
+    }
+    index = profile_phases->len;
+    profile_add(name, profile_stack->len);
+    g_array_append_val(profile_stack, index);
+    G_UNLOCK(profile);
+}
+
+/**
+ *  Ends most recently started synchronous phase.
+ **/
+void profile_end()
+{
+    if (!profile_enabled)
+        return;
+
+    G_LOCK(profile);
+    if (profile_enabled && profile_stack->len > 0) {
+        guint index = g_array_index(profile_stack, guint,
+                                    profile_stack->len - 1);
+        g_array_index(profile_phases, ProfilePhase, index).end = profile_now();
+        g_array_set_size(profile_stack, profile_stack->len - 1);
+    }
+    G_UNLOCK(profile);
+}
+
+/**
+ *  \param format printf-like phase name
+ *
+ *  Starts asynchronous phase, ended by profile_async_end() with the
+ *  same name.
+ **/
+void profile_async_begin(const gchar *format, ...)
+{
+    va_list args;
+    gchar *name;
+
+    if (!profile_enabled)
+        return;
+
+    va_start(args, format);
+    name = g_strdup_vprintf(format, args);
+    va_end(args);
+
+    G_LOCK(profile);
+    if (!profile_enabled) {
+        G_UNLOCK(profile);
+        g_free(name);
+        return;
+    }
+    profile_add(name, -1);
+    profile_async_open++;
+    G_UNLOCK(profile);
+}
+
+/**
+ *  \param data unused
+ *
+ *  Finishes profiling once startup is over.
+ *
+ *  \return FALSE, so the source is removed.
+ **/
+static gboolean profile_finish_cb(gpointer data)
+{
+    profile_finish();
+    return FALSE;
+}
+
+/**
+ *  \param format printf-like phase name
+ *
+ *  Ends asynchronous phase. Does nothing if there is no running
+ *  asynchronous phase with that name. Can be called from any thread.
+ **/
+void profile_async_end(const gchar *format, ...)
+{
+    va_list args;
+    gchar *name;
+    guint i;
+
+    if (!profile_enabled)
+        return;
+
+    va_start(args, format);
+    name = g_strdup_vprintf(format, args);
+    va_end(args);
+
+    G_LOCK(profile);
+    for (i = 0; profile_enabled && i < profile_phases->len; i++) {
+        ProfilePhase *phase = &g_array_index(profile_phases, ProfilePhase, i);
+
+        if (phase->depth == -1 && phase->end == -1 &&
+            g_strcmp0(phase->name, name) == 0) {
+            phase->end = profile_now();
+            if (--profile_async_open == 0 && profile_done)
+                g_idle_add(profile_finish_cb, NULL);
+            break;
+        }
+    }
+    G_UNLOCK(profile);
+
+    g_free(name);
+}
+
+/**
+ *  Marks main window as ready. Profile is finished as soon as all
+ *  asynchronous phases end, or after PROFILE_ASYNC_TIMEOUT seconds.
+ *  Must be called from main context.
+ **/
+void profile_startup_done()
+{
+    if (!profile_enabled)
+        return;
+
+    G_LOCK(profile);
+    if (!profile_enabled) {
+        G_UNLOCK(profile);
+        return;
+    }
+    profile_window_time = profile_now();
+    profile_done = TRUE;
+    if (profile_async_open == 0) {
+        g_idle_add(profile_finish_cb, NULL);
+    } else {
+        profile_timeout_source = g_timeout_add_seconds(PROFILE_ASYNC_TIMEOUT,
+                                                       profile_finish_cb,
+                                                       NULL);
+    }
+    G_UNLOCK(profile);
+}
+
+/**
+ *  \param json string to append to
+ *  \param str string to append as JSON string literal
+ **/
+static void profile_append_json_string(GString *json, const gchar *str)
+{
+    g_string_append_c(json, '"');
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            g_string_append_printf(json, "\\%c", *str);
+        else if ((guchar) *str < 0x20)
+            g_string_append_printf(json, "\\u%04x", (guchar) *str);
+        else
+            g_string_append_c(json, *str);
+    }
+    g_string_append_c(json, '"');
+}
+
+/**
+ *  Writes recorded phases as Chrome trace. Must be called with profile
+ *  lock held.
+ **/
+static void profile_write_trace()
+{
+    GError *error = NULL;
+    GString *json = g_string_new("{\"displayTimeUnit\": \"ms\", "
+                                 "\"traceEvents\": [\n");
+    guint i;
+
+    for (i = 0; i < profile_phases->len; i++) {
+        ProfilePhase *phase = &g_array_index(profile_phases, ProfilePhase, i);
+        gint64 end = (phase->end != -1) ? phase->end : profile_now();
+
+        if (i > 0)
+            g_string_append(json, ",\n");
+
+        if (phase->depth >= 0) {
+            g_string_append(json, "{\"name\": ");
+            profile_append_json_string(json, phase->name);
+            g_string_append_printf(json, ", \"cat\": \"startup\", "
+                                   "\"ph\": \"X\", \"ts\": %" G_GINT64_FORMAT
+                                   ", \"dur\": %" G_GINT64_FORMAT
+                                   ", \"pid\": 1, \"tid\": 1}",
+                                   phase->start, end - phase->start);
+        } else {
+            /* asynchronous phases overlap, so each one gets own ID */
+            g_string_append(json, "{\"name\": ");
+            profile_append_json_string(json, phase->name);
+            g_string_append_printf(json, ", \"cat\": \"reply\", \"ph\": \"b\", "
+                                   "\"id\": %d, \"ts\": %" G_GINT64_FORMAT
+                                   ", \"pid\": 1, \"tid\": 1},\n", i,
+                                   phase->start);
+            g_string_append(json, "{\"name\": ");
+            profile_append_json_string(json, phase->name);
+            g_string_append_printf(json, ", \"cat\": \"reply\", \"ph\": \"e\", "
+                                   "\"id\": %d, \"ts\": %" G_GINT64_FORMAT
+                                   ", \"pid\": 1, \"tid\": 1}", i, end);
+        }
+    }
+    g_string_append(json, "\n]}\n");
+
+    if (!g_file_set_contents(profile_trace_file, json->str, json->len,
+                             &error)) {
+        g_warning("Failed to write startup trace: %s", error->message);
+        g_error_free(error);
+    } else {
+        printf("Startup trace written to %s\n", profile_trace_file);
+    }
+
+    g_string_free(json, TRUE);
+}
+
+/**
+ *  Prints recorded phases, writes Chrome trace and disables profiler.
+ *  Does nothing if profiler is not enabled or already finished.
+ *  Must be called from main context.
+ **/
+void profile_finish()
+{
+    guint i;
+
+    if (!profile_enabled)
+        return;
+
+    G_LOCK(profile);
+    if (!profile_enabled) {
+        G_UNLOCK(profile);
+        return;
+    }
+    profile_enabled = FALSE;
+
+    if (profile_timeout_source != 0) {
+        g_source_remove(profile_timeout_source);
+        profile_timeout_source = 0;
+    }
+
+    printf("Startup profile (ms since start):\n");
+    printf("%9s %9s  %s\n", "start", "duration", "phase");
+    for (i = 0; i < profile_phases->len; i++) {
+        ProfilePhase *phase = &g_array_index(profile_phases, ProfilePhase, i);
+
+        if (phase->end == -1) {
+            printf("%9.1f %9s  %*s%s (unfinished)\n",
+                   phase->start / 1000.0, "-",
+                   MAX(phase->depth, 0) * 2, "", phase->name);
+        } else {
+            printf("%9.1f %9.1f  %*s%s%s\n",
+                   phase->start / 1000.0,
+                   (phase->end - phase->start) / 1000.0,
+                   MAX(phase->depth, 0) * 2, "", phase->name,
+                   phase->depth < 0 ? " (reply)" : "");
+        }
+    }
+    if (profile_window_time >= 0) {
+        printf("Main window ready after %.1f ms, startup finished after "
+               "%.1f ms\n", profile_window_time / 1000.0,
+               profile_now() / 1000.0);
+    }
+
+    profile_write_trace();
+
+    for (i = 0; i < profile_phases->len; i++) {
+        g_free(g_array_index(profile_phases, ProfilePhase, i).name);
+    }
+    g_array_free(profile_phases, TRUE);
+    profile_phases = NULL;
+    g_array_free(profile_stack, TRUE);
+    profile_stack = NULL;
+    g_free(profile_trace_file);
+    profile_trace_file = NULL;
+    G_UNLOCK(profile);
+}
@@ -0,0 +1,30 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef GDIGI_PROFILE_H
+#define GDIGI_PROFILE_H
+
+#include <glib.h>
+
+void profile_init(const gchar *trace_file, gint64 start_time);
+void profile_begin(const gchar *format, ...) G_GNUC_PRINTF(1, 2);
+void profile_end();
+void profile_async_begin(const gchar *format, ...) G_GNUC_PRINTF(1, 2);
+void profile_async_end(const gchar *format, ...) G_GNUC_PRINTF(1, 2);
+void profile_startup_done();
+void profile_finish();
+
+#endif /* GDIGI_PROFILE_H */
@@ -0,0 +1,1432 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include "gdigi.h"
+#include "gdigi_xml.h"
+#include "effects.h"
+#include "transport.h"
+#include "simulator.h"
+
+/*
+ * Virtual device, used by sim: and loopback: transports. It speaks the
+ * SysEx protocol of one of supported_devices on its own thread, through
+ * device end of a socketpair or in-memory link.
+ *
+ * Presets hold every parameter found on device pages (plus modifier
+ * parameters from xml_settings), with ranges taken from xml_settings.
+ * Replies can be delayed, throttled, corrupted and dropped to mimic slow
+ * or lossy links. Random numbers are seeded with product ID, so runs repeat.
+ */
+
+extern Device *supported_devices[];
+extern int n_supported_devices;
+extern XmlSettings xml_settings[];
+extern guint n_xml_settings;
+extern EffectValues values_on_off;
+
+/** presets in every bank, unless given with presets= */
+#define SIMULATOR_PRESETS 20
+/** most bytes written at once when bandwidth is limited */
+#define SIMULATOR_CHUNK 32
+/** parameters per RECEIVE_PRESET_PARAMETERS, host reads low byte of count */
+#define SIMULATOR_PARAMS_PER_MESSAGE 255
+#define SIMULATOR_INPUT_SIZE 256
+
+/* reported in RECEIVE_WHO_AM_I and RECEIVE_DEVICE_CONFIGURATION */
+#define SIMULATOR_DEVICE_ID 0x00
+#define SIMULATOR_OS_MAJOR 1
+#define SIMULATOR_OS_MINOR 0x03     /* BCD */
+#define SIMULATOR_CPU_MAJOR 1
+#define SIMULATOR_CPU_MINOR 0
+#define SIMULATOR_PROTOCOL 1
+
+/** modifier group ID sent in NOTIFY_MODIFIER_GROUP_CHANGED */
+#define SIMULATOR_MODIFIER_GROUP 1
+
+#define PARAM_KEY(id, position) GUINT_TO_POINTER(((position) << 16) | (id))
+
+typedef struct {
+    guint id;
+    guint position;
+    gint min;
+    gint max;
+    gint def;           /**< value in new presets */
+    gboolean on_off;    /**< effect switch, random in new presets */
+    gboolean linking;   /**< effect switch or type, changes linkable list */
+} SimParam;
+
+typedef struct {
+    gchar *name;
+    gint *values;       /**< one per preset parameter */
+} SimPreset;
+
+typedef struct {
+    guint bank;
+    SimPreset *presets;
+    guint n_presets;
+} SimBank;
+
+typedef struct {
+    gint64 due;         /**< monotonic time writing may start */
+    GString *data;
+    gsize sent;
+} SimPacket;
+
+struct _Simulator {
+    Device *device;
+    Transport *transport;       /**< device end of link to host */
+    GThread *thread;
+    GRand *rand;
+
+    gint64 latency;             /**< reply delay in microseconds */
+    gint64 jitter;              /**< random extra delay in microseconds */
+    guint bandwidth;            /**< bytes per second, 0 if unlimited */
+    gdouble drop;               /**< percent of replies dropped */
+    gdouble corrupt;            /**< percent of replies with a flipped bit */
+    guint n_presets;            /**< presets in every bank */
+
+    GArray *params;             /**< SimParam stored in presets */
+    GArray *globals;            /**< SimParam of global parameters */
+    gint *global_values;
+    GHashTable *index;          /**< key -> index + 1 into params */
+    GHashTable *global_index;   /**< key -> index + 1 into globals */
+
+    SimPreset edit;             /**< edit buffer */
+    gboolean modified;
+    guint current_bank;
+    guint current_preset;
+    SimBank *banks;
+    gint n_banks;
+
+    SimPreset *incoming;        /**< preset being sent by host */
+    guint incoming_bank;
+    guint incoming_index;
+
+    GString *input;             /**< SysEx message being received */
+    gboolean in_sysex;
+    GQueue *output;             /**< SimPacket waiting to be written */
+    gint64 last_due;
+    gint64 send_clock;          /**< earliest time of next write */
+
+    guint messages_in;
+    guint messages_out;
+    guint messages_dropped;
+    guint messages_corrupted;
+    guint64 bytes_out;
+};
+
+/**
+ *  \param name device model, as in "RP355", or empty string
+ *
+ *  \return matching supported device, first one if name is empty, or
+ *          NULL if there is no such device.
+ **/
+static Device *simulator_find_device(const gchar *name)
+{
+    gint x;
+
+    if (*name == '\0')
+        return supported_devices[0];
+
+    for (x = 0; x < n_supported_devices; x++) {
+        const gchar *model = strrchr(supported_devices[x]->name, ' ');
+
+        model = (model != NULL) ? model + 1 : supported_devices[x]->name;
+        if (g_ascii_strcasecmp(model, name) == 0)
+            return supported_devices[x];
+    }
+
+    return NULL;
+}
+
+/**
+ *  \param sim simulator
+ *  \param spec "<device>[,<option>=<value>...]"
+ *
+ *  Parses --simulate value.
+ *
+ *  \return TRUE on success, FALSE if spec is not valid.
+ **/
+static gboolean simulator_parse_spec(Simulator *sim, const gchar *spec)
+{
+    gchar **tokens = g_strsplit(spec, ",", -1);
+    gboolean ok = TRUE;
+    gint i;
+
+    sim->device = supported_devices[0];
+
+    for (i = 0; ok && tokens[i] != NULL; i++) {
+        gchar *token = g_strstrip(tokens[i]);
+        gchar *value = strchr(token, '=');
+        gchar *end;
+        gdouble number;
+
+        if (value == NULL && i == 0) {
+            sim->device = simulator_find_device(token);
+            if (sim->device == NULL) {
+                g_warning("Can't simulate unknown device %s", token);
+                ok = FALSE;
+            }
+            continue;
+        }
+
+        if (value == NULL) {
+            g_warning("Simulator option %s has no value", token);
+            ok = FALSE;
+            continue;
+        }
+
+        *value++ = '\0';
+        number = g_ascii_strtod(value, &end);
+        if (end == value || *end != '\0' || number < 0) {
+            g_warning("Invalid value %s of simulator option %s", value, token);
+            ok = FALSE;
+        } else if (strcmp(token, "latency") == 0) {
+            sim->latency = number * 1000;
+        } else if (strcmp(token, "jitter") == 0) {
+            sim->jitter = MIN(number * 1000, G_MAXINT32 - 1);
+        } else if (strcmp(token, "bandwidth") == 0) {
+            sim->bandwidth = number;
+        } else if (strcmp(token, "drop") == 0) {
+            sim->drop = number;
+        } else if (strcmp(token, "corrupt") == 0) {
+            sim->corrupt = number;
+        } else if (strcmp(token, "presets") == 0) {
+            sim->n_presets = CLAMP(number, 1, 99);
+        } else {
+            g_warning("Unknown simulator option %s", token);
+            ok = FALSE;
+        }
+    }
+
+    g_strfreev(tokens);
+    return ok;
+}
+
+/**
+ *  \param sim simulator
+ *  \param id parameter ID
+ *  \param position parameter position
+ *  \param values values given on device page, used if parameter is not
+ *                in xml_settings
+ *
+ *  Adds parameter to presets, or to global parameters.
+ *
+ *  \return new parameter, or NULL if it was already added.
+ **/
+static SimParam *simulator_add_param(Simulator *sim, guint id, guint position,
+                                     EffectValues *values)
+{
+    gboolean global = (position == GLOBAL_POSITION);
+    GArray *params = global ? sim->globals : sim->params;
+    GHashTable *index = global ? sim->global_index : sim->index;
+    XmlSettings *xml;
+    SimParam param;
+    gdouble min = 0.0, max = 0.0;
+    gboolean custom;
+
+    if (g_hash_table_lookup(index, PARAM_KEY(id, position)) != NULL)
+        return NULL;
+
+    xml = get_xml_settings(id, position);
+    if (xml != NULL && xml->values != NULL)
+        values = xml->values;
+    if (values != NULL)
+        get_values_info(values, &min, &max, &custom);
+
+    param.id = id;
+    param.position = position;
+    param.min = min;
+    param.max = max;
+    param.def = min;
+    param.on_off = FALSE;
+    param.linking = FALSE;
+
+    g_array_append_val(params, param);
+    g_hash_table_insert(index, PARAM_KEY(id, position),
+                        GUINT_TO_POINTER(params->len));
+
+    return &g_array_index(params, SimParam, params->len - 1);
+}
+
+/**
+ *  \param sim simulator
+ *
+ *  Collects parameters of every effect on device pages.
+ **/
+static void simulator_build_schema(Simulator *sim)
+{
+    Device *device = sim->device;
+    GHashTable *positions = g_hash_table_new(g_direct_hash, g_direct_equal);
+    gint p, l, e, g, s;
+    guint x;
+
+    for (p = 0; p < device->n_pages; p++) {
+        EffectPage *page = &device->pages[p];
+
+        for (l = 0; l < page->n_effects; l++) {
+            EffectList *list = &page->effects[l];
+
+            for (e = 0; e < list->amt; e++) {
+                Effect *effect = &list->effect[e];
+                SimParam *param;
+
+                g_hash_table_insert(positions,
+                                    GUINT_TO_POINTER(effect->position),
+                                    GINT_TO_POINTER(TRUE));
+
+                if (effect->id != (guint) -1) {
+                    param = simulator_add_param(sim, effect->id,
+                                                effect->position,
+                                                &values_on_off);
+                    if (param != NULL) {
+                        param->def = 1;
+                        param->on_off = TRUE;
+                        param->linking = TRUE;
+                    }
+                }
+
+                for (g = 0; effect->group != NULL && g < effect->group_amt; g++) {
+                    EffectGroup *group = &effect->group[g];
+
+                    /* labelled groups are choices of effect type */
+                    if (group->label != NULL) {
+                        param = simulator_add_param(sim, effect->type,
+                                                    effect->position, NULL);
+                        if (param != NULL) {
+                            param->def = group->type;
+                            param->linking = TRUE;
+                        }
+                    }
+
+                    for (s = 0; group->settings != NULL &&
+                                s < group->settings_amt; s++) {
+                        EffectSettings *setting = &group->settings[s];
+
+                        if (setting->id == (guint) -1)
+                            continue;
+                        simulator_add_param(sim, setting->id,
+                                            setting->position,
+                                            setting->values);
+                    }
+                }
+            }
+        }
+    }
+
+    /* modifier settings are created by GUI from linkable list */
+    for (x = 0; x < n_xml_settings; x++) {
+        XmlSettings *xml = &xml_settings[x];
+
+        if ((xml->position == EXP_POSITION ||
+             xml->position == LFO1_POSITION ||
+             xml->position == LFO2_POSITION) &&
+            g_hash_table_lookup(positions, GUINT_TO_POINTER(xml->position))) {
+            simulator_add_param(sim, xml->id, xml->position, xml->values);
+        }
+    }
+
+    g_hash_table_destroy(positions);
+}
+
+/**
+ *  \param sim simulator
+ *  \param preset preset to initialize
+ *  \param name preset name
+ *
+ *  Fills preset with default values. Effects are switched on at random,
+ *  so presets differ.
+ **/
+static void simulator_preset_init(Simulator *sim, SimPreset *preset,
+                                  gchar *name)
+{
+    guint i;
+
+    preset->name = name;
+    preset->values = g_new(gint, sim->params->len);
+
+    for (i = 0; i < sim->params->len; i++) {
+        SimParam *param = &g_array_index(sim->params, SimParam, i);
+
+        if (param->on_off)
+            preset->values[i] = g_rand_int_range(sim->rand, 0, 2);
+        else
+            preset->values[i] = param->def;
+    }
+}
+
+/**
+ *  \param preset preset to free contents of
+ **/
+static void simulator_preset_clear(SimPreset *preset)
+{
+    g_free(preset->name);
+    g_free(preset->values);
+}
+
+/**
+ *  \param sim simulator
+ *  \param dst preset to overwrite
+ *  \param src preset to copy name and values from
+ **/
+static void simulator_preset_copy(Simulator *sim, SimPreset *dst,
+                                  SimPreset *src)
+{
+    if (dst == src)
+        return;
+
+    g_free(dst->name);
+    dst->name = g_strdup(src->name);
+    memcpy(dst->values, src->values, sim->params->len * sizeof(gint));
+}
+
+/**
+ *  \param sim simulator
+ *
+ *  Creates presets of every bank and loads first one into edit buffer.
+ **/
+static void simulator_build_presets(Simulator *sim)
+{
+    Device *device = sim->device;
+    guint i;
+    gint x;
+
+    sim->banks = g_new0(SimBank, device->n_banks);
+    for (x = 0; x < device->n_banks; x++) {
+        SimBank *bank;
+
+        if (device->banks[x].bank == PRESETS_EDIT_BUFFER)
+            continue;
+
+        bank = &sim->banks[sim->n_banks++];
+        bank->bank = device->banks[x].bank;
+        bank->n_presets = sim->n_presets;
+        bank->presets = g_new(SimPreset, bank->n_presets);
+        for (i = 0; i < bank->n_presets; i++) {
+            simulator_preset_init(sim, &bank->presets[i],
+                                  g_strdup_printf("Preset %d-%02d",
+                                                  bank->bank, i + 1));
+        }
+    }
+
+    sim->global_values = g_new(gint, sim->globals->len);
+    for (i = 0; i < sim->globals->len; i++) {
+        sim->global_values[i] = g_array_index(sim->globals, SimParam, i).def;
+    }
+
+    simulator_preset_init(sim, &sim->edit, g_strdup(""));
+    if (sim->n_banks > 0) {
+        simulator_preset_copy(sim, &sim->edit, &sim->banks[0].presets[0]);
+        sim->current_bank = sim->banks[0].bank;
+    }
+    sim->current_preset = 0;
+    sim->modified = FALSE;
+}
+
+/**
+ *  \param sim simulator
+ *  \param bank preset bank
+ *  \param index preset index
+ *
+ *  \return preset, or NULL if there is no such preset.
+ **/
+static SimPreset *simulator_get_preset(Simulator *sim, guint bank,
+                                       guint index)
+{
+    gint x;
+
+    if (bank == PRESETS_EDIT_BUFFER)
+        return (index == 0) ? &sim->edit : NULL;
+
+    for (x = 0; x < sim->n_banks; x++) {
+        if (sim->banks[x].bank == bank)
+            return (index < sim->banks[x].n_presets) ?
+                   &sim->banks[x].presets[index] : NULL;
+    }
+
+    return NULL;
+}
+
+/**
+ *  \param sim simulator
+ *  \param id parameter ID
+ *  \param position parameter position
+ *
+ *  \return location of parameter value in edit buffer or global
+ *          parameters, or NULL if device has no such parameter.
+ **/
+static gint *simulator_get_value(Simulator *sim, guint id, guint position)
+{
+    guint i;
+
+    i = GPOINTER_TO_UINT(g_hash_table_lookup(sim->index,
+                                             PARAM_KEY(id, position)));
+    if (i != 0)
+        return &sim->edit.values[i - 1];
+
+    i = GPOINTER_TO_UINT(g_hash_table_lookup(sim->global_index,
+                                             PARAM_KEY(id, position)));
+    if (i != 0)
+        return &sim->global_values[i - 1];
+
+    return NULL;
+}
+
+/**
+ *  \param sim simulator
+ *  \param procedure procedure ID
+ *  \param data unpacked message data
+ *  \param len data length
+ *
+ *  Packs message and queues it for writing, unless it is chosen to be
+ *  dropped. Messages chosen to be corrupted get one bit of their packed
+ *  data or checksum flipped. Messages never overtake each other.
+ **/
+static void simulator_send(Simulator *sim, MessageID procedure,
+                           const gchar *data, gsize len)
+{
+    const guchar *src = (const guchar *) data;
+    GString *msg = g_string_sized_new(len + len / 7 + 12);
+    SimPacket *packet;
+    guchar checksum;
+    gint64 due;
+    gsize i, j;
+
+    g_string_append_len(msg, "\xF0\x00\x00\x10", 4);
+    g_string_append_c(msg, SIMULATOR_DEVICE_ID);
+    g_string_append_c(msg, sim->device->family_id);
+    g_string_append_c(msg, sim->device->product_id);
+    g_string_append_c(msg, procedure);
+
+    checksum = 0;
+    for (i = 3; i < msg->len; i++)
+        checksum ^= msg->str[i];
+
+    for (i = 0; i < len; i += 7) {
+        gsize n = MIN(7, len - i);
+        guchar status = 0;
+
+        for (j = 0; j < n; j++)
+            status |= (src[i + j] & 0x80) >> (j + 1);
+        g_string_append_c(msg, status);
+        checksum ^= status;
+
+        for (j = 0; j < n; j++) {
+            g_string_append_c(msg, src[i + j] & 0x7F);
+            checksum ^= src[i + j] & 0x7F;
+        }
+    }
+
+    g_string_append_c(msg, checksum);
+    g_string_append_c(msg, 0xF7);
+
+    sim->messages_out++;
+
+    if (sim->corrupt > 0 &&
+        g_rand_double_range(sim->rand, 0, 100) < sim->corrupt) {
+        gsize pos = g_rand_int_range(sim->rand, 8, msg->len - 1);
+
+        debug_msg(DEBUG_VERBOSE, "Simulator corrupted message 0x%02x",
+                  procedure);
+        msg->str[pos] ^= 0x01;
+        sim->messages_corrupted++;
+    }
+
+    if (sim->drop > 0 && g_rand_double_range(sim->rand, 0, 100) < sim->drop) {
+        debug_msg(DEBUG_VERBOSE, "Simulator dropped message 0x%02x",
+                  procedure);
+        sim->messages_dropped++;
+        g_string_free(msg, TRUE);
+        return;
+    }
+
+    due = g_get_monotonic_time() + sim->latency;
+    if (sim->jitter > 0)
+        due += g_rand_int_range(sim->rand, 0, sim->jitter + 1);
+    due = MAX(due, sim->last_due);
+    sim->last_due = due;
+
+    packet = g_slice_new(SimPacket);
+    packet->due = due;
+    packet->data = msg;
+    packet->sent = 0;
+    g_queue_push_tail(sim->output, packet);
+}
+
+/**
+ *  \param msg message data to append to
+ *  \param id parameter ID
+ *  \param position parameter position
+ *  \param value parameter value
+ **/
+static void simulator_append_param(GString *msg, guint id, guint position,
+                                   gint value)
+{
+    g_string_append_c(msg, (id & 0xFF00) >> 8);
+    g_string_append_c(msg, id & 0xFF);
+    g_string_append_c(msg, position);
+    append_value(msg, value);
+}
+
+/**
+ *  \param str encoded parameter
+ *  \param end end of message data
+ *  \param param return location for decoded parameter
+ *
+ *  \return encoded parameter length, or 0 if it is truncated.
+ **/
+static gsize simulator_decode_param(const guchar *str, const guchar *end,
+                                    SettingParam *param)
+{
+    gsize len = 4;
+    guint value;
+    gint i;
+
+    if (end - str < 4)
+        return 0;
+
+    value = str[3];
+    if (value & 0x80) {
+        gint n = value & 0x7F;
+
+        if (n > sizeof(guint) || end - str < 4 + n)
+            return 0;
+
+        value = 0;
+        for (i = 0; i < n; i++)
+            value = (value << 8) | str[4 + i];
+        len += n;
+    }
+
+    param->id = (str[0] << 8) | str[1];
+    param->position = str[2];
+    param->value = value;
+
+    return len;
+}
+
+/**
+ *  \param sim simulator
+ *
+ *  Tells host that modifier linkable list changed.
+ **/
+static void simulator_notify_group_changed(Simulator *sim)
+{
+    gchar msg[3] = {NOTIFY_MODIFIER_GROUP_CHANGED,
+                    (SIMULATOR_MODIFIER_GROUP & 0xFF00) >> 8,
+                    SIMULATOR_MODIFIER_GROUP & 0xFF};
+
+    simulator_send(sim, RECEIVE_DEVICE_NOTIFICATION, msg, sizeof(msg));
+}
+
+/**
+ *  \param sim simulator
+ *  \param src preset to load
+ *
+ *  Copies preset into edit buffer, notifying host if that changes
+ *  modifier linkable list.
+ **/
+static void simulator_load_edit(Simulator *sim, SimPreset *src)
+{
+    gboolean linked = FALSE;
+    guint i;
+
+    for (i = 0; !linked && i < sim->params->len; i++) {
+        if (g_array_index(sim->params, SimParam, i).linking &&
+            sim->edit.values[i] != src->values[i])
+            linked = TRUE;
+    }
+
+    simulator_preset_copy(sim, &sim->edit, src);
+
+    if (linked)
+        simulator_notify_group_changed(sim);
+}
+
+/**
+ *  \param sim simulator
+ *  \param bank preset bank
+ *  \param index preset index
+ *  \param preset preset to send
+ *  \param modified whether preset differs from stored one
+ *
+ *  Sends RECEIVE_PRESET_START, RECEIVE_PRESET_PARAMETERS and
+ *  RECEIVE_PRESET_END messages.
+ **/
+static void simulator_send_preset(Simulator *sim, guint bank, guint index,
+                                  SimPreset *preset, gboolean modified)
+{
+    guint n = sim->params->len;
+    guint chunks = (n + SIMULATOR_PARAMS_PER_MESSAGE - 1) /
+                   SIMULATOR_PARAMS_PER_MESSAGE;
+    GString *msg = g_string_new(NULL);
+    guint i, j;
+
+    g_string_append_c(msg, bank);
+    g_string_append_c(msg, index);
+    g_string_append_len(msg, preset->name, strlen(preset->name) + 1);
+    g_string_append_c(msg, modified);
+    g_string_append_c(msg, chunks + 1);     /* messages to follow */
+    simulator_send(sim, RECEIVE_PRESET_START, msg->str, msg->len);
+
+    for (i = 0; i < n; i += SIMULATOR_PARAMS_PER_MESSAGE) {
+        guint count = MIN(SIMULATOR_PARAMS_PER_MESSAGE, n - i);
+
+        g_string_truncate(msg, 0);
+        g_string_append_c(msg, (count & 0xFF00) >> 8);
+        g_string_append_c(msg, count & 0xFF);
+        for (j = i; j < i + count; j++) {
+            SimParam *param = &g_array_index(sim->params, SimParam, j);
+
+            simulator_append_param(msg, param->id, param->position,
+                                   preset->values[j]);
+        }
+        simulator_send(sim, RECEIVE_PRESET_PARAMETERS, msg->str, msg->len);
+    }
+
+    simulator_send(sim, RECEIVE_PRESET_END, NULL, 0);
+    g_string_free(msg, TRUE);
+}
+
+/**
+ *  \param sim simulator
+ *  \param data REQUEST_PRESET_NAMES data
+ *  \param len data length
+ **/
+static void simulator_send_preset_names(Simulator *sim, const guchar *data,
+                                        gsize len)
+{
+    SimBank *bank = NULL;
+    GString *msg;
+    guint i;
+    gint x;
+
+    for (x = 0; len >= 1 && x < sim->n_banks; x++) {
+        if (sim->banks[x].bank == data[0])
+            bank = &sim->banks[x];
+    }
+
+    if (bank == NULL) {
+        simulator_send(sim, NACK, NULL, 0);
+        return;
+    }
+
+    msg = g_string_new(NULL);
+    g_string_append_c(msg, bank->bank);
+    g_string_append_c(msg, bank->n_presets);
+    for (i = 0; i < bank->n_presets; i++) {
+        g_string_append_len(msg, bank->presets[i].name,
+                            strlen(bank->presets[i].name) + 1);
+    }
+    simulator_send(sim, RECEIVE_PRESET_NAMES, msg->str, msg->len);
+    g_string_free(msg, TRUE);
+}
+
+/**
+ *  \param sim simulator
+ *
+ *  Sends user presets as bulk dump.
+ **/
+static void simulator_send_bulk_dump(Simulator *sim)
+{
+    guint chunks = (sim->params->len + SIMULATOR_PARAMS_PER_MESSAGE - 1) /
+                   SIMULATOR_PARAMS_PER_MESSAGE;
+    SimBank *bank = NULL;
+    guint count = 1;    /* RECEIVE_BULK_DUMP_END */
+    gchar msg[2];
+    guint i;
+    gint x;
+
+    for (x = 0; x < sim->n_banks; x++) {
+        if (sim->banks[x].bank == PRESETS_USER)
+            bank = &sim->banks[x];
+    }
+
+    if (bank != NULL)
+        count += bank->n_presets * (chunks + 2);
+
+    msg[0] = (count & 0xFF00) >> 8;
+    msg[1] = count & 0xFF;
+    simulator_send(sim, RECEIVE_BULK_DUMP_START, msg, sizeof(msg));
+
+    for (i = 0; bank != NULL && i < bank->n_presets; i++) {
+        simulator_send_preset(sim, bank->bank, i, &bank->presets[i], FALSE);
+    }
+
+    simulator_send(sim, RECEIVE_BULK_DUMP_END, NULL, 0);
+}
+
+/**
+ *  \param sim simulator
+ *  \param msg message data to append to
+ *  \param seen parameters already listed
+ *  \param count amount of listed parameters
+ *  \param id parameter ID
+ *  \param position parameter position
+ *
+ *  Lists parameter, if it can be linked to modifiers.
+ **/
+static void simulator_link(Simulator *sim, GString *msg, GHashTable *seen,
+                           guint *count, guint id, guint position)
+{
+    if (!modifier_is_linkable(id, position) ||
+        g_hash_table_lookup(seen, PARAM_KEY(id, position)) != NULL)
+        return;
+
+    g_hash_table_insert(seen, PARAM_KEY(id, position), GINT_TO_POINTER(TRUE));
+    g_string_append_c(msg, (id & 0xFF00) >> 8);
+    g_string_append_c(msg, id & 0xFF);
+    g_string_append_c(msg, position);
+    (*count)++;
+}
+
+/**
+ *  \param sim simulator
+ *  \param group_id requested modifier group
+ *
+ *  Sends parameters of enabled effects which can be linked to modifiers.
+ **/
+static void simulator_send_linkable_list(Simulator *sim, guint group_id)
+{
+    Device *device = sim->device;
+    GHashTable *seen = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GString *msg = g_string_new(NULL);
+    guint count = 1;
+    gint p, l, e, g, s;
+
+    g_string_append_c(msg, (group_id & 0xFF00) >> 8);
+    g_string_append_c(msg, group_id & 0xFF);
+    g_string_append_len(msg, "\0\0", 2);       /* count, filled in below */
+    g_string_append_len(msg, "\0\0\0", 3);     /* "None" */
+
+    for (p = 0; p < device->n_pages; p++) {
+        EffectPage *page = &device->pages[p];
+
+        for (l = 0; l < page->n_effects; l++) {
+            EffectList *list = &page->effects[l];
+
+            for (e = 0; e < list->amt; e++) {
+                Effect *effect = &list->effect[e];
+                gint *value;
+
+                if (effect->position == GLOBAL_POSITION)
+                    continue;
+
+                if (effect->id != (guint) -1) {
+                    simulator_link(sim, msg, seen, &count,
+                                   effect->id, effect->position);
+                    value = simulator_get_value(sim, effect->id,
+                                                effect->position);
+                    if (value != NULL && *value == 0)
+                        continue;
+                }
+
+                value = simulator_get_value(sim, effect->type,
+                                            effect->position);
+
+                for (g = 0; effect->group != NULL && g < effect->group_amt; g++) {
+                    EffectGroup *group = &effect->group[g];
+
+                    if (group->label != NULL &&
+                        (value == NULL || *value != group->type))
+                        continue;
+
+                    for (s = 0; group->settings != NULL &&
+                                s < group->settings_amt; s++) {
+                        simulator_link(sim, msg, seen, &count,
+                                       group->settings[s].id,
+                                       group->settings[s].position);
+                    }
+                }
+            }
+        }
+    }
+
+    msg->str[2] = (count & 0xFF00) >> 8;
+    msg->str[3] = count & 0xFF;
+    simulator_send(sim, RECEIVE_MODIFIER_LINKABLE_LIST, msg->str, msg->len);
+
+    g_string_free(msg, TRUE);
+    g_hash_table_destroy(seen);
+}
+
+/**
+ *  \param sim simulator
+ *  \param data MOVE_PRESET data
+ *  \param len data length
+ *
+ *  Copies preset, possibly renaming destination and loading it.
+ **/
+static void simulator_move_preset(Simulator *sim, const guchar *data,
+                                  gsize len)
+{
+    SimPreset *src, *dst;
+    const gchar *name;
+    const gchar *nul;
+    gboolean load;
+
+    if (len < 5) {
+        simulator_send(sim, NACK, NULL, 0);
+        return;
+    }
+
+    src = simulator_get_preset(sim, data[0], data[1]);
+    dst = simulator_get_preset(sim, data[2], data[3]);
+    name = (const gchar *) &data[4];
+    nul = memchr(name, '\0', len - 4);
+
+    if (src == NULL || dst == NULL || nul == NULL) {
+        simulator_send(sim, NACK, NULL, 0);
+        return;
+    }
+    load = ((const guchar *) nul + 1 < data + len) ? nul[1] : FALSE;
+
+    if (dst == &sim->edit) {
+        simulator_load_edit(sim, src);
+        sim->current_bank = data[0];
+        sim->current_preset = data[1];
+    } else {
+        simulator_preset_copy(sim, dst, src);
+    }
+
+    if (*name != '\0') {
+        g_free(dst->name);
+        dst->name = g_strdup(name);
+    }
+
+    if (dst != &sim->edit && load) {
+        simulator_load_edit(sim, dst);
+        sim->current_bank = data[2];
+        sim->current_preset = data[3];
+    }
+
+    if (dst == &sim->edit || load)
+        sim->modified = FALSE;
+}
+
+/**
+ *  \param sim simulator
+ *  \param procedure received procedure ID
+ *  \param data unpacked message data
+ *  \param len data length
+ *
+ *  Handles message sent by host.
+ **/
+static void simulator_handle(Simulator *sim, MessageID procedure,
+                             const guchar *data, gsize len)
+{
+    const guchar *end = data + len;
+    SettingParam param;
+    GString *msg;
+    SimPreset *preset;
+    gint *value;
+    guint i;
+
+    switch (procedure) {
+        case REQUEST_WHO_AM_I:
+        {
+            gchar reply[3] = {SIMULATOR_DEVICE_ID,
+                              sim->device->family_id,
+                              sim->device->product_id};
+
+            simulator_send(sim, RECEIVE_WHO_AM_I, reply, sizeof(reply));
+            break;
+        }
+        case REQUEST_DEVICE_CONFIGURATION:
+        {
+            gchar reply[8] = {SIMULATOR_OS_MAJOR, SIMULATOR_OS_MINOR,
+                              SIMULATOR_CPU_MAJOR, SIMULATOR_CPU_MINOR,
+                              SIMULATOR_PROTOCOL,
+                              sim->current_bank, sim->current_preset,
+                              0 /* no media card */};
+
+            simulator_send(sim, RECEIVE_DEVICE_CONFIGURATION,
+                           reply, sizeof(reply));
+            break;
+        }
+        case REQUEST_GLOBAL_PARAMETERS:
+            msg = g_string_new(NULL);
+            g_string_append_c(msg, (sim->globals->len & 0xFF00) >> 8);
+            g_string_append_c(msg, sim->globals->len & 0xFF);
+            for (i = 0; i < sim->globals->len; i++) {
+                SimParam *global = &g_array_index(sim->globals, SimParam, i);
+
+                simulator_append_param(msg, global->id, global->position,
+                                       sim->global_values[i]);
+            }
+            simulator_send(sim, RECEIVE_GLOBAL_PARAMETERS, msg->str, msg->len);
+            g_string_free(msg, TRUE);
+            break;
+
+        case REQUEST_BULK_DUMP:
+            simulator_send_bulk_dump(sim);
+            break;
+
+        case REQUEST_PRESET_NAMES:
+            simulator_send_preset_names(sim, data, len);
+            break;
+
+        case REQUEST_PRESET:
+            preset = (len >= 2) ? simulator_get_preset(sim, data[0], data[1])
+                                : NULL;
+            if (preset == NULL) {
+                simulator_send(sim, NACK, NULL, 0);
+                break;
+            }
+            simulator_send_preset(sim, data[0], data[1], preset,
+                                  preset == &sim->edit && sim->modified);
+            break;
+
+        case REQUEST_MODIFIER_LINKABLE_LIST:
+            simulator_send_linkable_list(sim, (len >= 2) ?
+                                         (data[0] << 8) | data[1] :
+                                         SIMULATOR_MODIFIER_GROUP);
+            break;
+
+        case REQUEST_PARAMETER_VALUE:
+            value = (len >= 3) ? simulator_get_value(sim,
+                                                     (data[0] << 8) | data[1],
+                                                     data[2])
+                               : NULL;
+            if (value == NULL) {
+                simulator_send(sim, NACK, NULL, 0);
+                break;
+            }
+            msg = g_string_new(NULL);
+            simulator_append_param(msg, (data[0] << 8) | data[1], data[2],
+                                   *value);
+            simulator_send(sim, RECEIVE_PARAMETER_VALUE, msg->str, msg->len);
+            g_string_free(msg, TRUE);
+            break;
+
+        case RECEIVE_PARAMETER_VALUE:
+            if (simulator_decode_param(data, end, &param) == 0)
+                break;
+            value = simulator_get_value(sim, param.id, param.position);
+            if (value == NULL) {
+                debug_msg(DEBUG_VERBOSE, "Simulator ignored parameter "
+                          "id %d position %d", param.id, param.position);
+                break;
+            }
+            if (*value != param.value) {
+                guint index = GPOINTER_TO_UINT(g_hash_table_lookup(
+                                  sim->index,
+                                  PARAM_KEY(param.id, param.position)));
+
+                *value = param.value;
+                if (index != 0) {
+                    sim->modified = TRUE;
+                    if (g_array_index(sim->params, SimParam, index - 1).linking)
+                        simulator_notify_group_changed(sim);
+                }
+            }
+            break;
+
+        case MOVE_PRESET:
+            simulator_move_preset(sim, data, len);
+            break;
+
+        case RECEIVE_PRESET_NAME:
+            preset = (len >= 3) ? simulator_get_preset(sim, data[0], data[1])
+                                : NULL;
+            if (preset == NULL || memchr(&data[2], '\0', len - 2) == NULL) {
+                simulator_send(sim, NACK, NULL, 0);
+                break;
+            }
+            g_free(preset->name);
+            preset->name = g_strdup((const gchar *) &data[2]);
+            break;
+
+        case RECEIVE_PRESET_START:
+            preset = (len >= 3) ? simulator_get_preset(sim, data[0], data[1])
+                                : NULL;
+            if (preset == NULL || memchr(&data[2], '\0', len - 2) == NULL) {
+                simulator_send(sim, NACK, NULL, 0);
+                break;
+            }
+            if (sim->incoming == NULL) {
+                sim->incoming = g_slice_new(SimPreset);
+                simulator_preset_init(sim, sim->incoming, NULL);
+            }
+            simulator_preset_copy(sim, sim->incoming, preset);
+            g_free(sim->incoming->name);
+            sim->incoming->name = g_strdup((const gchar *) &data[2]);
+            sim->incoming_bank = data[0];
+            sim->incoming_index = data[1];
+            break;
+
+        case RECEIVE_PRESET_PARAMETERS:
+            if (sim->incoming == NULL || len < 2)
+                break;
+            data += 2;
+            while (data < end) {
+                gsize n = simulator_decode_param(data, end, &param);
+
+                if (n == 0)
+                    break;
+                i = GPOINTER_TO_UINT(g_hash_table_lookup(sim->index,
+                                     PARAM_KEY(param.id, param.position)));
+                if (i != 0)
+                    sim->incoming->values[i - 1] = param.value;
+                data += n;
+            }
+            break;
+
+        case RECEIVE_PRESET_END:
+            if (sim->incoming == NULL)
+                break;
+            preset = simulator_get_preset(sim, sim->incoming_bank,
+                                          sim->incoming_index);
+            if (preset == &sim->edit) {
+                simulator_load_edit(sim, sim->incoming);
+                sim->modified = FALSE;
+            } else if (preset != NULL) {
+                simulator_preset_copy(sim, preset, sim->incoming);
+            }
+            simulator_preset_clear(sim->incoming);
+            g_slice_free(SimPreset, sim->incoming);
+            sim->incoming = NULL;
+            break;
+
+        default:
+            debug_msg(DEBUG_VERBOSE, "Simulator ignored message 0x%02x",
+                      procedure);
+    }
+}
+
+/**
+ *  \param dest string to append unpacked data to
+ *  \param src packed data
+ *  \param len packed data length
+ **/
+static void simulator_unpack(GString *dest, const guchar *src, gsize len)
+{
+    gsize i = 0;
+    gint j;
+
+    while (i < len) {
+        guchar status = src[i++];
+
+        for (j = 0; j < 7 && i < len; j++, i++)
+            g_string_append_c(dest, ((status << (j + 1)) & 0x80) | src[i]);
+    }
+}
+
+/**
+ *  \param sim simulator
+ *  \param raw complete SysEx message, as received
+ *
+ *  Verifies and unpacks message, then handles it.
+ **/
+static void simulator_receive(Simulator *sim, GString *raw)
+{
+    const guchar *str = (const guchar *) raw->str;
+    GString *data;
+    guchar checksum = 0;
+    gsize i;
+
+    if (raw->len < 10 || str[1] != 0x00 || str[2] != 0x00 || str[3] != 0x10) {
+        g_warning("Simulator received invalid message");
+        return;
+    }
+
+    /* checksum covers everything from str[3] and cancels out itself */
+    for (i = 3; i < raw->len - 1; i++)
+        checksum ^= str[i];
+    if (checksum != 0) {
+        g_warning("Simulator received message 0x%02x with bad checksum",
+                  str[7]);
+        simulator_send(sim, NACK, NULL, 0);
+        return;
+    }
+
+    sim->messages_in++;
+
+    data = g_string_sized_new(raw->len);
+    simulator_unpack(data, &str[8], raw->len - 10);
+    simulator_handle(sim, str[7], (const guchar *) data->str, data->len);
+    g_string_free(data, TRUE);
+}
+
+/**
+ *  \param sim simulator
+ *  \param data bytes written by host
+ *  \param len data length
+ **/
+static void simulator_feed(Simulator *sim, const guchar *data, gsize len)
+{
+    gsize i;
+
+    for (i = 0; i < len; i++) {
+        if (data[i] >= 0xF8)
+            continue;   /* real time messages */
+
+        if (data[i] == 0xF0) {
+            g_string_truncate(sim->input, 0);
+            sim->in_sysex = TRUE;
+        }
+
+        if (!sim->in_sysex)
+            continue;
+
+        g_string_append_c(sim->input, data[i]);
+        if (data[i] == 0xF7) {
+            sim->in_sysex = FALSE;
+            simulator_receive(sim, sim->input);
+        }
+    }
+}
+
+/**
+ *  \param sim simulator
+ *
+ *  Writes queued messages which are due, as far as bandwidth and socket
+ *  buffer allow.
+ **/
+static void simulator_write(Simulator *sim)
+{
+    while (!g_queue_is_empty(sim->output)) {
+        SimPacket *packet = g_queue_peek_head(sim->output);
+        gint64 now = g_get_monotonic_time();
+        gsize chunk = packet->data->len - packet->sent;
+        gssize n;
+
+        if (packet->due > now || sim->send_clock > now)
+            return;
+
+        if (sim->bandwidth > 0)
+            chunk = MIN(chunk, SIMULATOR_CHUNK);
+
+        n = transport_write(sim->transport,
+                            (const guchar *) &packet->data->str[packet->sent],
+                            chunk);
+        if (n < 0) {
+            if (n != -EAGAIN && n != -EINTR)
+                g_warning("Simulator failed to write: %s", g_strerror(-n));
+            return;
+        }
+
+        sim->bytes_out += n;
+        if (sim->bandwidth > 0)
+            sim->send_clock = now + n * G_USEC_PER_SEC / sim->bandwidth;
+
+        packet->sent += n;
+        if (packet->sent == packet->data->len) {
+            g_queue_pop_head(sim->output);
+            g_string_free(packet->data, TRUE);
+            g_slice_free(SimPacket, packet);
+        }
+    }
+}
+
+/**
+ *  \param sim simulator
+ *  \param writable return location, set to TRUE if queued data can be
+ *                  written as soon as link accepts it
+ *
+ *  \return poll timeout in ms until next queued message may be written,
+ *          or -1 if there is nothing to wait for.
+ **/
+static gint simulator_poll_timeout(Simulator *sim, gboolean *writable)
+{
+    SimPacket *packet = g_queue_peek_head(sim->output);
+    gint64 wake, now;
+
+    *writable = FALSE;
+    if (packet == NULL)
+        return -1;
+
+    wake = MAX(packet->due, sim->send_clock);
+    now = g_get_monotonic_time();
+    if (wake > now)
+        return (wake - now + 999) / 1000;
+
+    *writable = TRUE;
+    return -1;
+}
+
+/**
+ *  \param data Simulator
+ *
+ *  Simulator thread. Runs until host closes its end of link.
+ *
+ *  \return NULL.
+ **/
+static gpointer simulator_thread(gpointer data)
+{
+    Simulator *sim = data;
+    guchar buf[SIMULATOR_INPUT_SIZE];
+    struct pollfd *pfds;
+    gboolean writable;
+    unsigned short revents;
+    gint npfds, timeout, i;
+    gssize n;
+
+    npfds = transport_poll_descriptors_count(sim->transport);
+    pfds = g_new(struct pollfd, npfds);
+
+    for (;;) {
+        timeout = simulator_poll_timeout(sim, &writable);
+        transport_poll_descriptors(sim->transport, pfds, npfds);
+        for (i = 0; writable && i < npfds; i++)
+            pfds[i].events |= POLLOUT;
+
+        if (poll(pfds, npfds, timeout) < 0) {
+            if (errno == EINTR)
+                continue;
+            g_warning("Simulator poll failed: %s", g_strerror(errno));
+            break;
+        }
+
+        revents = transport_poll_revents(sim->transport, pfds, npfds);
+        if (revents & POLLIN) {
+            n = transport_read(sim->transport, buf, sizeof(buf));
+            if (n == 0)
+                break;
+            if (n < 0 && n != -EAGAIN && n != -EINTR) {
+                g_warning("Simulator failed to read: %s", g_strerror(-n));
+                break;
+            }
+            if (n > 0)
+                simulator_feed(sim, buf, n);
+        } else if (revents & (POLLERR | POLLHUP)) {
+            break;
+        }
+
+        simulator_write(sim);
+    }
+
+    g_free(pfds);
+
+    return NULL;
+}
+
+/**
+ *  \param sim simulator to free, its thread must not be running
+ **/
+static void simulator_destroy(Simulator *sim)
+{
+    SimPacket *packet;
+    gint x;
+    guint i;
+
+    if (sim->transport != NULL)
+        transport_close(sim->transport);
+
+    for (x = 0; x < sim->n_banks; x++) {
+        for (i = 0; i < sim->banks[x].n_presets; i++)
+            simulator_preset_clear(&sim->banks[x].presets[i]);
+        g_free(sim->banks[x].presets);
+    }
+    g_free(sim->banks);
+    simulator_preset_clear(&sim->edit);
+
+    if (sim->incoming != NULL) {
+        simulator_preset_clear(sim->incoming);
+        g_slice_free(SimPreset, sim->incoming);
+    }
+
+    while ((packet = g_queue_pop_head(sim->output)) != NULL) {
+        g_string_free(packet->data, TRUE);
+        g_slice_free(SimPacket, packet);
+    }
+    g_queue_free(sim->output);
+    g_string_free(sim->input, TRUE);
+
+    g_array_free(sim->params, TRUE);
+    g_array_free(sim->globals, TRUE);
+    g_free(sim->global_values);
+    g_hash_table_destroy(sim->index);
+    g_hash_table_destroy(sim->global_index);
+    g_rand_free(sim->rand);
+
+    g_slice_free(Simulator, sim);
+}
+
+/**
+ *  \param spec "<device>[,<option>=<value>...]", where device is model
+ *              name like RP355 and options are latency and jitter (ms),
+ *              bandwidth (bytes/s), drop and corrupt (percent of replies)
+ *              and presets (presets in each bank)
+ *  \param transport device end of link to host, which must never block
+ *                   on write. Taken over on success.
+ *
+ *  Starts simulated device.
+ *
+ *  \return Simulator which must be freed using simulator_free, or NULL
+ *          on error.
+ **/
+Simulator *simulator_new(const gchar *spec, Transport *transport)
+{
+    Simulator *sim = g_slice_new0(Simulator);
+
+    sim->n_presets = SIMULATOR_PRESETS;
+    if (!simulator_parse_spec(sim, spec)) {
+        g_slice_free(Simulator, sim);
+        return NULL;
+    }
+
+    sim->rand = g_rand_new_with_seed(sim->device->product_id);
+    sim->params = g_array_new(FALSE, FALSE, sizeof(SimParam));
+    sim->globals = g_array_new(FALSE, FALSE, sizeof(SimParam));
+    sim->index = g_hash_table_new(g_direct_hash, g_direct_equal);
+    sim->global_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+    sim->input = g_string_sized_new(SIMULATOR_INPUT_SIZE);
+    sim->output = g_queue_new();
+
+    simulator_build_schema(sim);
+    simulator_build_presets(sim);
+
+    debug_msg(DEBUG_STARTUP, "Simulating %s: %d preset parameters, "
+              "%d global parameters, %d banks of %d presets",
+              sim->device->name, sim->params->len, sim->globals->len,
+              sim->n_banks, sim->n_presets);
+
+    sim->transport = transport;
+    sim->thread = g_thread_create(simulator_thread, sim, TRUE, NULL);
+    if (sim->thread == NULL) {
+        g_warning("Failed to start simulator thread");
+        sim->transport = NULL;      /* stays with caller */
+        simulator_destroy(sim);
+        return NULL;
+    }
+
+    return sim;
+}
+
+/**
+ *  \param sim simulator
+ *
+ *  Waits until simulator thread exits, then frees simulator together with
+ *  its transport. Host end of link must have been shut down already.
+ **/
+void simulator_free(Simulator *sim)
+{
+    g_return_if_fail(sim != NULL);
+
+    g_thread_join(sim->thread);
+
+    debug_msg(DEBUG_STATS, "Simulator: %d messages received, %d sent, "
+              "%d corrupted, %d dropped, %" G_GUINT64_FORMAT " bytes written",
+              sim->messages_in, sim->messages_out, sim->messages_corrupted,
+              sim->messages_dropped, sim->bytes_out);
+
+    simulator_destroy(sim);
+}
@@ -0,0 +1,28 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef GDIGI_SIMULATOR_H
+#define GDIGI_SIMULATOR_H
+
+#include <glib.h>
+#include "transport.h"
+
+typedef struct _Simulator Simulator;
+
+Simulator *simulator_new(const gchar *spec, Transport *transport);
+void simulator_free(Simulator *sim);
+
+#endif /* GDIGI_SIMULATOR_H */
@@ -0,0 +1,244 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include "harness.h"
+
+/*
+ * Applying presets to main window built for simulated device, with every
+ * notebook page built. Skipped when there is no display.
+ */
+
+#define BENCH_PRESETS 5
+#define BENCH_SPEC HARNESS_MODEL ",presets=5"
+#define BENCH_ROUNDS 20
+
+static Preset *presets[BENCH_PRESETS];
+
+/**
+ *  Runs pending GTK events and idle callbacks.
+ **/
+static void run_pending_events()
+{
+    while (gtk_events_pending())
+        gtk_main_iteration();
+}
+
+/**
+ *  \return amount of finished edit buffer requests.
+ **/
+static guint presets_read()
+{
+    RequestStats *stats = &request_stats[RECEIVE_PRESET_START];
+
+    return stats->completed + stats->timed_out;
+}
+
+/**
+ *  \param finished amount of finished edit buffer requests to wait for
+ *
+ *  Runs main loop until edit buffer requested without waiting has been
+ *  read and applied, as reply callbacks run on main loop.
+ **/
+static void wait_presets_read(guint finished)
+{
+    while (presets_read() < finished)
+        g_main_context_iteration(NULL, TRUE);
+}
+
+/**
+ *  \param widget widget to search
+ *
+ *  \return first GtkNotebook in widget hierarchy, or NULL.
+ **/
+static GtkWidget *find_notebook(GtkWidget *widget)
+{
+    GtkWidget *notebook = NULL;
+    GList *children, *iter;
+
+    if (GTK_IS_NOTEBOOK(widget))
+        return widget;
+    if (!GTK_IS_CONTAINER(widget))
+        return NULL;
+
+    children = gtk_container_get_children(GTK_CONTAINER(widget));
+    for (iter = children; iter != NULL && notebook == NULL; iter = iter->next)
+        notebook = find_notebook(iter->data);
+    g_list_free(children);
+
+    return notebook;
+}
+
+/**
+ *  Builds every page of main window, pages are built when first shown.
+ **/
+static void build_all_pages()
+{
+    GList *toplevels = gtk_window_list_toplevels();
+    GList *iter;
+
+    for (iter = toplevels; iter != NULL; iter = iter->next) {
+        GtkWidget *notebook = find_notebook(iter->data);
+        gint i;
+
+        if (notebook == NULL)
+            continue;
+
+        for (i = 0; i < gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)); i++)
+            gtk_notebook_set_current_page(GTK_NOTEBOOK(notebook), i);
+        gtk_notebook_set_current_page(GTK_NOTEBOOK(notebook), 0);
+    }
+    g_list_free(toplevels);
+}
+
+/**
+ *  \param preset preset to load
+ *
+ *  Loads preset into edit buffer of simulated device.
+ **/
+static void load_edit_buffer(Preset *preset)
+{
+    GString *start = g_string_new(NULL);
+
+    g_string_append_printf(start, "%c%c%s%c%c%c",
+                           PRESETS_EDIT_BUFFER, 0, preset->name, 0,
+                           0,       /* modified */
+                           2);      /* messages to follow */
+    send_message(RECEIVE_PRESET_START, start->str, start->len);
+    send_preset_parameters(preset->params);
+    send_message(RECEIVE_PRESET_END, NULL, 0);
+    g_string_free(start, TRUE);
+}
+
+/**
+ *  Applies presets parameter by parameter, as received parameter
+ *  changes are applied.
+ **/
+static void bench_apply_params()
+{
+    gint64 start, elapsed = 0;
+    guint params = 0;
+    gint i;
+
+    for (i = 0; i < BENCH_ROUNDS * BENCH_PRESETS; i++) {
+        Preset *preset = presets[i % BENCH_PRESETS];
+
+        start = g_get_monotonic_time();
+        apply_setting_params_to_gui((SettingParam *) preset->params->data,
+                                    preset->params->len);
+        elapsed += g_get_monotonic_time() - start;
+        params += preset->params->len;
+
+        run_pending_events();
+    }
+
+    g_print("%-28s %8.2f ms per preset, %6.2f us per parameter\n",
+            "apply_setting_params_to_gui",
+            elapsed / 1000.0 / (BENCH_ROUNDS * BENCH_PRESETS),
+            (gdouble) elapsed / params);
+}
+
+/**
+ *  Reads edit buffer and applies it to GUI, as done after preset
+ *  change, then reads it alone to tell how long applying took.
+ **/
+static void bench_apply_current()
+{
+    gint64 start, read = 0, read_apply = 0;
+    gint i;
+
+    for (i = 0; i < BENCH_ROUNDS * BENCH_PRESETS; i++) {
+        guint finished = presets_read() + 1;
+        Preset *preset;
+
+        load_edit_buffer(presets[i % BENCH_PRESETS]);
+
+        start = g_get_monotonic_time();
+        apply_current_preset_to_gui(NULL);
+        wait_presets_read(finished);
+        read_apply += g_get_monotonic_time() - start;
+        run_pending_events();
+
+        start = g_get_monotonic_time();
+        preset = harness_read_preset(PRESETS_EDIT_BUFFER, 0, REQUEST_TIMEOUT);
+        read += g_get_monotonic_time() - start;
+        g_assert(preset != NULL);
+        preset_free(preset);
+    }
+
+    g_print("%-28s %8.2f ms per preset, %.2f ms of it reading\n",
+            "apply_current_preset_to_gui",
+            read_apply / 1000.0 / (BENCH_ROUNDS * BENCH_PRESETS),
+            read / 1000.0 / (BENCH_ROUNDS * BENCH_PRESETS));
+}
+
+int main(int argc, char *argv[])
+{
+    Device *device = NULL;
+    GList *toplevels, *iter;
+    gint64 start;
+    guint finished;
+    gint i;
+
+    g_thread_init(NULL);
+
+    if (!gtk_init_check(&argc, &argv)) {
+        g_print("No display, skipping GUI benchmark\n");
+        return 0;
+    }
+
+    if (!harness_open(BENCH_SPEC) || !harness_identify(3) ||
+        !get_device_info(device_id, family_id, product_id, &device)) {
+        g_printerr("Failed to start simulated device\n");
+        return 1;
+    }
+
+    for (i = 0; i < BENCH_PRESETS; i++) {
+        presets[i] = harness_read_preset(PRESETS_USER, i, REQUEST_TIMEOUT);
+        g_assert(presets[i] != NULL);
+    }
+
+    start = g_get_monotonic_time();
+    finished = presets_read() + 1;
+    gui_create(device);
+    build_all_pages();
+    wait_presets_read(finished);
+    run_pending_events();
+    g_print("%-28s %8.2f ms\n", "main window with all pages",
+            (g_get_monotonic_time() - start) / 1000.0);
+
+    /* first application of each preset builds grids of its effects */
+    for (i = 0; i < BENCH_PRESETS; i++) {
+        apply_setting_params_to_gui((SettingParam *) presets[i]->params->data,
+                                    presets[i]->params->len);
+        run_pending_events();
+    }
+
+    bench_apply_params();
+    bench_apply_current();
+
+    toplevels = gtk_window_list_toplevels();
+    for (iter = toplevels; iter != NULL; iter = iter->next)
+        gtk_widget_destroy(iter->data);
+    g_list_free(toplevels);
+    run_pending_events();
+    gui_free();
+
+    harness_close();
+    for (i = 0; i < BENCH_PRESETS; i++)
+        preset_free(presets[i]);
+
+    return 0;
+}
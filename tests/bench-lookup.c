@@ -0,0 +1,133 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include "harness.h"
+
+/*
+ * Parameter metadata lookups over parameters of a full preset, compared
+ * with linear search of xml_settings.
+ */
+
+#define BENCH_TIME 500000       /* microseconds per benchmark */
+
+static GArray *params;          /* SettingParam of benchmarked preset */
+static volatile gpointer sink;  /* keeps results from being optimized out */
+
+/**
+ *  \param id modifier ID
+ *  \param position modifier position
+ *
+ *  Finds modifier info the way get_xml_settings() did before the index.
+ *
+ *  \return Modifier, or NULL if not found.
+ **/
+static XmlSettings *linear_get_xml_settings(guint id, guint position)
+{
+    guint x;
+
+    for (x = 0; x < n_xml_settings; x++) {
+        if (xml_settings[x].id == id && xml_settings[x].position == position)
+            return &xml_settings[x];
+    }
+
+    return NULL;
+}
+
+static void bench_get_xml_settings()
+{
+    guint x;
+
+    for (x = 0; x < params->len; x++) {
+        SettingParam *param = &g_array_index(params, SettingParam, x);
+
+        sink = get_xml_settings(param->id, param->position);
+    }
+}
+
+static void bench_linear_get_xml_settings()
+{
+    guint x;
+
+    for (x = 0; x < params->len; x++) {
+        SettingParam *param = &g_array_index(params, SettingParam, x);
+
+        sink = linear_get_xml_settings(param->id, param->position);
+    }
+}
+
+static void bench_map_xml_value()
+{
+    guint x;
+
+    for (x = 0; x < params->len; x++) {
+        SettingParam *param = &g_array_index(params, SettingParam, x);
+        XmlSettings *xml = get_xml_settings(param->id, param->position);
+
+        if (xml != NULL && xml->values != NULL &&
+            xml->values->type == VALUE_TYPE_LABEL)
+            sink = map_xml_value(xml, xml->values, param->value);
+    }
+}
+
+static void bench_format_ipv()
+{
+    guint x;
+
+    for (x = 0; x < params->len; x++) {
+        SettingParam *param = &g_array_index(params, SettingParam, x);
+        GString *ipv = format_ipv(param->id, param->position, param->value);
+
+        g_string_free(ipv, TRUE);
+    }
+}
+
+/**
+ *  \param name benchmark name
+ *  \param func function processing every parameter in params
+ *
+ *  Runs func for BENCH_TIME and prints time taken per parameter.
+ **/
+static void bench(const gchar *name, void (*func)())
+{
+    gint64 start, elapsed;
+    guint64 runs = 0;
+
+    func();     /* warm up caches, builds index on first lookup */
+
+    start = g_get_monotonic_time();
+    do {
+        func();
+        runs++;
+        elapsed = g_get_monotonic_time() - start;
+    } while (elapsed < BENCH_TIME);
+
+    g_print("%-24s %8.1f ns per parameter\n", name,
+            elapsed * 1000.0 / (runs * params->len));
+}
+
+int main(int argc, char *argv[])
+{
+    params = harness_params_new(0);
+
+    g_print("%d parameters, %d xml_settings\n", params->len, n_xml_settings);
+    bench("get_xml_settings", bench_get_xml_settings);
+    bench("linear search", bench_linear_get_xml_settings);
+    bench("map_xml_value", bench_map_xml_value);
+    bench("format_ipv", bench_format_ipv);
+
+    g_array_free(params, TRUE);
+    return 0;
+}
@@ -0,0 +1,154 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include "harness.h"
+
+/*
+ * Request latency and preset throughput over loopback: transport.
+ * Optional argument is simulator spec, to measure with latency,
+ * bandwidth etc. of a real link.
+ */
+
+#define BENCH_SPEC HARNESS_MODEL ",presets=20"
+#define BENCH_ROUND_TRIPS 1000
+#define BENCH_TIME 2000000      /* microseconds of preset reads */
+
+static gint compare_times(gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64 *) a;
+    gint64 y = *(const gint64 *) b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ *  \param name benchmark name
+ *  \param times request times in microseconds, gets sorted
+ *
+ *  Prints request time statistics.
+ **/
+static void print_times(const gchar *name, GArray *times)
+{
+    gint64 total = 0;
+    guint x;
+
+    g_array_sort(times, compare_times);
+    for (x = 0; x < times->len; x++)
+        total += g_array_index(times, gint64, x);
+
+    g_print("%-16s %6u requests, mean %7.1f us, median %6" G_GINT64_FORMAT
+            " us, 99%% %6" G_GINT64_FORMAT " us, max %6" G_GINT64_FORMAT
+            " us\n", name, times->len, (gdouble) total / times->len,
+            g_array_index(times, gint64, times->len / 2),
+            g_array_index(times, gint64, times->len * 99 / 100),
+            g_array_index(times, gint64, times->len - 1));
+}
+
+/**
+ *  Measures round trips of smallest request.
+ **/
+static void bench_who_am_i()
+{
+    GArray *times = g_array_new(FALSE, FALSE, sizeof(gint64));
+    gint x;
+
+    for (x = 0; x < BENCH_ROUND_TRIPS; x++) {
+        gint64 start = g_get_monotonic_time();
+        gint64 time;
+        GString *reply;
+
+        reply = device_request_wait(REQUEST_WHO_AM_I, "\x7F\x7F\x7F", 3,
+                                    RECEIVE_WHO_AM_I, REQUEST_TIMEOUT);
+        time = g_get_monotonic_time() - start;
+        if (reply == NULL)
+            continue;
+
+        g_string_free(reply, TRUE);
+        g_array_append_val(times, time);
+    }
+
+    if (times->len > 0)
+        print_times("who am I", times);
+    g_array_free(times, TRUE);
+}
+
+/**
+ *  Reads user presets one after another for BENCH_TIME.
+ **/
+static void bench_presets()
+{
+    GStrv names = query_preset_names(PRESETS_USER);
+    guint n_presets;
+    GArray *times;
+    guint64 bytes = 0;
+    gint64 start, elapsed;
+    guint index = 0;
+
+    if (names == NULL || (n_presets = g_strv_length(names)) == 0) {
+        g_printerr("No user presets to read\n");
+        g_strfreev(names);
+        return;
+    }
+    g_strfreev(names);
+
+    times = g_array_new(FALSE, FALSE, sizeof(gint64));
+    start = g_get_monotonic_time();
+    do {
+        gchar data[2] = {PRESETS_USER, index++ % n_presets};
+        gint64 request_start = g_get_monotonic_time();
+        gint64 time;
+        GList *list, *iter;
+
+        list = device_request_wait(REQUEST_PRESET, data, sizeof(data),
+                                   RECEIVE_PRESET_START, REQUEST_TIMEOUT);
+        time = g_get_monotonic_time() - request_start;
+        elapsed = g_get_monotonic_time() - start;
+        if (list == NULL)
+            continue;
+
+        for (iter = list; iter != NULL; iter = g_list_next(iter))
+            bytes += ((GString *) iter->data)->len;
+        message_list_free(list);
+        g_array_append_val(times, time);
+    } while (elapsed < BENCH_TIME);
+
+    if (times->len > 0) {
+        print_times("preset", times);
+        /* bytes per microsecond is MB/s */
+        g_print("%-16s %6.1f presets/s, %.2f MB/s unpacked\n", "preset",
+                times->len * 1000000.0 / elapsed, (gdouble) bytes / elapsed);
+    }
+    g_array_free(times, TRUE);
+}
+
+int main(int argc, char *argv[])
+{
+    const gchar *spec = (argc > 1) ? argv[1] : BENCH_SPEC;
+
+    g_thread_init(NULL);
+
+    if (!harness_open(spec) || !harness_identify(3)) {
+        g_printerr("Failed to start simulated device %s\n", spec);
+        return 1;
+    }
+
+    g_print("loopback:%s\n", spec);
+    bench_who_am_i();
+    bench_presets();
+
+    harness_close();
+    return 0;
+}
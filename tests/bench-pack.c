@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include "harness.h"
+#include "pack.h"
+
+/*
+ * Packing and unpacking speed, in MB/s of unpacked data, compared with
+ * byte at a time packing.
+ */
+
+#define BENCH_DATA_LEN (64 * 1024)
+#define BENCH_TIME 500000       /* microseconds per benchmark */
+
+static guchar data[BENCH_DATA_LEN];
+static guchar packed[PACKED_LEN(BENCH_DATA_LEN) + 1];
+static guchar unpacked[BENCH_DATA_LEN + 1];
+static SysExDecoder decoder;
+
+static void bench_pack_data()
+{
+    guchar checksum = 0;
+
+    pack_data(packed, (const gchar *) data, BENCH_DATA_LEN, &checksum);
+}
+
+static void bench_scalar_pack()
+{
+    guchar checksum = 0;
+
+    scalar_pack(packed, data, BENCH_DATA_LEN, &checksum);
+}
+
+static void bench_decoder_unpack()
+{
+    g_string_truncate(decoder.msg, 0);
+    decoder.state = DECODER_STATUS;
+    sysex_decoder_unpack(&decoder, packed, PACKED_LEN(BENCH_DATA_LEN),
+                         FALSE);
+}
+
+static void bench_scalar_unpack()
+{
+    scalar_unpack(unpacked, packed, PACKED_LEN(BENCH_DATA_LEN));
+}
+
+/**
+ *  \param name benchmark name
+ *  \param func function processing BENCH_DATA_LEN bytes
+ *
+ *  Runs func for BENCH_TIME and prints its speed.
+ **/
+static void bench(const gchar *name, void (*func)())
+{
+    gint64 start, elapsed;
+    guint64 runs = 0;
+
+    func();     /* warm up caches */
+
+    start = g_get_monotonic_time();
+    do {
+        func();
+        runs++;
+        elapsed = g_get_monotonic_time() - start;
+    } while (elapsed < BENCH_TIME);
+
+    /* bytes per microsecond is MB/s */
+    g_print("%-20s %10.1f MB/s\n", name,
+            (gdouble) runs * BENCH_DATA_LEN / elapsed);
+}
+
+int main(int argc, char *argv[])
+{
+    GRand *rand = g_rand_new_with_seed(0);
+    gint i;
+
+    g_thread_init(NULL);
+    unpack_msb_table_init(NULL);
+
+    for (i = 0; i < BENCH_DATA_LEN; i++)
+        data[i] = g_rand_int_range(rand, 0, 256);
+    g_rand_free(rand);
+
+    decoder.msg = g_string_sized_new(BENCH_DATA_LEN + 1);
+
+    bench("pack_data", bench_pack_data);
+    bench("scalar pack", bench_scalar_pack);
+
+    bench("decoder unpack", bench_decoder_unpack);
+    g_assert(decoder.msg->len == BENCH_DATA_LEN &&
+             memcmp(decoder.msg->str, data, BENCH_DATA_LEN) == 0);
+    bench("scalar unpack", bench_scalar_unpack);
+
+    g_string_free(decoder.msg, TRUE);
+    return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include "harness.h"
+
+/*
+ * Messages per second through send path into output ring, which is
+ * drained by a writer thread throwing data away. Encoders building
+ * messages with GString and printf, as gdigi did before, are measured
+ * for comparison.
+ */
+
+#define BENCH_TIME 500000       /* microseconds per benchmark */
+
+static GArray *params;          /* SettingParam of a preset */
+
+/**
+ *  \param procedure procedure ID
+ *  \param data unpacked message data
+ *  \param len data length
+ *
+ *  Builds message in GString, packing data into another one.
+ **/
+static void printf_send_message(gint procedure, gchar *data, gint len)
+{
+    GString *msg = g_string_new_len("\xF0\x00\x00\x10", 4);
+    gchar checksum = 0;
+    gint i;
+
+    g_string_append_printf(msg, "%c%c%c%c",
+                           device_id, family_id, product_id, procedure);
+
+    if (len > 0) {
+        GString *packed = g_string_sized_new(PACKED_LEN(len));
+        gint status_byte = 0;
+        guchar status = 0;
+
+        for (i = 0; i < len; i++) {
+            if ((i % 7) == 0) {
+                packed->str[status_byte] = status;
+                status = 0;
+                status_byte = packed->len;
+                g_string_append_c(packed, '\0');
+            }
+            g_string_append_c(packed, data[i] & 0x7F);
+            status |= (data[i] & 0x80) >> ((i % 7) + 1);
+        }
+        packed->str[status_byte] = status;
+
+        g_string_append_len(msg, packed->str, packed->len);
+        g_string_free(packed, TRUE);
+    }
+
+    for (i = 1; i < msg->len; i++)
+        checksum ^= msg->str[i];
+    g_string_append_printf(msg, "%c\xF7", checksum);
+
+    send_data(msg->str, msg->len);
+    g_string_free(msg, TRUE);
+}
+
+/**
+ *  \param msg GString to append value to
+ *  \param value value to append
+ **/
+static void printf_append_value(GString *msg, guint value)
+{
+    guint temp = value;
+    gint n = 0;
+    gint x;
+
+    do {
+        n++;
+        temp = temp >> 8;
+    } while (temp);
+
+    if (n == 1) {
+        if (value & 0x80) {
+            n = 2;
+        } else {
+            g_string_append_printf(msg, "%c", value);
+            return;
+        }
+    }
+
+    g_string_append_printf(msg, "%c", n | 0x80);
+    for (x = 0; x < n; x++)
+        g_string_append_printf(msg, "%c", (value >> (8*(n-x-1))) & 0xFF);
+}
+
+static void printf_set_option(guint id, guint position, guint value)
+{
+    GString *msg = g_string_sized_new(9);
+
+    g_string_append_printf(msg, "%c%c%c",
+                           (id & 0xFF00) >> 8, id & 0xFF, position);
+    printf_append_value(msg, value);
+    printf_send_message(RECEIVE_PARAMETER_VALUE, msg->str, msg->len);
+    g_string_free(msg, TRUE);
+}
+
+static void printf_send_preset_parameters(GArray *params)
+{
+    GString *msg = g_string_sized_new(500);
+    guint x;
+
+    g_string_append_printf(msg, "%c%c",
+                           (params->len & 0xFF00) >> 8, params->len & 0xFF);
+    for (x = 0; x < params->len; x++) {
+        SettingParam *param = &g_array_index(params, SettingParam, x);
+
+        g_string_append_printf(msg, "%c%c%c",
+                               (param->id & 0xFF00) >> 8, param->id & 0xFF,
+                               param->position);
+        printf_append_value(msg, param->value);
+    }
+
+    printf_send_message(RECEIVE_PRESET_PARAMETERS, msg->str, msg->len);
+    g_string_free(msg, TRUE);
+}
+
+/**
+ *  \return amount of messages sent.
+ **/
+static guint bench_set_option()
+{
+    guint x;
+
+    for (x = 0; x < params->len; x++) {
+        SettingParam *param = &g_array_index(params, SettingParam, x);
+
+        set_option(param->id, param->position, param->value);
+    }
+
+    return params->len;
+}
+
+static guint bench_printf_set_option()
+{
+    guint x;
+
+    for (x = 0; x < params->len; x++) {
+        SettingParam *param = &g_array_index(params, SettingParam, x);
+
+        printf_set_option(param->id, param->position, param->value);
+    }
+
+    return params->len;
+}
+
+static guint bench_send_preset_parameters()
+{
+    send_preset_parameters(params);
+    return 1;
+}
+
+static guint bench_printf_send_preset_parameters()
+{
+    printf_send_preset_parameters(params);
+    return 1;
+}
+
+/**
+ *  \param name benchmark name
+ *  \param func function sending messages, returning how many it sent
+ *
+ *  Runs func for BENCH_TIME, waits until writer thread has drained
+ *  output ring, then prints messages per second.
+ **/
+static void bench(const gchar *name, guint (*func)())
+{
+    gint64 start, elapsed;
+    guint64 messages = 0;
+
+    start = g_get_monotonic_time();
+    do {
+        messages += func();
+    } while (g_get_monotonic_time() - start < BENCH_TIME);
+
+    while (g_atomic_int_get(&output_ring_tail) !=
+           g_atomic_int_get(&output_ring_head))
+        g_usleep(100);
+    elapsed = g_get_monotonic_time() - start;
+
+    g_print("%-32s %10.0f messages/s\n", name,
+            messages * 1000000.0 / elapsed);
+}
+
+int main(int argc, char *argv[])
+{
+    g_thread_init(NULL);
+
+    params = harness_params_new(0);
+    harness_null_writer_start();
+
+    g_print("%d parameters\n", params->len);
+    bench("set_option", bench_set_option);
+    bench("set_option, printf", bench_printf_set_option);
+    bench("send_preset_parameters", bench_send_preset_parameters);
+    bench("send_preset_parameters, printf",
+          bench_printf_send_preset_parameters);
+
+    output_writer_finish();
+    g_array_free(params, TRUE);
+    return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include "harness.h"
+
+/*
+ * Startup against simulated device, following main() from opening the
+ * device until edit buffer, modifier linkable list and global
+ * parameters arrive.
+ * Prints the --profile-startup breakdown and fails when startup takes
+ * longer than the limit, given in ms as optional argument.
+ * Preset cache is not used, so user's cache stays untouched.
+ * Skipped when there is no display.
+ */
+
+#define STARTUP_SPEC HARNESS_MODEL
+#define STARTUP_LIMIT 1000      /* ms */
+#define STARTUP_TRACE_FILE "gdigi-startup-bench.json"
+
+/**
+ *  \param timeout in ms
+ *
+ *  Runs main loop until replies requested by gui_create() have been
+ *  handled.
+ *
+ *  \return TRUE if they arrived, FALSE on timeout.
+ **/
+static gboolean wait_startup_replies(guint timeout)
+{
+    gint64 end = g_get_monotonic_time() + timeout * 1000;
+
+    while (request_stats[RECEIVE_PRESET_START].completed == 0 ||
+           messages_good[RECEIVE_MODIFIER_LINKABLE_LIST] == 0 ||
+           messages_good[RECEIVE_GLOBAL_PARAMETERS] == 0) {
+        if (g_get_monotonic_time() > end)
+            return FALSE;
+        if (!g_main_context_iteration(NULL, FALSE))
+            g_usleep(1000);
+    }
+
+    /* reply callbacks are idles, and so is profile_finish_cb */
+    while (gtk_events_pending())
+        gtk_main_iteration();
+
+    return TRUE;
+}
+
+int main(int argc, char *argv[])
+{
+    gint64 start_time = g_get_monotonic_time();
+    gint64 window, finished;
+    guint limit = (argc > 1) ? atoi(argv[1]) : STARTUP_LIMIT;
+    Device *device = NULL;
+    DeviceConfigView config;
+    GList *toplevels, *iter;
+    gboolean complete;
+    gchar *trace_file;
+
+    g_thread_init(NULL);
+
+    if (!gtk_init_check(&argc, &argv)) {
+        g_print("No display, skipping startup benchmark\n");
+        return 0;
+    }
+
+    /* trace is left in temporary directory for closer look */
+    trace_file = g_build_filename(g_get_tmp_dir(), STARTUP_TRACE_FILE, NULL);
+    profile_init(trace_file, start_time);
+    g_free(trace_file);
+
+    if (!harness_open(STARTUP_SPEC) ||
+        !request_who_am_i(&device_id, &family_id, &product_id) ||
+        !get_device_info(device_id, family_id, product_id, &device) ||
+        !request_device_configuration(&config)) {
+        g_printerr("Failed to start simulated device\n");
+        return 1;
+    }
+
+    set_option(GUI_MODE_ON_OFF, GLOBAL_POSITION, 1);
+
+    profile_begin("Create GUI");
+    gui_create(device);
+    profile_end();
+    profile_startup_done();
+    window = g_get_monotonic_time() - start_time;
+
+    complete = wait_startup_replies(LIST_TIMEOUT);
+    finished = g_get_monotonic_time() - start_time;
+    profile_finish();
+
+    toplevels = gtk_window_list_toplevels();
+    for (iter = toplevels; iter != NULL; iter = iter->next)
+        gtk_widget_destroy(iter->data);
+    g_list_free(toplevels);
+    gui_free();
+
+    set_option(GUI_MODE_ON_OFF, GLOBAL_POSITION, 0);
+    harness_close();
+
+    if (!complete) {
+        g_printerr("Startup replies didn't arrive\n");
+        return 1;
+    }
+
+    g_print("Main window ready after %.1f ms, startup finished after %.1f ms, "
+            "limit %u ms\n", window / 1000.0, finished / 1000.0, limit);
+    if (finished > limit * G_GINT64_CONSTANT(1000)) {
+        g_printerr("Startup took longer than %u ms\n", limit);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,321 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include "harness.h"
+
+/*
+ * Requests and replies between MIDI layer and simulated device, over
+ * clean, slow, lossy and corrupting links.
+ */
+
+#define TEST_PRESETS 5
+#define TEST_SPEC HARNESS_MODEL ",presets=5"
+
+extern XmlSettings xml_settings[];
+extern guint n_xml_settings;
+
+/**
+ *  \param bank preset bank
+ *  \param index preset index
+ *
+ *  \return name simulator gives to preset, must be freed using g_free.
+ **/
+static gchar *default_preset_name(guint bank, guint index)
+{
+    return g_strdup_printf("Preset %d-%02d", bank, index + 1);
+}
+
+static void test_request_reply()
+{
+    DeviceConfigView config;
+    GStrv names;
+    gchar *name;
+
+    g_assert(harness_open(TEST_SPEC));
+    g_assert(harness_identify(1));
+    g_assert_cmpint(family_id, ==, 0x5E);
+    g_assert_cmpint(product_id, ==, 0x09);
+
+    g_assert(request_device_configuration(&config));
+    g_assert_cmpint(config.current_bank, ==, PRESETS_USER);
+    g_assert_cmpint(config.current_preset, ==, 0);
+
+    names = query_preset_names(PRESETS_SYSTEM);
+    g_assert(names != NULL);
+    g_assert_cmpint(g_strv_length(names), ==, TEST_PRESETS);
+    name = default_preset_name(PRESETS_SYSTEM, TEST_PRESETS - 1);
+    g_assert_cmpstr(names[TEST_PRESETS - 1], ==, name);
+    g_free(name);
+    g_strfreev(names);
+
+    /* unknown bank gets NACK, request must not stay queued */
+    g_assert(device_request_wait(REQUEST_PRESET_NAMES, "\x63", 1,
+                                 RECEIVE_PRESET_NAMES, 200) == NULL);
+    g_assert(g_queue_is_empty(message_slots[RECEIVE_PRESET_NAMES].requests));
+
+    harness_close();
+}
+
+static void test_preset_load()
+{
+    Preset *preset, *loaded;
+    GString *start;
+    guint i;
+
+    g_assert(harness_open(TEST_SPEC));
+    g_assert(harness_identify(1));
+
+    preset = harness_read_preset(PRESETS_USER, 2, REQUEST_TIMEOUT);
+    g_assert(preset != NULL);
+    g_assert_cmpuint(preset->params->len, >, 7);
+
+    /* values with bit 7 set at every position of 7-byte groups */
+    for (i = 0; i < preset->params->len; i++) {
+        static const guint values[] = {0, 0x7F, 0x80, 0xFF80, 0x80FF80};
+
+        g_array_index(preset->params, SettingParam, i).value =
+            values[i % G_N_ELEMENTS(values)];
+    }
+    g_free(preset->name);
+    preset->name = g_strdup("Loaded \xC3\xA9");
+
+    start = g_string_new(NULL);
+    g_string_append_printf(start, "%c%c%s%c%c%c",
+                           PRESETS_EDIT_BUFFER, 0,
+                           preset->name, 0,
+                           0,       /* modified */
+                           2);      /* messages to follow */
+    send_message(RECEIVE_PRESET_START, start->str, start->len);
+    send_preset_parameters(preset->params);
+    send_message(RECEIVE_PRESET_END, NULL, 0);
+    g_string_free(start, TRUE);
+
+    loaded = harness_read_preset(PRESETS_EDIT_BUFFER, 0, REQUEST_TIMEOUT);
+    g_assert(loaded != NULL);
+    g_assert(harness_presets_equal(preset, loaded));
+
+    preset_free(loaded);
+    preset_free(preset);
+    harness_close();
+}
+
+static void test_preset_store()
+{
+    Preset *current, *stored;
+    GStrv names;
+    gchar *name;
+
+    g_assert(harness_open(TEST_SPEC));
+    g_assert(harness_identify(1));
+
+    switch_preset(PRESETS_USER, 1);
+    current = harness_read_preset(PRESETS_EDIT_BUFFER, 0, REQUEST_TIMEOUT);
+    g_assert(current != NULL);
+    name = default_preset_name(PRESETS_USER, 1);
+    g_assert_cmpstr(current->name, ==, name);
+    g_free(name);
+
+    store_preset_name(3, "Stored");
+    stored = harness_read_preset(PRESETS_USER, 3, REQUEST_TIMEOUT);
+    g_assert(stored != NULL);
+    g_assert_cmpstr(stored->name, ==, "Stored");
+
+    g_free(current->name);
+    current->name = g_strdup("Stored");
+    g_assert(harness_presets_equal(current, stored));
+
+    names = query_preset_names(PRESETS_USER);
+    g_assert(names != NULL);
+    g_assert_cmpstr(names[3], ==, "Stored");
+    g_strfreev(names);
+
+    preset_free(stored);
+    preset_free(current);
+    harness_close();
+}
+
+static void test_late_reply()
+{
+    gchar bank = PRESETS_USER;
+    GStrv names;
+    gchar *name;
+
+    g_assert(harness_open(TEST_SPEC ",latency=300"));
+    g_assert(harness_identify(1));
+
+    /* reply to request which timed out must not answer next one */
+    g_assert(device_request_wait(REQUEST_PRESET_NAMES, &bank, 1,
+                                 RECEIVE_PRESET_NAMES, 50) == NULL);
+    set_preset_name(0, "Renamed");
+    names = query_preset_names(PRESETS_USER);
+    g_assert(names != NULL);
+    g_assert_cmpstr(names[0], ==, "Renamed");
+    g_strfreev(names);
+
+    /* nor the one for other bank */
+    g_assert(device_request_wait(REQUEST_PRESET_NAMES, &bank, 1,
+                                 RECEIVE_PRESET_NAMES, 50) == NULL);
+    names = query_preset_names(PRESETS_SYSTEM);
+    g_assert(names != NULL);
+    name = default_preset_name(PRESETS_SYSTEM, 0);
+    g_assert_cmpstr(names[0], ==, name);
+    g_free(name);
+    g_strfreev(names);
+
+    g_assert_cmpuint(request_stats[RECEIVE_PRESET_NAMES].timed_out, ==, 2);
+    g_assert_cmpuint(request_stats[RECEIVE_PRESET_NAMES].completed, ==, 2);
+
+    harness_close();
+}
+
+static void test_drop_recovery()
+{
+    guint answered = 0;
+    gint i;
+
+    g_assert(harness_open(TEST_SPEC ",drop=20,jitter=300"));
+    g_assert(harness_identify(5));
+
+    /* replies get lost or come after timeout; those which are taken
+       must answer own request, not an older one of the same bank */
+    for (i = 0; i < 24; i++) {
+        gchar bank = (i % 3) ? PRESETS_USER : PRESETS_SYSTEM;
+        gchar *name = g_strdup_printf("Request %d", i);
+        GString *msg = g_string_new(NULL);
+        GString *reply;
+        NameIter names;
+
+        g_string_append_printf(msg, "%c%c%s%c", bank, 0, name, 0);
+        send_message(RECEIVE_PRESET_NAME, msg->str, msg->len);
+        g_string_free(msg, TRUE);
+
+        reply = device_request_wait(REQUEST_PRESET_NAMES, &bank, 1,
+                                    RECEIVE_PRESET_NAMES, 200);
+        if (reply != NULL) {
+            g_assert(name_iter_init(&names, reply));
+            g_assert_cmpint(names.bank, ==, bank);
+            g_assert_cmpstr(name_iter_next(&names), ==, name);
+            g_string_free(reply, TRUE);
+            answered++;
+        }
+        g_free(name);
+    }
+
+    g_assert_cmpuint(answered, >, 0);
+    g_assert_cmpuint(request_stats[RECEIVE_PRESET_NAMES].completed, ==,
+                     answered);
+
+    harness_close();
+}
+
+static void test_corrupt_recovery()
+{
+    Preset *clean[2][TEST_PRESETS];
+    guint banks[2] = {PRESETS_USER, PRESETS_SYSTEM};
+    guint corrupted = 0;
+    gint b, i, pass;
+
+    g_assert(harness_open(TEST_SPEC));
+    g_assert(harness_identify(1));
+    for (b = 0; b < 2; b++) {
+        for (i = 0; i < TEST_PRESETS; i++) {
+            clean[b][i] = harness_read_preset(banks[b], i, REQUEST_TIMEOUT);
+            g_assert(clean[b][i] != NULL);
+        }
+    }
+    harness_close();
+
+    /* presets are the same, simulator is seeded with product ID */
+    g_assert(harness_open(TEST_SPEC ",corrupt=2"));
+    g_assert(harness_identify(5));
+    for (pass = 0; pass < 8; pass++) {
+        for (b = 0; b < 2; b++) {
+            for (i = 0; i < TEST_PRESETS; i++) {
+                Preset *preset = harness_read_preset(banks[b], i,
+                                                     2 * REQUEST_TIMEOUT);
+
+                g_assert(preset != NULL);
+                g_assert(harness_presets_equal(clean[b][i], preset));
+                preset_free(preset);
+            }
+        }
+    }
+
+    corrupted = messages_bad[RECEIVE_PRESET_START] +
+                messages_bad[RECEIVE_PRESET_PARAMETERS] +
+                messages_bad[RECEIVE_PRESET_END];
+    g_assert_cmpuint(corrupted, >, 0);
+    harness_close();
+
+    for (b = 0; b < 2; b++) {
+        for (i = 0; i < TEST_PRESETS; i++)
+            preset_free(clean[b][i]);
+    }
+}
+
+/**
+ *  \return amount of global parameters known in edit buffer.
+ **/
+static guint count_known_globals()
+{
+    guint known = 0;
+    guint value;
+    guint x;
+
+    for (x = 0; x < n_xml_settings; x++) {
+        if (xml_settings[x].position == GLOBAL_POSITION &&
+            edit_buffer_get_param(xml_settings[x].id, GLOBAL_POSITION,
+                                  &value))
+            known++;
+    }
+
+    return known;
+}
+
+static void test_corrupt_globals()
+{
+    /* every try gets corrupted, parameters must not be applied */
+    g_assert(harness_open(TEST_SPEC ",corrupt=100"));
+    send_message(REQUEST_GLOBAL_PARAMETERS, NULL, 0);
+    g_assert(harness_wait_count(&messages_bad[RECEIVE_GLOBAL_PARAMETERS],
+                                MAX_REREQUESTS + 1, REQUEST_TIMEOUT));
+    g_assert_cmpuint(count_known_globals(), ==, 0);
+    harness_close();
+
+    g_assert(harness_open(TEST_SPEC));
+    send_message(REQUEST_GLOBAL_PARAMETERS, NULL, 0);
+    /* replies are handled in order, so parameters have been applied
+       once next reply arrives */
+    g_assert(harness_identify(1));
+    g_assert_cmpuint(messages_good[RECEIVE_GLOBAL_PARAMETERS], ==, 1);
+    g_assert_cmpuint(count_known_globals(), >, 0);
+    harness_close();
+}
+
+int main(int argc, char *argv[])
+{
+    harness_init(&argc, &argv);
+
+    g_test_add_func("/device/request-reply", test_request_reply);
+    g_test_add_func("/device/preset-load", test_preset_load);
+    g_test_add_func("/device/preset-store", test_preset_store);
+    g_test_add_func("/device/late-reply", test_late_reply);
+    g_test_add_func("/device/drop-recovery", test_drop_recovery);
+    g_test_add_func("/device/corrupt-recovery", test_corrupt_recovery);
+    g_test_add_func("/device/corrupt-globals", test_corrupt_globals);
+
+    return g_test_run();
+}
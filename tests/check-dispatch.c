@@ -0,0 +1,208 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include "harness.h"
+
+/*
+ * Message dispatch under a flood of replies nobody asked for. Waiters
+ * of other message IDs, and of other keys of the same ID, must get their
+ * own replies in time, and flooded replies must not pile up anywhere.
+ * Corrupted messages are never dispatched, and only the request they
+ * answer is repeated.
+ */
+
+#define FLOOD_SPEC HARNESS_MODEL ",presets=5"
+#define FLOOD_ROUNDS 100
+
+static volatile gboolean flood_stop;
+
+/**
+ *  \param data unused
+ *
+ *  Keeps asking for device configuration and user preset names, without
+ *  registering requests, until flood_stop is set.
+ *
+ *  \return amount of requests of each kind sent.
+ **/
+static gpointer flood_thread(gpointer data)
+{
+    gchar bank = PRESETS_USER;
+    guint sent = 0;
+
+    while (!flood_stop) {
+        send_message(REQUEST_DEVICE_CONFIGURATION, NULL, 0);
+        send_message(REQUEST_PRESET_NAMES, &bank, 1);
+        sent++;
+        g_usleep(200);
+    }
+
+    return GUINT_TO_POINTER(sent);
+}
+
+/**
+ *  \param data unused
+ *
+ *  Asks for system preset names FLOOD_ROUNDS times. Flooded replies
+ *  of user bank share the slot, but must not answer these requests.
+ *
+ *  \return NULL.
+ **/
+static gpointer names_thread(gpointer data)
+{
+    gchar bank = PRESETS_SYSTEM;
+    gint i;
+
+    for (i = 0; i < FLOOD_ROUNDS; i++) {
+        GString *reply;
+        NameIter names;
+
+        reply = device_request_wait(REQUEST_PRESET_NAMES, &bank, 1,
+                                    RECEIVE_PRESET_NAMES, REQUEST_TIMEOUT);
+        g_assert(reply != NULL);
+        g_assert(name_iter_init(&names, reply));
+        g_assert_cmpint(names.bank, ==, PRESETS_SYSTEM);
+        g_string_free(reply, TRUE);
+    }
+
+    return NULL;
+}
+
+static void test_flood()
+{
+    GThread *flood, *names;
+    guint flooded;
+    gint i;
+
+    g_assert(harness_open(FLOOD_SPEC));
+    g_assert(harness_identify(1));
+
+    flood_stop = FALSE;
+    flood = g_thread_create(flood_thread, NULL, TRUE, NULL);
+    names = g_thread_create(names_thread, NULL, TRUE, NULL);
+
+    for (i = 0; i < FLOOD_ROUNDS; i++)
+        g_assert(harness_identify(1));
+
+    g_thread_join(names);
+    flood_stop = TRUE;
+    flooded = GPOINTER_TO_UINT(g_thread_join(flood));
+    g_assert_cmpuint(flooded, >, 0);
+
+    /* every flooded reply got received and dropped */
+    g_assert(harness_wait_count(
+                 &messages_good[RECEIVE_DEVICE_CONFIGURATION],
+                 flooded, REQUEST_TIMEOUT));
+    g_assert(harness_wait_count(&messages_good[RECEIVE_PRESET_NAMES],
+                                flooded + FLOOD_ROUNDS, REQUEST_TIMEOUT));
+    g_assert_cmpuint(messages_good[RECEIVE_DEVICE_CONFIGURATION], ==,
+                     flooded);
+    g_assert_cmpuint(messages_good[RECEIVE_PRESET_NAMES], ==,
+                     flooded + FLOOD_ROUNDS);
+
+    g_assert_cmpuint(request_stats[RECEIVE_WHO_AM_I].completed, ==,
+                     FLOOD_ROUNDS + 1);
+    g_assert_cmpuint(request_stats[RECEIVE_PRESET_NAMES].completed, ==,
+                     FLOOD_ROUNDS);
+
+    /* nothing is left waiting in any slot */
+    g_mutex_lock(message_queue_mutex);
+    for (i = 0; i < N_MESSAGE_SLOTS; i++) {
+        g_assert(g_queue_is_empty(message_slots[i].requests));
+        g_assert(g_queue_is_empty(message_slots[i].late));
+    }
+    g_mutex_unlock(message_queue_mutex);
+
+    harness_close();
+}
+
+static void test_corrupt()
+{
+    gchar n = 0x12;
+    guchar *msg;
+    gint len;
+
+    message_slots_init();
+    memset(messages_good, 0, sizeof(messages_good));
+    memset(messages_bad, 0, sizeof(messages_bad));
+
+    /* flip bit of data byte, message must not count as received */
+    msg = harness_message_new(RECEIVE_WHO_AM_I, &n, 1, &len);
+    msg[9] ^= 0x01;
+    harness_feed(msg, len);
+    g_free(msg);
+    g_assert_cmpuint(messages_bad[RECEIVE_WHO_AM_I], ==, 1);
+    g_assert_cmpuint(messages_good[RECEIVE_WHO_AM_I], ==, 0);
+
+    harness_receive(RECEIVE_WHO_AM_I, &n, 1);
+    g_assert_cmpuint(messages_bad[RECEIVE_WHO_AM_I], ==, 1);
+    g_assert_cmpuint(messages_good[RECEIVE_WHO_AM_I], ==, 1);
+
+    message_slots_free();
+}
+
+static void test_corrupt_key()
+{
+    gchar system[] = {PRESETS_SYSTEM, 1, 'S', 0};  /* one name */
+    RememberedRequest *request;
+    gchar bank;
+    guchar *msg;
+    gint len;
+
+    message_slots_init();
+    harness_null_writer_start();
+    memset(messages_bad, 0, sizeof(messages_bad));
+
+    bank = PRESETS_USER;
+    send_message(REQUEST_PRESET_NAMES, &bank, 1);
+    bank = PRESETS_SYSTEM;
+    send_message(REQUEST_PRESET_NAMES, &bank, 1);
+
+    /* flip bit of last name byte, header still tells the bank */
+    msg = harness_message_new(RECEIVE_PRESET_NAMES, system, sizeof(system),
+                              &len);
+    msg[len - 3] ^= 0x01;
+    harness_feed(msg, len);
+    g_free(msg);
+    g_assert_cmpuint(messages_bad[RECEIVE_PRESET_NAMES], ==, 1);
+
+    g_assert_cmpuint(g_queue_get_length(remembered_requests), ==, 2);
+    request = g_queue_peek_nth(remembered_requests, 0);
+    g_assert_cmpint(request->key, ==, PRESETS_USER);
+    g_assert_cmpint(request->retries, ==, 0);
+    request = g_queue_peek_nth(remembered_requests, 1);
+    g_assert_cmpint(request->key, ==, PRESETS_SYSTEM);
+    g_assert_cmpint(request->retries, ==, 1);
+
+    /* clean reply answers the request of its own bank */
+    harness_receive(RECEIVE_PRESET_NAMES, system, sizeof(system));
+    g_assert_cmpuint(g_queue_get_length(remembered_requests), ==, 1);
+    request = g_queue_peek_head(remembered_requests);
+    g_assert_cmpint(request->key, ==, PRESETS_USER);
+
+    output_writer_finish();
+    message_slots_free();
+}
+
+int main(int argc, char *argv[])
+{
+    harness_init(&argc, &argv);
+
+    g_test_add_func("/dispatch/flood", test_flood);
+    g_test_add_func("/dispatch/corrupt", test_corrupt);
+    g_test_add_func("/dispatch/corrupt-key", test_corrupt_key);
+
+    return g_test_run();
+}
@@ -0,0 +1,153 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include "harness.h"
+#include "pack.h"
+
+/*
+ * pack_data() and SysEx decoder against byte at a time packing, for
+ * every tail length after up to MAX_GROUPS whole groups.
+ */
+
+#define MAX_GROUPS 8
+#define MAX_LEN (7 * MAX_GROUPS + 6)
+
+enum {
+    FILL_RANDOM,
+    FILL_MSB,           /**< every byte has bit 7 set */
+    FILL_ALTERNATE,     /**< bit 7 set in every other byte */
+    N_FILLS
+};
+
+/**
+ *  \param data buffer to fill
+ *  \param len data length
+ *  \param fill one of FILL_*
+ **/
+static void fill_data(guchar *data, gint len, gint fill)
+{
+    gint i;
+
+    for (i = 0; i < len; i++) {
+        switch (fill) {
+            case FILL_RANDOM:
+                data[i] = g_test_rand_int_range(0, 256);
+                break;
+            case FILL_MSB:
+                data[i] = 0x80 | (i & 0x7F);
+                break;
+            case FILL_ALTERNATE:
+                data[i] = (i & 1) ? 0xFF : 0x01;
+                break;
+        }
+    }
+}
+
+/**
+ *  \param packed packed data
+ *  \param len packed data length
+ *  \param split where data is split in two reads
+ *
+ *  Unpacks data the way read thread does.
+ *
+ *  \return unpacked data, must be freed using g_string_free.
+ **/
+static GString *decode(const guchar *packed, gint len, gint split)
+{
+    SysExDecoder decoder;
+
+    memset(&decoder, 0, sizeof(decoder));
+    decoder.state = DECODER_STATUS;
+    decoder.msg = g_string_new(NULL);
+
+    sysex_decoder_unpack(&decoder, packed, split, split < len);
+    sysex_decoder_unpack(&decoder, &packed[split], len - split, FALSE);
+
+    return decoder.msg;
+}
+
+static void test_pack()
+{
+    gint len, fill;
+
+    for (fill = 0; fill < N_FILLS; fill++) {
+        for (len = 0; len <= MAX_LEN; len++) {
+            guchar *data = g_malloc(len + 1);
+            guchar *packed = g_malloc(PACKED_LEN(len) + 1);
+            guchar *expected = g_malloc(PACKED_LEN(len) + 1);
+            guchar checksum = 0x5A, expected_checksum = 0x5A;
+            gint n;
+
+            fill_data(data, len, fill);
+
+            n = pack_data(packed, (const gchar *) data, len, &checksum);
+            g_assert_cmpint(n, ==, PACKED_LEN(len));
+            g_assert_cmpint(scalar_pack(expected, data, len,
+                                        &expected_checksum), ==, n);
+            g_assert(memcmp(packed, expected, n) == 0);
+            g_assert_cmpuint(checksum, ==, expected_checksum);
+
+            g_free(expected);
+            g_free(packed);
+            g_free(data);
+        }
+    }
+}
+
+static void test_round_trip()
+{
+    gint len, fill, split;
+
+    for (fill = 0; fill < N_FILLS; fill++) {
+        for (len = 0; len <= MAX_LEN; len++) {
+            guchar *data = g_malloc(len + 1);
+            guchar *packed = g_malloc(PACKED_LEN(len) + 1);
+            guchar *expected = g_malloc(len + 1);
+            guchar checksum = 0;
+            gint n;
+
+            fill_data(data, len, fill);
+            n = pack_data(packed, (const gchar *) data, len, &checksum);
+
+            g_assert_cmpint(scalar_unpack(expected, packed, n), ==, len);
+            g_assert(memcmp(expected, data, len) == 0);
+
+            /* groups may be split anywhere between reads */
+            for (split = 0; split <= n; split++) {
+                GString *msg = decode(packed, n, split);
+
+                g_assert_cmpuint(msg->len, ==, len);
+                g_assert(memcmp(msg->str, data, len) == 0);
+                g_string_free(msg, TRUE);
+            }
+
+            g_free(expected);
+            g_free(packed);
+            g_free(data);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    harness_init(&argc, &argv);
+    unpack_msb_table_init(NULL);
+
+    g_test_add_func("/pack/pack", test_pack);
+    g_test_add_func("/pack/round-trip", test_round_trip);
+
+    return g_test_run();
+}
@@ -0,0 +1,379 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include "harness.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include "../simulator.h"
+
+/*
+ * seq: transport against sequencer port owned by the test. Tests are
+ * skipped when ALSA sequencer is not available.
+ */
+
+#define LARGE_SYSEX_LEN 3000
+#define READ_CHUNK_LEN 1000
+
+typedef struct {
+    snd_seq_t *seq;
+    int port;
+    gchar *address;             /**< seq: address of port */
+} TestPort;
+
+/**
+ *  \param test port to set up
+ *
+ *  Creates sequencer client and port gdigi can connect to.
+ *
+ *  \return TRUE on success, FALSE if sequencer is not available.
+ **/
+static gboolean test_port_open(TestPort *test)
+{
+    if (snd_seq_open(&test->seq, "default", SND_SEQ_OPEN_DUPLEX, 0) < 0)
+        return FALSE;
+    snd_seq_set_client_name(test->seq, "gdigi test");
+
+    test->port = snd_seq_create_simple_port(test->seq, "gdigi test",
+                                            SND_SEQ_PORT_CAP_READ |
+                                            SND_SEQ_PORT_CAP_SUBS_READ |
+                                            SND_SEQ_PORT_CAP_WRITE |
+                                            SND_SEQ_PORT_CAP_SUBS_WRITE,
+                                            SND_SEQ_PORT_TYPE_MIDI_GENERIC |
+                                            SND_SEQ_PORT_TYPE_APPLICATION);
+    if (test->port < 0) {
+        snd_seq_close(test->seq);
+        return FALSE;
+    }
+
+    test->address = g_strdup_printf("seq:%d:%d",
+                                    snd_seq_client_id(test->seq),
+                                    test->port);
+    return TRUE;
+}
+
+static void test_port_close(TestPort *test)
+{
+    snd_seq_close(test->seq);
+    g_free(test->address);
+}
+
+/**
+ *  \param test test port
+ *  \param data bytes to send
+ *  \param len length of data
+ *
+ *  Sends data to subscribers as single SysEx event, no matter how large.
+ **/
+static void test_port_send(TestPort *test, const guchar *data, gsize len)
+{
+    snd_seq_event_t ev;
+
+    snd_seq_ev_clear(&ev);
+    snd_seq_ev_set_source(&ev, test->port);
+    snd_seq_ev_set_subs(&ev);
+    snd_seq_ev_set_direct(&ev);
+    snd_seq_ev_set_sysex(&ev, len, (void *) data);
+    g_assert_cmpint(snd_seq_event_output_direct(test->seq, &ev), >=, 0);
+}
+
+/**
+ *  \param test test port
+ *
+ *  Receives SysEx events until one ends with F7.
+ *
+ *  \return received message, must be freed using g_byte_array_free.
+ **/
+static GByteArray *test_port_receive(TestPort *test)
+{
+    GByteArray *msg = g_byte_array_new();
+    snd_seq_event_t *ev;
+
+    do {
+        g_assert_cmpint(snd_seq_event_input(test->seq, &ev), >=, 0);
+        if (ev->type == SND_SEQ_EVENT_SYSEX)
+            g_byte_array_append(msg, ev->data.ext.ptr, ev->data.ext.len);
+    } while (msg->len == 0 || msg->data[msg->len - 1] != 0xF7);
+
+    return msg;
+}
+
+/**
+ *  \param transport transport
+ *  \param timeout in ms
+ *
+ *  \return TRUE if transport has input, FALSE on timeout.
+ **/
+static gboolean wait_readable(Transport *transport, gint timeout)
+{
+    gint npfds = transport_poll_descriptors_count(transport);
+    struct pollfd *pfds = g_new(struct pollfd, npfds);
+    gboolean readable = FALSE;
+
+    transport_poll_descriptors(transport, pfds, npfds);
+    if (poll(pfds, npfds, timeout) > 0)
+        readable = (transport_poll_revents(transport, pfds, npfds) & POLLIN);
+
+    g_free(pfds);
+    return readable;
+}
+
+/**
+ *  \return SysEx message of LARGE_SYSEX_LEN bytes.
+ **/
+static guchar *large_sysex_new()
+{
+    guchar *msg = g_malloc(LARGE_SYSEX_LEN);
+    gint i;
+
+    msg[0] = 0xF0;
+    for (i = 1; i < LARGE_SYSEX_LEN - 1; i++)
+        msg[i] = i & 0x7F;
+    msg[LARGE_SYSEX_LEN - 1] = 0xF7;
+
+    return msg;
+}
+
+static void test_large_event()
+{
+    TestPort test;
+    Transport *seq;
+    guchar *msg = large_sysex_new();
+    guchar buf[READ_CHUNK_LEN];
+    GByteArray *received = g_byte_array_new();
+    gssize n;
+
+    g_assert(test_port_open(&test));
+    seq = transport_open(test.address);
+    g_assert(seq != NULL);
+
+    /* event larger than read buffer comes in pieces, none are lost */
+    test_port_send(&test, msg, LARGE_SYSEX_LEN);
+    while (received->len < LARGE_SYSEX_LEN) {
+        g_assert(wait_readable(seq, 1000));
+        n = transport_read(seq, buf, sizeof(buf));
+        if (n == -EAGAIN)
+            continue;
+        g_assert_cmpint(n, >, 0);
+        g_byte_array_append(received, buf, n);
+    }
+
+    g_assert_cmpuint(received->len, ==, LARGE_SYSEX_LEN);
+    g_assert(memcmp(received->data, msg, LARGE_SYSEX_LEN) == 0);
+
+    /* reader must not be woken up once everything was read */
+    g_assert(!wait_readable(seq, 0));
+
+    transport_close(seq);
+    test_port_close(&test);
+    g_byte_array_free(received, TRUE);
+    g_free(msg);
+}
+
+static void test_write()
+{
+    TestPort test;
+    Transport *seq;
+    guchar *msg = large_sysex_new();
+    GByteArray *received;
+
+    g_assert(test_port_open(&test));
+    seq = transport_open(test.address);
+    g_assert(seq != NULL);
+
+    g_assert_cmpint(transport_write(seq, msg, LARGE_SYSEX_LEN), ==,
+                    LARGE_SYSEX_LEN);
+    received = test_port_receive(&test);
+    g_assert_cmpuint(received->len, ==, LARGE_SYSEX_LEN);
+    g_assert(memcmp(received->data, msg, LARGE_SYSEX_LEN) == 0);
+
+    transport_close(seq);
+    test_port_close(&test);
+    g_byte_array_free(received, TRUE);
+    g_free(msg);
+}
+
+typedef struct {
+    TestPort port;
+    int sock;                   /**< host end of socketpair to simulator */
+    int stop_fd;                /**< readable once bridge should stop */
+    GThread *thread;
+    Simulator *simulator;
+} Bridge;
+
+/**
+ *  \param data Bridge
+ *
+ *  Passes bytes between test port and simulator. Simulator output is sent
+ *  in events as large as it was read, so gdigi has to split them.
+ *
+ *  \return NULL.
+ **/
+static gpointer bridge_thread(gpointer data)
+{
+    Bridge *bridge = data;
+    gint nseq = snd_seq_poll_descriptors_count(bridge->port.seq, POLLIN);
+    struct pollfd *pfds = g_new(struct pollfd, nseq + 2);
+    guchar buf[8192];
+    snd_seq_event_t *ev;
+    gssize n;
+
+    snd_seq_poll_descriptors(bridge->port.seq, pfds, nseq, POLLIN);
+    pfds[nseq].fd = bridge->sock;
+    pfds[nseq].events = POLLIN;
+    pfds[nseq+1].fd = bridge->stop_fd;
+    pfds[nseq+1].events = POLLIN;
+
+    for (;;) {
+        unsigned short revents;
+        gint i;
+
+        for (i = 0; i < nseq + 2; i++)
+            pfds[i].revents = 0;
+        if (poll(pfds, nseq + 2, -1) < 0 && errno != EINTR)
+            break;
+
+        if (pfds[nseq+1].revents & POLLIN)
+            break;
+
+        if (pfds[nseq].revents & (POLLIN | POLLHUP)) {
+            n = read(bridge->sock, buf, sizeof(buf));
+            if (n <= 0)
+                break;
+            test_port_send(&bridge->port, buf, n);
+        }
+
+        snd_seq_poll_descriptors_revents(bridge->port.seq, pfds, nseq,
+                                         &revents);
+        if (!(revents & POLLIN))
+            continue;
+
+        do {
+            if (snd_seq_event_input(bridge->port.seq, &ev) < 0)
+                break;
+            if (ev->type == SND_SEQ_EVENT_SYSEX &&
+                write(bridge->sock, ev->data.ext.ptr,
+                      ev->data.ext.len) < 0)
+                break;
+        } while (snd_seq_event_input_pending(bridge->port.seq, 0) > 0);
+    }
+
+    g_free(pfds);
+    return NULL;
+}
+
+/**
+ *  \param bridge bridge to set up
+ *  \param spec simulator spec, see simulator_new()
+ *
+ *  Starts simulator behind test port.
+ **/
+static void bridge_start(Bridge *bridge, const gchar *spec)
+{
+    Transport *device;
+    gchar *address;
+    int fds[2];
+
+    g_assert(test_port_open(&bridge->port));
+    g_assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+
+    /* simulator thread must never block on write */
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    address = g_strdup_printf("fd:%d", fds[1]);
+    device = transport_open(address);
+    g_free(address);
+    g_assert(device != NULL);
+
+    bridge->simulator = simulator_new(spec, device);
+    g_assert(bridge->simulator != NULL);
+
+    bridge->sock = fds[0];
+    bridge->stop_fd = eventfd(0, EFD_CLOEXEC);
+    g_assert(bridge->stop_fd >= 0);
+    bridge->thread = g_thread_create(bridge_thread, bridge, TRUE, NULL);
+}
+
+static void bridge_stop(Bridge *bridge)
+{
+    eventfd_write(bridge->stop_fd, 1);
+    g_thread_join(bridge->thread);
+    close(bridge->stop_fd);
+
+    /* simulator thread exits once it reads end of stream */
+    shutdown(bridge->sock, SHUT_RDWR);
+    simulator_free(bridge->simulator);
+    close(bridge->sock);
+
+    test_port_close(&bridge->port);
+}
+
+static void test_simulator()
+{
+    Bridge bridge;
+    Preset *preset;
+    GStrv names;
+    gint i;
+
+    bridge_start(&bridge, HARNESS_MODEL ",presets=5");
+    g_assert(harness_open_port(bridge.port.address));
+    g_assert(harness_identify(1));
+    g_assert_cmpint(product_id, ==, 0x09);
+
+    names = query_preset_names(PRESETS_USER);
+    g_assert(names != NULL);
+    g_assert_cmpint(g_strv_length(names), ==, 5);
+    g_strfreev(names);
+
+    for (i = 0; i < 5; i++) {
+        preset = harness_read_preset(PRESETS_USER, i, REQUEST_TIMEOUT);
+        g_assert(preset != NULL);
+        g_assert_cmpuint(preset->params->len, >, 0);
+        preset_free(preset);
+    }
+
+    harness_close();
+    bridge_stop(&bridge);
+}
+
+/**
+ *  \return TRUE if ALSA sequencer can be opened.
+ **/
+static gboolean sequencer_available()
+{
+    snd_seq_t *seq;
+
+    if (snd_seq_open(&seq, "default", SND_SEQ_OPEN_DUPLEX, 0) < 0)
+        return FALSE;
+
+    snd_seq_close(seq);
+    return TRUE;
+}
+
+int main(int argc, char *argv[])
+{
+    harness_init(&argc, &argv);
+
+    if (!sequencer_available()) {
+        g_print("ALSA sequencer not available, skipping seq: tests\n");
+        return 0;
+    }
+
+    g_test_add_func("/seq/large-event", test_large_event);
+    g_test_add_func("/seq/write", test_write);
+    g_test_add_func("/seq/simulator", test_simulator);
+
+    return g_test_run();
+}
@@ -0,0 +1,363 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef GDIGI_TESTS_HARNESS_H
+#define GDIGI_TESTS_HARNESS_H
+
+/*
+ * Every test and benchmark program is a single translation unit that
+ * includes gdigi.c, so it can use static functions of the MIDI layer.
+ * main() of gdigi.c is renamed and never called. Programs either hand
+ * received messages to the MIDI layer using harness_receive(), or talk
+ * to simulated device over loopback: transport set up by
+ * harness_open(). GUI is never created unless a program does it,
+ * received parameters only reach the edit buffer.
+ */
+
+#define main gdigi_main
+#include "../gdigi.c"
+#undef main
+
+/** model simulated unless test asks for another one */
+#define HARNESS_MODEL "RP355"
+
+/**
+ *  \param argc pointer to main() argc
+ *  \param argv pointer to main() argv
+ *
+ *  Initializes GLib test framework. Unlike g_test_init() alone, warnings
+ *  are not fatal, as tests provoke timeouts and corrupted replies on
+ *  purpose.
+ **/
+static void harness_init(int *argc, char ***argv)
+{
+    g_thread_init(NULL);
+    g_test_init(argc, argv, NULL);
+    g_log_set_always_fatal(G_LOG_FATAL_MASK);
+}
+
+/**
+ *  \param data unused
+ *
+ *  Stands in for MIDI writer thread while there is no device, throwing
+ *  away everything queued in output ring.
+ *
+ *  \return NULL.
+ **/
+static gpointer harness_null_writer_thread(gpointer data)
+{
+    for (;;) {
+        guint tail = g_atomic_int_get(&output_ring_tail);
+        gboolean stop;
+
+        g_mutex_lock(output_mutex);
+        g_atomic_int_set(&output_writer_sleeping, TRUE);
+        while (((guint)g_atomic_int_get(&output_ring_head) == tail) &&
+               !output_writer_stop) {
+            g_cond_wait(output_data_cond, output_mutex);
+        }
+        g_atomic_int_set(&output_writer_sleeping, FALSE);
+        stop = output_writer_stop &&
+               ((guint)g_atomic_int_get(&output_ring_head) == tail);
+        g_mutex_unlock(output_mutex);
+
+        if (stop)
+            break;
+
+        g_atomic_int_set(&output_ring_tail,
+                         g_atomic_int_get(&output_ring_head));
+
+        if (g_atomic_int_get(&output_producer_waiting)) {
+            g_mutex_lock(output_mutex);
+            g_cond_signal(output_space_cond);
+            g_mutex_unlock(output_mutex);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ *  Sets up output ring like output_writer_start() does, but with writer
+ *  thread which discards data. Stop it using output_writer_finish().
+ **/
+static void harness_null_writer_start()
+{
+    output_producer_mutex = g_mutex_new();
+    output_mutex = g_mutex_new();
+    output_data_cond = g_cond_new();
+    output_space_cond = g_cond_new();
+    output_writer_stop = FALSE;
+
+    output_thread = g_thread_create(harness_null_writer_thread, NULL, TRUE,
+                                    NULL);
+}
+
+/**
+ *  \param port device port, like "loopback:RP355"
+ *
+ *  Opens device port and starts MIDI threads, like main() does.
+ *  Device is not identified yet, see harness_identify().
+ *
+ *  \return TRUE on success, FALSE on error.
+ **/
+static gboolean harness_open_port(const gchar *port)
+{
+    device_port = g_strdup(port);
+    if (open_device() == TRUE) {
+        g_free(device_port);
+        device_port = NULL;
+        return FALSE;
+    }
+
+    memset(messages_good, 0, sizeof(messages_good));
+    memset(messages_bad, 0, sizeof(messages_bad));
+    memset(request_stats, 0, sizeof(request_stats));
+    edit_buffer_invalidate();
+
+    message_slots_init();
+    output_writer_start();
+
+    return read_thread_start() == FALSE;
+}
+
+/**
+ *  \param spec simulator spec, see simulator_new()
+ *
+ *  Starts simulated device on loopback: transport and MIDI threads.
+ *
+ *  \return TRUE on success, FALSE on error.
+ **/
+static gboolean harness_open(const gchar *spec)
+{
+    gchar *port = g_strconcat("loopback:", spec, NULL);
+    gboolean ok = harness_open_port(port);
+
+    g_free(port);
+    return ok;
+}
+
+/**
+ *  \param tries how many times to ask, replies may be dropped
+ *
+ *  Asks simulated device who it is, setting device_id, family_id and
+ *  product_id used in sent messages.
+ *
+ *  \return TRUE on success, FALSE if device didn't answer.
+ **/
+static gboolean harness_identify(gint tries)
+{
+    while (tries-- > 0) {
+        if (request_who_am_i(&device_id, &family_id, &product_id))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ *  Stops MIDI threads and simulated device.
+ **/
+static void harness_close()
+{
+    read_thread_finish();
+    output_writer_finish();
+    message_slots_free();
+
+    transport_close(transport);
+    transport = NULL;
+
+    g_free(device_port);
+    device_port = NULL;
+}
+
+/**
+ *  \param count message counter, like messages_good[RECEIVE_WHO_AM_I]
+ *  \param value value to wait for
+ *  \param timeout in ms
+ *
+ *  Waits until read thread has counted given amount of messages.
+ *
+ *  \return TRUE if count was reached, FALSE on timeout.
+ **/
+static gboolean harness_wait_count(volatile guint *count, guint value,
+                                   guint timeout)
+{
+    gint64 end = g_get_monotonic_time() + timeout * 1000;
+
+    while (*count < value) {
+        if (g_get_monotonic_time() > end)
+            return FALSE;
+        g_usleep(1000);
+    }
+
+    return TRUE;
+}
+
+/**
+ *  \param bank preset bank
+ *  \param index preset index
+ *  \param timeout in ms
+ *
+ *  Reads preset stored on simulated device.
+ *
+ *  \return Preset which must be freed using preset_free, or NULL if
+ *          device didn't reply.
+ **/
+static Preset *harness_read_preset(guint bank, guint index, guint timeout)
+{
+    gchar data[2] = {bank, index};
+    GList *list;
+    Preset *preset;
+
+    list = device_request_wait(REQUEST_PRESET, data, sizeof(data),
+                               RECEIVE_PRESET_START, timeout);
+    if (list == NULL)
+        return NULL;
+
+    preset = create_preset_from_data(list);
+    message_list_free(list);
+
+    return preset;
+}
+
+/**
+ *  \param a preset
+ *  \param b preset
+ *
+ *  \return TRUE if presets have same name and parameters.
+ **/
+static gboolean harness_presets_equal(Preset *a, Preset *b)
+{
+    GArray *diffs = preset_diff(a, b);
+    gboolean equal = (diffs->len == 0 && g_strcmp0(a->name, b->name) == 0);
+
+    g_array_free(diffs, TRUE);
+    return equal;
+}
+
+static SysExDecoder harness_decoder;  /* decodes harness_receive() input */
+
+/**
+ *  \param procedure procedure ID
+ *  \param data unpacked message data
+ *  \param len data length
+ *  \param n set to message length
+ *
+ *  Builds message as device sends it.
+ *
+ *  \return message, must be freed using g_free.
+ **/
+static guchar *harness_message_new(gint procedure, const gchar *data,
+                                   gint len, gint *n)
+{
+    guchar *msg = g_malloc(SYSEX_LEN(len));
+    guchar checksum;
+
+    msg[0] = 0xF0;          /* SysEx status byte */
+    msg[1] = 0x00;          /* Manufacturer ID   */
+    msg[2] = 0x00;
+    msg[3] = 0x10;
+    msg[4] = device_id;
+    msg[5] = family_id;
+    msg[6] = product_id;
+    msg[7] = procedure;
+
+    checksum = msg[3] ^ msg[4] ^ msg[5] ^ msg[6] ^ msg[7];
+    *n = 8;
+    *n += pack_data(&msg[*n], data, len, &checksum);
+    msg[(*n)++] = checksum;
+    msg[(*n)++] = 0xF7;
+
+    return msg;
+}
+
+/**
+ *  \param msg message as device sends it
+ *  \param len message length
+ *
+ *  Feeds message to decoder, as read thread does once device sent it.
+ **/
+static void harness_feed(const guchar *msg, gint len)
+{
+    if (harness_decoder.msg == NULL) {
+        unpack_msb_table_init(NULL);
+        harness_decoder.state = DECODER_IDLE;
+        harness_decoder.msg = g_string_sized_new(INPUT_CHUNK_SIZE);
+    }
+
+    sysex_decoder_feed(&harness_decoder, msg, len);
+}
+
+/**
+ *  \param procedure procedure ID
+ *  \param data unpacked message data
+ *  \param len data length
+ *
+ *  Hands message to MIDI layer as if device sent it.
+ **/
+static void harness_receive(gint procedure, const gchar *data, gint len)
+{
+    gint n;
+    guchar *msg = harness_message_new(procedure, data, len, &n);
+
+    harness_feed(msg, n);
+    g_free(msg);
+}
+
+extern XmlSettings xml_settings[];
+extern guint n_xml_settings;
+
+/**
+ *  \param seed shifts values, parameters built using different seeds
+ *              differ
+ *
+ *  Builds parameters like those of a preset read from device, one for
+ *  every xml_settings entry which isn't global. Values are spread over
+ *  value ranges, so label lookups don't all hit the first label.
+ *
+ *  \return GArray of SettingParam, must be freed using g_array_free.
+ **/
+static GArray *harness_params_new(guint seed)
+{
+    GArray *params = g_array_new(FALSE, FALSE, sizeof(SettingParam));
+    guint x;
+
+    for (x = 0; x < n_xml_settings; x++) {
+        XmlSettings *xml = &xml_settings[x];
+        SettingParam param;
+        gdouble min = 0.0, max = 0.0;
+        gboolean custom;
+
+        if (xml->position == GLOBAL_POSITION)
+            continue;
+
+        if (xml->values != NULL)
+            get_values_info(xml->values, &min, &max, &custom);
+
+        memset(&param, 0, sizeof(param));
+        param.id = xml->id;
+        param.position = xml->position;
+        param.value = min;
+        if (max > min)
+            param.value += (x + seed) % ((guint) (max - min) + 1);
+        g_array_append_val(params, param);
+    }
+
+    return params;
+}
+
+#endif /* GDIGI_TESTS_HARNESS_H */
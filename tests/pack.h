@@ -0,0 +1,75 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef GDIGI_TESTS_PACK_H
+#define GDIGI_TESTS_PACK_H
+
+#include <glib.h>
+
+/*
+ * Byte at a time 8-into-7 packing, as gdigi did it before pack_group()
+ * and unpack_group(). Reference for tests and benchmarks.
+ */
+
+/**
+ *  \param dest buffer to store packed data, at least PACKED_LEN(len) long
+ *  \param src data to be packed
+ *  \param len data length
+ *  \param checksum checksum to be updated with packed bytes
+ *
+ *  \return packed data length
+ **/
+static gint scalar_pack(guchar *dest, const guchar *src, gint len,
+                        guchar *checksum)
+{
+    gint i, j, n = 0;
+
+    for (i = 0; i < len; i += 7) {
+        guchar *status = &dest[n++];
+
+        *status = 0;
+        for (j = 0; j < 7 && i + j < len; j++) {
+            *status |= (src[i + j] & 0x80) >> (j + 1);
+            dest[n++] = src[i + j] & 0x7F;
+        }
+    }
+
+    for (i = 0; i < n; i++)
+        *checksum ^= dest[i];
+
+    return n;
+}
+
+/**
+ *  \param dest buffer to store unpacked data
+ *  \param src packed data
+ *  \param len packed data length
+ *
+ *  \return unpacked data length
+ **/
+static gint scalar_unpack(guchar *dest, const guchar *src, gint len)
+{
+    gint i, j, n = 0;
+
+    for (i = 0; i < len; i += 8) {
+        for (j = 1; j < 8 && i + j < len; j++)
+            dest[n++] = src[i + j] | ((src[i] << j) & 0x80);
+    }
+
+    return n;
+}
+
+#endif /* GDIGI_TESTS_PACK_H */
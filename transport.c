@@ -0,0 +1,1078 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <alsa/asoundlib.h>
+#include "gdigi.h"
+#include "profile.h"
+#include "transport.h"
+#include "simulator.h"
+
+/*
+ * Byte stream between gdigi and device. Backend is chosen by address
+ * prefix:
+ *
+ *   rawmidi:<device>   ALSA rawmidi device, also used without prefix
+ *   seq:<client:port>  ALSA sequencer port
+ *   unix:<path>        Unix stream socket
+ *   fd:<in>[,<out>]    inherited file descriptors, e.g. pipes
+ *   sim:<spec>         simulated device over socketpair
+ *   loopback:<spec>    simulated device over in-memory link
+ *
+ * Calls follow snd_rawmidi conventions: read and write return amount of
+ * bytes or negative errno, -EAGAIN if there is nothing to read. Read
+ * returns 0 once the other end is gone. Read and write may be used from
+ * different threads, but each of them from one thread only.
+ */
+
+/** size of sequencer MIDI event encoder and decoder buffers */
+#define SEQ_BUFFER_SIZE 256
+
+typedef struct {
+    const gchar *name;
+    const gchar *prefix;    /**< address prefix, NULL for internal backends */
+    gboolean (*open)(Transport *transport, const gchar *address);
+    gssize (*read)(Transport *transport, guchar *buf, gsize len);
+    gssize (*write)(Transport *transport, const guchar *buf, gsize len);
+    gint (*poll_descriptors_count)(Transport *transport);
+    void (*poll_descriptors)(Transport *transport,
+                             struct pollfd *pfds, gint npfds);
+    unsigned short (*poll_revents)(Transport *transport,
+                                   struct pollfd *pfds, gint npfds);
+    void (*shutdown)(Transport *transport);  /**< peer sees end of stream */
+    void (*close)(Transport *transport);
+} TransportBackend;
+
+struct _Transport {
+    const TransportBackend *backend;
+    gpointer priv;              /**< backend data */
+    gchar *address;
+    gboolean report;            /**< print statistics on close */
+
+    gint64 open_time;           /**< monotonic time transport was opened */
+    guint64 bytes_in;
+    guint64 bytes_out;
+    guint reads;
+    guint writes;
+    gint64 write_time;          /**< microseconds spent in writes */
+    gint64 write_time_max;
+};
+
+/**
+ *  \param backend transport backend
+ *  \param address address, without backend prefix
+ *
+ *  \return new transport, which backend data is not set up yet.
+ **/
+static Transport *transport_new(const TransportBackend *backend,
+                                const gchar *address)
+{
+    Transport *transport = g_slice_new0(Transport);
+
+    transport->backend = backend;
+    transport->address = g_strdup(address);
+    transport->open_time = g_get_monotonic_time();
+
+    return transport;
+}
+
+/**
+ *  \param transport transport
+ *
+ *  Frees transport, which backend data must be gone already.
+ **/
+static void transport_free(Transport *transport)
+{
+    g_free(transport->address);
+    g_slice_free(Transport, transport);
+}
+
+/* File descriptors: Unix sockets and pipes */
+
+typedef struct {
+    int in_fd;
+    int out_fd;                 /**< may equal in_fd */
+    gboolean socket;            /**< out_fd is a socket */
+} FdTransport;
+
+static gssize fd_read(Transport *transport, guchar *buf, gsize len)
+{
+    FdTransport *fd = transport->priv;
+    gssize n = read(fd->in_fd, buf, len);
+
+    return (n < 0) ? -errno : n;
+}
+
+static gssize fd_write(Transport *transport, const guchar *buf, gsize len)
+{
+    FdTransport *fd = transport->priv;
+    gssize n;
+
+    /* sockets must not raise SIGPIPE once the other end is gone */
+    if (fd->socket)
+        n = send(fd->out_fd, buf, len, MSG_NOSIGNAL);
+    else
+        n = write(fd->out_fd, buf, len);
+
+    return (n < 0) ? -errno : n;
+}
+
+static gint fd_poll_descriptors_count(Transport *transport)
+{
+    return 1;
+}
+
+static void fd_poll_descriptors(Transport *transport,
+                                struct pollfd *pfds, gint npfds)
+{
+    FdTransport *fd = transport->priv;
+
+    pfds[0].fd = fd->in_fd;
+    pfds[0].events = POLLIN;
+    pfds[0].revents = 0;
+}
+
+static unsigned short fd_poll_revents(Transport *transport,
+                                      struct pollfd *pfds, gint npfds)
+{
+    return pfds[0].revents;
+}
+
+static void fd_shutdown(Transport *transport)
+{
+    FdTransport *fd = transport->priv;
+
+    if (fd->socket)
+        shutdown(fd->out_fd, SHUT_RDWR);
+}
+
+static void fd_close(Transport *transport)
+{
+    FdTransport *fd = transport->priv;
+
+    if (fd->out_fd != fd->in_fd)
+        close(fd->out_fd);
+    close(fd->in_fd);
+    g_slice_free(FdTransport, fd);
+}
+
+/**
+ *  \param transport transport
+ *  \param in_fd descriptor to read from, taken over
+ *  \param out_fd descriptor to write to, taken over (may equal in_fd)
+ *
+ *  Sets up transport to use file descriptors.
+ **/
+static void fd_transport_init(Transport *transport, int in_fd, int out_fd)
+{
+    FdTransport *fd = g_slice_new(FdTransport);
+    struct stat st;
+
+    fd->in_fd = in_fd;
+    fd->out_fd = out_fd;
+    fd->socket = (fstat(out_fd, &st) == 0 && S_ISSOCK(st.st_mode));
+
+    transport->priv = fd;
+}
+
+static gboolean unix_open(Transport *transport, const gchar *address)
+{
+    struct sockaddr_un addr;
+    int sock;
+
+    if (strlen(address) >= sizeof(addr.sun_path)) {
+        g_warning("Socket path %s is too long", address);
+        return FALSE;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, address);
+
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        g_warning("socket failed: %s", g_strerror(errno));
+        return FALSE;
+    }
+
+    if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        g_warning("Failed to connect to %s: %s", address, g_strerror(errno));
+        close(sock);
+        return FALSE;
+    }
+
+    fd_transport_init(transport, sock, sock);
+    return TRUE;
+}
+
+static gboolean fd_open(Transport *transport, const gchar *address)
+{
+    gchar *end;
+    long in_fd, out_fd;
+
+    in_fd = strtol(address, &end, 10);
+    if (end == address || in_fd < 0)
+        goto invalid;
+
+    if (*end == ',') {
+        const gchar *out = end + 1;
+
+        out_fd = strtol(out, &end, 10);
+        if (end == out || out_fd < 0)
+            goto invalid;
+    } else {
+        out_fd = in_fd;
+    }
+
+    if (*end != '\0')
+        goto invalid;
+
+    if (fcntl(in_fd, F_GETFD) < 0 || fcntl(out_fd, F_GETFD) < 0) {
+        g_warning("Bad file descriptor in %s", address);
+        return FALSE;
+    }
+
+    fd_transport_init(transport, in_fd, out_fd);
+    return TRUE;
+
+invalid:
+    g_warning("Invalid file descriptors %s, expected <in>[,<out>]", address);
+    return FALSE;
+}
+
+static const TransportBackend unix_backend = {
+    "unix", "unix:", unix_open, fd_read, fd_write,
+    fd_poll_descriptors_count, fd_poll_descriptors, fd_poll_revents,
+    fd_shutdown, fd_close
+};
+
+static const TransportBackend fd_backend = {
+    "fd", "fd:", fd_open, fd_read, fd_write,
+    fd_poll_descriptors_count, fd_poll_descriptors, fd_poll_revents,
+    fd_shutdown, fd_close
+};
+
+/* ALSA rawmidi */
+
+typedef struct {
+    snd_rawmidi_t *input;
+    snd_rawmidi_t *output;
+} RawmidiTransport;
+
+static gboolean rawmidi_open(Transport *transport, const gchar *address)
+{
+    RawmidiTransport *midi = g_slice_new0(RawmidiTransport);
+    int err;
+
+    err = snd_rawmidi_open(&midi->input, &midi->output, address,
+                           SND_RAWMIDI_SYNC);
+    if (err) {
+        fprintf(stderr, "snd_rawmidi_open %s failed: %d\n", address, err);
+        g_slice_free(RawmidiTransport, midi);
+        return FALSE;
+    }
+
+    err = snd_rawmidi_nonblock(midi->output, 0);
+    if (err) {
+        fprintf(stderr, "snd_rawmidi_nonblock failed: %d\n", err);
+        snd_rawmidi_close(midi->output);
+        snd_rawmidi_close(midi->input);
+        g_slice_free(RawmidiTransport, midi);
+        return FALSE;
+    }
+
+    snd_rawmidi_read(midi->input, NULL, 0); /* trigger reading */
+
+    transport->priv = midi;
+    return TRUE;
+}
+
+static gssize rawmidi_read(Transport *transport, guchar *buf, gsize len)
+{
+    RawmidiTransport *midi = transport->priv;
+
+    return snd_rawmidi_read(midi->input, buf, len);
+}
+
+static gssize rawmidi_write(Transport *transport, const guchar *buf, gsize len)
+{
+    RawmidiTransport *midi = transport->priv;
+
+    return snd_rawmidi_write(midi->output, buf, len);
+}
+
+static gint rawmidi_poll_descriptors_count(Transport *transport)
+{
+    RawmidiTransport *midi = transport->priv;
+
+    return snd_rawmidi_poll_descriptors_count(midi->input);
+}
+
+static void rawmidi_poll_descriptors(Transport *transport,
+                                     struct pollfd *pfds, gint npfds)
+{
+    RawmidiTransport *midi = transport->priv;
+
+    snd_rawmidi_poll_descriptors(midi->input, pfds, npfds);
+}
+
+static unsigned short rawmidi_poll_revents(Transport *transport,
+                                           struct pollfd *pfds, gint npfds)
+{
+    RawmidiTransport *midi = transport->priv;
+    unsigned short revents;
+    int err;
+
+    err = snd_rawmidi_poll_descriptors_revents(midi->input, pfds, npfds,
+                                               &revents);
+    if (err < 0) {
+        g_warning("cannot get poll events: %s", snd_strerror(err));
+        return POLLERR;
+    }
+
+    return revents;
+}
+
+static void rawmidi_close(Transport *transport)
+{
+    RawmidiTransport *midi = transport->priv;
+
+    snd_rawmidi_drain(midi->output);
+    snd_rawmidi_close(midi->output);
+
+    snd_rawmidi_drain(midi->input);
+    snd_rawmidi_close(midi->input);
+
+    g_slice_free(RawmidiTransport, midi);
+}
+
+static const TransportBackend rawmidi_backend = {
+    "rawmidi", "rawmidi:", rawmidi_open, rawmidi_read, rawmidi_write,
+    rawmidi_poll_descriptors_count, rawmidi_poll_descriptors,
+    rawmidi_poll_revents, NULL, rawmidi_close
+};
+
+/* ALSA sequencer */
+
+typedef struct {
+    snd_seq_t *seq;
+    int port;                   /**< own port, connected both ways */
+    snd_midi_event_t *encoder;
+    snd_midi_event_t *decoder;
+    GByteArray *pending;        /**< rest of SysEx event too large to read */
+    int pending_fd;             /**< readable while pending is not empty */
+} SeqTransport;
+
+static void seq_free(SeqTransport *seq)
+{
+    if (seq->encoder != NULL)
+        snd_midi_event_free(seq->encoder);
+    if (seq->decoder != NULL)
+        snd_midi_event_free(seq->decoder);
+    if (seq->seq != NULL)
+        snd_seq_close(seq->seq);
+    if (seq->pending_fd >= 0)
+        close(seq->pending_fd);
+    g_byte_array_free(seq->pending, TRUE);
+    g_slice_free(SeqTransport, seq);
+}
+
+static gboolean seq_open(Transport *transport, const gchar *address)
+{
+    SeqTransport *seq = g_slice_new0(SeqTransport);
+    snd_seq_addr_t addr;
+    int err;
+
+    seq->pending = g_byte_array_new();
+    seq->pending_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (seq->pending_fd < 0) {
+        g_warning("Failed to create eventfd: %s", g_strerror(errno));
+        seq_free(seq);
+        return FALSE;
+    }
+
+    err = snd_seq_open(&seq->seq, "default", SND_SEQ_OPEN_DUPLEX, 0);
+    if (err < 0) {
+        g_warning("snd_seq_open failed: %s", snd_strerror(err));
+        seq_free(seq);
+        return FALSE;
+    }
+    snd_seq_set_client_name(seq->seq, "gdigi");
+
+    seq->port = snd_seq_create_simple_port(seq->seq, "gdigi",
+                                           SND_SEQ_PORT_CAP_READ |
+                                           SND_SEQ_PORT_CAP_SUBS_READ |
+                                           SND_SEQ_PORT_CAP_WRITE |
+                                           SND_SEQ_PORT_CAP_SUBS_WRITE,
+                                           SND_SEQ_PORT_TYPE_MIDI_GENERIC |
+                                           SND_SEQ_PORT_TYPE_APPLICATION);
+    if (seq->port < 0) {
+        g_warning("Failed to create sequencer port: %s",
+                  snd_strerror(seq->port));
+        seq_free(seq);
+        return FALSE;
+    }
+
+    err = snd_seq_parse_address(seq->seq, &addr, address);
+    if (err < 0) {
+        g_warning("Invalid sequencer port %s: %s", address, snd_strerror(err));
+        seq_free(seq);
+        return FALSE;
+    }
+
+    if ((err = snd_seq_connect_to(seq->seq, seq->port,
+                                  addr.client, addr.port)) < 0 ||
+        (err = snd_seq_connect_from(seq->seq, seq->port,
+                                    addr.client, addr.port)) < 0) {
+        g_warning("Failed to connect to sequencer port %s: %s",
+                  address, snd_strerror(err));
+        seq_free(seq);
+        return FALSE;
+    }
+
+    if ((err = snd_midi_event_new(SEQ_BUFFER_SIZE, &seq->encoder)) < 0 ||
+        (err = snd_midi_event_new(SEQ_BUFFER_SIZE, &seq->decoder)) < 0) {
+        g_warning("snd_midi_event_new failed: %s", snd_strerror(err));
+        seq_free(seq);
+        return FALSE;
+    }
+    /* SysEx decoder in gdigi.c doesn't expect running status */
+    snd_midi_event_no_status(seq->decoder, 1);
+
+    transport->priv = seq;
+    return TRUE;
+}
+
+static gssize seq_read(Transport *transport, guchar *buf, gsize len)
+{
+    SeqTransport *seq = transport->priv;
+    snd_seq_event_t *ev;
+    eventfd_t value;
+    gsize n = 0;
+    long decoded;
+    int err;
+
+    if (seq->pending->len > 0) {
+        n = MIN(len, seq->pending->len);
+        memcpy(buf, seq->pending->data, n);
+        g_byte_array_remove_range(seq->pending, 0, n);
+
+        /* stop waking up reader once there is nothing left */
+        if (seq->pending->len == 0)
+            eventfd_read(seq->pending_fd, &value);
+        return n;
+    }
+
+    /* drain every event fetched along with the first one, as long as
+       one more of them surely fits */
+    do {
+        err = snd_seq_event_input(seq->seq, &ev);
+        if (err < 0)
+            break;
+
+        decoded = snd_midi_event_decode(seq->decoder, &buf[n], len - n, ev);
+        if (decoded > 0) {
+            n += decoded;
+        } else if (decoded == -ENOMEM &&
+                   ev->type == SND_SEQ_EVENT_SYSEX) {
+            /* return what fits, the rest is read next time */
+            const guchar *data = ev->data.ext.ptr;
+            gsize fits = len - n;
+
+            memcpy(&buf[n], data, fits);
+            g_byte_array_append(seq->pending, &data[fits],
+                                ev->data.ext.len - fits);
+            eventfd_write(seq->pending_fd, 1);
+            return len;
+        } else if (decoded == -ENOMEM) {
+            g_warning("Dropped sequencer event too large to read");
+        }
+        /* other events (subscriptions etc.) have no MIDI bytes */
+    } while (len - n >= SEQ_BUFFER_SIZE &&
+             snd_seq_event_input_pending(seq->seq, 0) > 0);
+
+    if (n > 0)
+        return n;
+
+    return (err < 0) ? err : -EAGAIN;
+}
+
+static gssize seq_write(Transport *transport, const guchar *buf, gsize len)
+{
+    SeqTransport *seq = transport->priv;
+    snd_seq_event_t ev;
+    gsize done = 0;
+    long n;
+    int err;
+
+    while (done < len) {
+        snd_seq_ev_clear(&ev);
+        n = snd_midi_event_encode(seq->encoder, &buf[done], len - done, &ev);
+        if (n < 0)
+            return (done > 0) ? (gssize) done : n;
+        done += n;
+
+        /* incomplete messages stay in encoder until the rest arrives */
+        if (ev.type == SND_SEQ_EVENT_NONE)
+            continue;
+
+        snd_seq_ev_set_source(&ev, seq->port);
+        snd_seq_ev_set_subs(&ev);
+        snd_seq_ev_set_direct(&ev);
+        err = snd_seq_event_output_direct(seq->seq, &ev);
+        if (err < 0)
+            return err;
+    }
+
+    return done;
+}
+
+static gint seq_poll_descriptors_count(Transport *transport)
+{
+    SeqTransport *seq = transport->priv;
+
+    /* pending_fd comes last */
+    return snd_seq_poll_descriptors_count(seq->seq, POLLIN) + 1;
+}
+
+static void seq_poll_descriptors(Transport *transport,
+                                 struct pollfd *pfds, gint npfds)
+{
+    SeqTransport *seq = transport->priv;
+
+    snd_seq_poll_descriptors(seq->seq, pfds, npfds - 1, POLLIN);
+
+    pfds[npfds-1].fd = seq->pending_fd;
+    pfds[npfds-1].events = POLLIN;
+    pfds[npfds-1].revents = 0;
+}
+
+static unsigned short seq_poll_revents(Transport *transport,
+                                       struct pollfd *pfds, gint npfds)
+{
+    SeqTransport *seq = transport->priv;
+    unsigned short revents;
+    int err;
+
+    err = snd_seq_poll_descriptors_revents(seq->seq, pfds, npfds - 1,
+                                           &revents);
+    if (err < 0) {
+        g_warning("cannot get poll events: %s", snd_strerror(err));
+        return POLLERR;
+    }
+
+    return revents | (pfds[npfds-1].revents & POLLIN);
+}
+
+static void seq_close(Transport *transport)
+{
+    seq_free(transport->priv);
+}
+
+static const TransportBackend seq_backend = {
+    "seq", "seq:", seq_open, seq_read, seq_write,
+    seq_poll_descriptors_count, seq_poll_descriptors, seq_poll_revents,
+    NULL, seq_close
+};
+
+/* In-memory link between two threads */
+
+typedef struct {
+    GMutex *mutex;
+    GByteArray *queue[2];       /**< bytes waiting to be read by each end */
+    int event_fd[2];            /**< readable while end has something to do */
+    gboolean closed[2];
+    gint ends;                  /**< ends not closed yet */
+} LoopbackLink;
+
+typedef struct {
+    LoopbackLink *link;
+    gint end;
+} LoopbackEnd;
+
+static void loopback_signal(LoopbackLink *link, gint end)
+{
+    eventfd_write(link->event_fd[end], 1);
+}
+
+static gssize loopback_read(Transport *transport, guchar *buf, gsize len)
+{
+    LoopbackEnd *end = transport->priv;
+    LoopbackLink *link = end->link;
+    GByteArray *queue = link->queue[end->end];
+    gboolean peer_closed;
+    eventfd_t value;
+    gssize n;
+
+    g_mutex_lock(link->mutex);
+    peer_closed = link->closed[!end->end];
+    if (queue->len > 0) {
+        n = MIN(len, queue->len);
+        memcpy(buf, queue->data, n);
+        g_byte_array_remove_range(queue, 0, n);
+    } else {
+        n = peer_closed ? 0 : -EAGAIN;
+    }
+
+    /* stop waking up reader once there is nothing left */
+    if (queue->len == 0 && !peer_closed)
+        eventfd_read(link->event_fd[end->end], &value);
+    g_mutex_unlock(link->mutex);
+
+    return n;
+}
+
+static gssize loopback_write(Transport *transport, const guchar *buf,
+                             gsize len)
+{
+    LoopbackEnd *end = transport->priv;
+    LoopbackLink *link = end->link;
+    gssize n;
+
+    g_mutex_lock(link->mutex);
+    if (link->closed[!end->end]) {
+        n = -EPIPE;
+    } else {
+        g_byte_array_append(link->queue[!end->end], buf, len);
+        loopback_signal(link, !end->end);
+        n = len;
+    }
+    g_mutex_unlock(link->mutex);
+
+    return n;
+}
+
+static gint loopback_poll_descriptors_count(Transport *transport)
+{
+    return 1;
+}
+
+static void loopback_poll_descriptors(Transport *transport,
+                                      struct pollfd *pfds, gint npfds)
+{
+    LoopbackEnd *end = transport->priv;
+
+    pfds[0].fd = end->link->event_fd[end->end];
+    pfds[0].events = POLLIN;
+    pfds[0].revents = 0;
+}
+
+static void loopback_shutdown(Transport *transport)
+{
+    LoopbackEnd *end = transport->priv;
+    LoopbackLink *link = end->link;
+
+    g_mutex_lock(link->mutex);
+    if (!link->closed[end->end]) {
+        link->closed[end->end] = TRUE;
+        loopback_signal(link, !end->end);
+    }
+    g_mutex_unlock(link->mutex);
+}
+
+static void loopback_close(Transport *transport)
+{
+    LoopbackEnd *end = transport->priv;
+    LoopbackLink *link = end->link;
+    gint ends;
+
+    loopback_shutdown(transport);
+
+    g_mutex_lock(link->mutex);
+    ends = --link->ends;
+    g_mutex_unlock(link->mutex);
+
+    if (ends == 0) {
+        g_byte_array_free(link->queue[0], TRUE);
+        g_byte_array_free(link->queue[1], TRUE);
+        close(link->event_fd[0]);
+        close(link->event_fd[1]);
+        g_mutex_free(link->mutex);
+        g_slice_free(LoopbackLink, link);
+    }
+
+    g_slice_free(LoopbackEnd, end);
+}
+
+static const TransportBackend loopback_link_backend = {
+    "loopback link", NULL, NULL, loopback_read, loopback_write,
+    loopback_poll_descriptors_count, loopback_poll_descriptors,
+    fd_poll_revents, loopback_shutdown, loopback_close
+};
+
+/**
+ *  \param link link
+ *  \param end 0 or 1
+ *  \param address name of the end
+ *
+ *  \return transport using given end of link.
+ **/
+static Transport *loopback_end_new(LoopbackLink *link, gint end,
+                                   const gchar *address)
+{
+    Transport *transport = transport_new(&loopback_link_backend, address);
+    LoopbackEnd *priv = g_slice_new(LoopbackEnd);
+
+    priv->link = link;
+    priv->end = end;
+    transport->priv = priv;
+
+    return transport;
+}
+
+/* Simulated device, attached through socketpair or in-memory link */
+
+typedef struct {
+    Transport *link;            /**< host end of link to simulator */
+    Simulator *simulator;
+} SimulatedTransport;
+
+/**
+ *  \param transport transport to set up
+ *  \param spec simulator spec, see simulator_new()
+ *  \param host host end of link, taken over
+ *  \param device device end of link, taken over
+ *
+ *  Starts simulator on device end of link.
+ *
+ *  \return TRUE on success, FALSE on error.
+ **/
+static gboolean simulated_attach(Transport *transport, const gchar *spec,
+                                 Transport *host, Transport *device)
+{
+    SimulatedTransport *sim;
+    Simulator *simulator;
+
+    profile_begin("Start simulated device");
+    simulator = simulator_new(spec, device);
+    profile_end();
+
+    if (simulator == NULL) {
+        transport_close(device);
+        transport_close(host);
+        return FALSE;
+    }
+
+    debug_msg(DEBUG_STARTUP, "Using simulated device.");
+
+    /* simulator statistics cover its end of link too */
+    device->report = TRUE;
+
+    sim = g_slice_new(SimulatedTransport);
+    sim->link = host;
+    sim->simulator = simulator;
+    transport->priv = sim;
+
+    return TRUE;
+}
+
+static gboolean sim_open(Transport *transport, const gchar *address)
+{
+    Transport *host, *device;
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        g_warning("socketpair failed: %s", g_strerror(errno));
+        return FALSE;
+    }
+
+    /* simulator thread must never block on write */
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+    host = transport_new(&fd_backend, "socketpair");
+    fd_transport_init(host, fds[0], fds[0]);
+    device = transport_new(&fd_backend, "simulator end");
+    fd_transport_init(device, fds[1], fds[1]);
+
+    return simulated_attach(transport, address, host, device);
+}
+
+static gboolean loopback_open(Transport *transport, const gchar *address)
+{
+    LoopbackLink *link = g_slice_new0(LoopbackLink);
+
+    link->event_fd[0] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    link->event_fd[1] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (link->event_fd[0] < 0 || link->event_fd[1] < 0) {
+        g_warning("eventfd failed: %s", g_strerror(errno));
+        if (link->event_fd[0] >= 0)
+            close(link->event_fd[0]);
+        if (link->event_fd[1] >= 0)
+            close(link->event_fd[1]);
+        g_slice_free(LoopbackLink, link);
+        return FALSE;
+    }
+
+    link->mutex = g_mutex_new();
+    link->queue[0] = g_byte_array_new();
+    link->queue[1] = g_byte_array_new();
+    link->ends = 2;
+
+    return simulated_attach(transport, address,
+                            loopback_end_new(link, 0, "loopback"),
+                            loopback_end_new(link, 1, "simulator end"));
+}
+
+static gssize simulated_read(Transport *transport, guchar *buf, gsize len)
+{
+    SimulatedTransport *sim = transport->priv;
+
+    return sim->link->backend->read(sim->link, buf, len);
+}
+
+static gssize simulated_write(Transport *transport, const guchar *buf,
+                              gsize len)
+{
+    SimulatedTransport *sim = transport->priv;
+
+    return sim->link->backend->write(sim->link, buf, len);
+}
+
+static gint simulated_poll_descriptors_count(Transport *transport)
+{
+    SimulatedTransport *sim = transport->priv;
+
+    return sim->link->backend->poll_descriptors_count(sim->link);
+}
+
+static void simulated_poll_descriptors(Transport *transport,
+                                       struct pollfd *pfds, gint npfds)
+{
+    SimulatedTransport *sim = transport->priv;
+
+    sim->link->backend->poll_descriptors(sim->link, pfds, npfds);
+}
+
+static unsigned short simulated_poll_revents(Transport *transport,
+                                             struct pollfd *pfds, gint npfds)
+{
+    SimulatedTransport *sim = transport->priv;
+
+    return sim->link->backend->poll_revents(sim->link, pfds, npfds);
+}
+
+static void simulated_close(Transport *transport)
+{
+    SimulatedTransport *sim = transport->priv;
+
+    /* simulator thread exits once it reads end of stream */
+    sim->link->backend->shutdown(sim->link);
+    simulator_free(sim->simulator);
+    transport_close(sim->link);
+
+    g_slice_free(SimulatedTransport, sim);
+}
+
+static const TransportBackend sim_backend = {
+    "sim", "sim:", sim_open, simulated_read, simulated_write,
+    simulated_poll_descriptors_count, simulated_poll_descriptors,
+    simulated_poll_revents, NULL, simulated_close
+};
+
+static const TransportBackend loopback_backend = {
+    "loopback", "loopback:", loopback_open, simulated_read, simulated_write,
+    simulated_poll_descriptors_count, simulated_poll_descriptors,
+    simulated_poll_revents, NULL, simulated_close
+};
+
+static const TransportBackend *backends[] = {
+    &rawmidi_backend,
+    &seq_backend,
+    &unix_backend,
+    &fd_backend,
+    &sim_backend,
+    &loopback_backend,
+};
+
+/**
+ *  \param address "<prefix>:<address>", see list of backends above, or
+ *                 ALSA rawmidi device name like hw:1,0,0
+ *
+ *  Opens transport.
+ *
+ *  \return Transport which must be closed using transport_close, or NULL
+ *          on error.
+ **/
+Transport *transport_open(const gchar *address)
+{
+    const TransportBackend *backend = &rawmidi_backend;
+    Transport *transport;
+    gint64 elapsed;
+    guint x;
+
+    for (x = 0; x < G_N_ELEMENTS(backends); x++) {
+        if (g_str_has_prefix(address, backends[x]->prefix)) {
+            backend = backends[x];
+            address += strlen(backends[x]->prefix);
+            break;
+        }
+    }
+
+    transport = transport_new(backend, address);
+    if (!backend->open(transport, address)) {
+        transport_free(transport);
+        return NULL;
+    }
+    transport->report = TRUE;
+
+    elapsed = g_get_monotonic_time() - transport->open_time;
+    debug_msg(DEBUG_STATS, "Opened %s transport %s in %.1f ms",
+              backend->name, address, elapsed / 1000.0);
+
+    return transport;
+}
+
+/**
+ *  \param transport transport
+ *
+ *  \return backend name, like "rawmidi".
+ **/
+const gchar *transport_get_name(Transport *transport)
+{
+    return transport->backend->name;
+}
+
+/**
+ *  \param transport transport
+ *  \param buf buffer to read into
+ *  \param len size of buf
+ *
+ *  Reads available data. Should be called once poll descriptors report
+ *  POLLIN.
+ *
+ *  \return amount of bytes read, 0 if the other end is gone, or negative
+ *          errno (-EAGAIN if there was nothing to read).
+ **/
+gssize transport_read(Transport *transport, guchar *buf, gsize len)
+{
+    gssize n = transport->backend->read(transport, buf, len);
+
+    if (n > 0) {
+        transport->reads++;
+        transport->bytes_in += n;
+    }
+
+    return n;
+}
+
+/**
+ *  \param transport transport
+ *  \param buf data to write
+ *  \param len length of data
+ *
+ *  Writes data. Blocks until it's written, unless transport end was
+ *  created non-blocking.
+ *
+ *  \return amount of bytes written, or negative errno.
+ **/
+gssize transport_write(Transport *transport, const guchar *buf, gsize len)
+{
+    gint64 start = g_get_monotonic_time();
+    gint64 elapsed;
+    gssize n;
+
+    n = transport->backend->write(transport, buf, len);
+    if (n > 0) {
+        elapsed = g_get_monotonic_time() - start;
+        transport->writes++;
+        transport->bytes_out += n;
+        transport->write_time += elapsed;
+        transport->write_time_max = MAX(transport->write_time_max, elapsed);
+    }
+
+    return n;
+}
+
+/**
+ *  \param transport transport
+ *
+ *  \return amount of descriptors to poll for input.
+ **/
+gint transport_poll_descriptors_count(Transport *transport)
+{
+    return transport->backend->poll_descriptors_count(transport);
+}
+
+/**
+ *  \param transport transport
+ *  \param pfds array to fill in
+ *  \param npfds size of pfds, as returned by transport_poll_descriptors_count
+ *
+ *  Fills in descriptors to poll for input.
+ **/
+void transport_poll_descriptors(Transport *transport,
+                                struct pollfd *pfds, gint npfds)
+{
+    transport->backend->poll_descriptors(transport, pfds, npfds);
+}
+
+/**
+ *  \param transport transport
+ *  \param pfds descriptors after poll()
+ *  \param npfds amount of descriptors
+ *
+ *  \return poll events of transport (POLLIN, POLLERR, POLLHUP).
+ **/
+unsigned short transport_poll_revents(Transport *transport,
+                                      struct pollfd *pfds, gint npfds)
+{
+    return transport->backend->poll_revents(transport, pfds, npfds);
+}
+
+/**
+ *  \param transport transport
+ *
+ *  Closes transport, printing its statistics if requested with -D t.
+ *  Must not be used by any thread anymore.
+ **/
+void transport_close(Transport *transport)
+{
+    g_return_if_fail(transport != NULL);
+
+    if (transport->report) {
+        gdouble seconds = (g_get_monotonic_time() - transport->open_time) /
+                          1000000.0;
+
+        debug_msg(DEBUG_STATS,
+                  "%s transport %s: read %" G_GUINT64_FORMAT " bytes in %d "
+                  "reads (%.1f bytes/s), wrote %" G_GUINT64_FORMAT " bytes "
+                  "in %d writes (%.1f bytes/s)",
+                  transport->backend->name, transport->address,
+                  transport->bytes_in, transport->reads,
+                  seconds > 0 ? transport->bytes_in / seconds : 0.0,
+                  transport->bytes_out, transport->writes,
+                  seconds > 0 ? transport->bytes_out / seconds : 0.0);
+        debug_msg(DEBUG_STATS,
+                  "%s transport %s: write latency avg %.1f us, max %"
+                  G_GINT64_FORMAT " us",
+                  transport->backend->name, transport->address,
+                  transport->writes ?
+                      (gdouble) transport->write_time / transport->writes : 0.0,
+                  transport->write_time_max);
+    }
+
+    transport->backend->close(transport);
+    transport_free(transport);
+}
@@ -0,0 +1,36 @@
+/*
+ *  Copyright (c) 2026 gdigi contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; under version 3 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef GDIGI_TRANSPORT_H
+#define GDIGI_TRANSPORT_H
+
+#include <glib.h>
+#include <poll.h>
+
+typedef struct _Transport Transport;
+
+Transport *transport_open(const gchar *address);
+const gchar *transport_get_name(Transport *transport);
+gssize transport_read(Transport *transport, guchar *buf, gsize len);
+gssize transport_write(Transport *transport, const guchar *buf, gsize len);
+gint transport_poll_descriptors_count(Transport *transport);
+void transport_poll_descriptors(Transport *transport,
+                                struct pollfd *pfds, gint npfds);
+unsigned short transport_poll_revents(Transport *transport,
+                                      struct pollfd *pfds, gint npfds);
+void transport_close(Transport *transport);
+
+#endif /* GDIGI_TRANSPORT_H */